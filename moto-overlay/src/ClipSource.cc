@@ -0,0 +1,286 @@
+/****************************************************************************
+ *                                                                          *
+ *  Author : lukasz.iwaszkiewicz@gmail.com                                  *
+ *  ~~~~~~~~                                                                *
+ *  License : see COPYING file for details.                                 *
+ *  ~~~~~~~~~                                                               *
+ ****************************************************************************/
+
+#include "ClipSource.h"
+#include <gst/app/gstappsrc.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+
+/// Access units pushed per need-data.
+static const int FEED_BATCH = 8;
+
+struct ClipFeed {
+        int fd = -1;
+        H264Index index;
+        std::vector <TimeRange> ranges;
+        bool keyframesOnly = false;
+        GstCaps *caps = 0;
+        size_t range = 0;
+        size_t next = 0;                /// Next access unit to push.
+        size_t last = 0;                /// One past the last access unit of the current range.
+        bool rangeStart = true;
+        GstClockTime base = 0;          /// Running time at which current range starts.
+        GstSegment segment;
+
+        ~ClipFeed ()
+        {
+                if (fd >= 0) {
+                        close (fd);
+                }
+
+                if (caps) {
+                        gst_caps_unref (caps);
+                }
+        }
+};
+
+/**
+ * Like H264Index::unitAt, but an open end (GST_CLOCK_TIME_NONE) means "the whole file".
+ */
+static size_t unitAt (GstClockTime t)
+{
+        return (GST_CLOCK_TIME_IS_VALID (t)) ? H264Index::unitAt (t) : std::numeric_limits <size_t>::max ();
+}
+
+static void deleteFeed (gpointer data)
+{
+        delete static_cast <ClipFeed *> (data);
+}
+
+/**
+ * First access unit at or after n which is to be pushed, feed->last if none.
+ */
+static size_t nextUnit (ClipFeed const *feed, size_t n)
+{
+        if (!feed->keyframesOnly) {
+                return n;
+        }
+
+        std::vector <AccessUnit> const &units = feed->index.units ();
+
+        while (n < feed->last && !units[n].keyframe) {
+                ++n;
+        }
+
+        return n;
+}
+
+/**
+ * Positions the feed at the start of feed->range. Returns false if there are no more ranges.
+ */
+static bool startRange (ClipFeed *feed)
+{
+        std::vector <AccessUnit> const &units = feed->index.units ();
+
+        while (feed->range < feed->ranges.size ()) {
+                TimeRange const &r = feed->ranges[feed->range];
+                size_t first = H264Index::unitAt (r.begin);
+                feed->last = std::min (unitAt (r.end), units.size ());
+
+                if (first < feed->last) {
+                        feed->next = nextUnit (feed, feed->index.keyframeBefore (first));
+
+                        gst_segment_init (&feed->segment, GST_FORMAT_TIME);
+                        feed->segment.start = r.begin;
+                        feed->segment.stop = r.end;
+                        feed->segment.time = r.begin;
+                        feed->segment.position = r.begin;
+                        feed->segment.base = feed->base;
+                        feed->segment.rate = r.speedup;
+                        feed->rangeStart = true;
+                        return true;
+                }
+
+                ++feed->range;
+        }
+
+        return false;
+}
+
+static GstBuffer *readUnit (ClipFeed *feed, size_t n, bool withParameterSets)
+{
+        AccessUnit const &unit = feed->index.units ()[n];
+        std::string const &ps = feed->index.parameterSets ();
+        size_t prefix = (withParameterSets && !unit.parameterSets) ? ps.size () : 0;
+        GstBuffer *buffer = gst_buffer_new_allocate (NULL, prefix + unit.size, NULL);
+        GstMapInfo map;
+
+        gst_buffer_map (buffer, &map, GST_MAP_WRITE);
+        std::copy (ps.begin (), ps.begin () + prefix, map.data);
+        ssize_t got = pread (feed->fd, map.data + prefix, unit.size, unit.offset);
+        gst_buffer_unmap (buffer, &map);
+
+        if (got != ssize_t (unit.size)) {
+                gst_buffer_unref (buffer);
+                return NULL;
+        }
+
+        GST_BUFFER_PTS (buffer) = GST_BUFFER_DTS (buffer) = H264Index::timeOf (n);
+        GST_BUFFER_DURATION (buffer) = VIDEO_FRAME_DURATION_NS;
+
+        if (!unit.keyframe) {
+                GST_BUFFER_FLAG_SET (buffer, GST_BUFFER_FLAG_DELTA_UNIT);
+        }
+
+        return buffer;
+}
+
+static void feedClip (GstElement *appsrc, guint, gpointer user_data)
+{
+        ClipFeed *feed = static_cast <ClipFeed *> (user_data);
+
+        if (feed->range >= feed->ranges.size ()) {
+                return;
+        }
+
+        for (int n = 0; n < FEED_BATCH; ++n) {
+                if (feed->next >= feed->last) {
+                        TimeRange const &r = feed->ranges[feed->range];
+                        feed->base += (r.end - r.begin) / r.speedup;
+                        ++feed->range;
+
+                        if (!startRange (feed)) {
+                                gst_app_src_end_of_stream (GST_APP_SRC (appsrc));
+                                return;
+                        }
+                }
+
+                GstBuffer *buffer = readUnit (feed, feed->next, feed->rangeStart);
+
+                if (!buffer) {
+                        GError *err = g_error_new_literal (GST_RESOURCE_ERROR, GST_RESOURCE_ERROR_READ, "Short read from H.264 file");
+                        gst_element_post_message (appsrc, gst_message_new_error (GST_OBJECT (appsrc), err, NULL));
+                        g_error_free (err);
+                        return;
+                }
+
+                size_t following = nextUnit (feed, feed->next + 1);
+
+                if (feed->keyframesOnly) {
+                        GST_BUFFER_DURATION (buffer) = H264Index::timeOf (following - feed->next);
+                }
+
+                if (feed->rangeStart) {
+                        GST_BUFFER_FLAG_SET (buffer, GST_BUFFER_FLAG_DISCONT);
+                        feed->rangeStart = false;
+                }
+
+                // A sample carrying a different segment makes appsrc send a new segment event.
+                GstSample *sample = gst_sample_new (buffer, feed->caps, &feed->segment, NULL);
+                gst_buffer_unref (buffer);
+                GstFlowReturn ret = gst_app_src_push_sample (GST_APP_SRC (appsrc), sample);
+                gst_sample_unref (sample);
+                feed->next = following;
+
+                if (ret != GST_FLOW_OK) {
+                        return;
+                }
+        }
+}
+
+GstElement *createClipSource (std::string const &path, std::vector <TimeRange> const &ranges, bool keyframesOnly)
+{
+        // Only as much of the file as the last range needs gets scanned.
+        size_t units = 0;
+
+        for (TimeRange const &r : ranges) {
+                units = std::max (units, unitAt (r.end));
+        }
+
+        H264Index index;
+
+        if (!index.scan (path, units)) {
+                g_critical ("Unable to index %s", path.c_str ());
+                return NULL;
+        }
+
+        return createClipSource (path, index, ranges, keyframesOnly);
+}
+
+GstElement *createClipSource (std::string const &path, H264Index const &index, std::vector <TimeRange> const &ranges, bool keyframesOnly)
+{
+        ClipFeed *feed = new ClipFeed;
+        feed->index = index;
+        feed->ranges = ranges;
+        feed->keyframesOnly = keyframesOnly;
+        feed->fd = open (path.c_str (), O_RDONLY);
+
+        if (feed->fd < 0) {
+                g_critical ("Unable to open %s", path.c_str ());
+                delete feed;
+                return NULL;
+        }
+
+        if (!startRange (feed)) {
+                g_critical ("Requested range lies outside of %s", path.c_str ());
+                delete feed;
+                return NULL;
+        }
+
+        feed->caps = gst_caps_new_simple ("video/x-h264",
+                                          "stream-format", G_TYPE_STRING, "byte-stream",
+                                          "alignment", G_TYPE_STRING, "au",
+                                          "framerate", GST_TYPE_FRACTION, VIDEO_FRAME_RATE, 1,
+                                          NULL);
+
+        GstElement *appsrc = gst_element_factory_make ("appsrc", "source");
+        g_object_set (G_OBJECT (appsrc), "caps", feed->caps, "format", GST_FORMAT_TIME, "handle-segment-change", TRUE, NULL);
+        g_object_set_data_full (G_OBJECT (appsrc), "feed", feed, deleteFeed);
+        g_signal_connect (appsrc, "need-data", G_CALLBACK (feedClip), feed);
+        return appsrc;
+}
+
+/****************************************************************************/
+
+size_t unitsFor (TimeRange const &range)
+{
+        return unitAt (range.end);
+}
+
+std::vector <TimeRange> splitAtKeyframes (std::string const &path, TimeRange const &range, size_t chunks)
+{
+        H264Index index;
+
+        if (!index.scan (path, unitsFor (range))) {
+                g_critical ("Unable to index %s", path.c_str ());
+                return std::vector <TimeRange> ();
+        }
+
+        return splitAtKeyframes (path, index, range, chunks);
+}
+
+std::vector <TimeRange> splitAtKeyframes (std::string const &path, H264Index const &index, TimeRange const &range, size_t chunks)
+{
+        std::vector <TimeRange> parts;
+
+        size_t first = H264Index::unitAt (range.begin);
+        size_t last = std::min (unitAt (range.end), index.units ().size ());
+
+        if (first >= last) {
+                g_critical ("Requested range lies outside of %s", path.c_str ());
+                return parts;
+        }
+
+        GstClockTime begin = range.begin;
+
+        for (size_t n = 1; n < chunks; ++n) {
+                GstClockTime split = H264Index::timeOf (index.keyframeBefore (first + (last - first) * n / chunks));
+
+                // A GOP longer than a chunk, merge with the next one.
+                if (split <= begin) {
+                        continue;
+                }
+
+                parts.push_back (TimeRange { begin, split });
+                begin = split;
+        }
+
+        parts.push_back (TimeRange { begin, range.end });
+        return parts;
+}
@@ -0,0 +1,61 @@
+/****************************************************************************
+ *                                                                          *
+ *  Author : lukasz.iwaszkiewicz@gmail.com                                  *
+ *  ~~~~~~~~                                                                *
+ *  License : see COPYING file for details.                                 *
+ *  ~~~~~~~~~                                                               *
+ ****************************************************************************/
+
+#ifndef CLIPSOURCE_H_
+#define CLIPSOURCE_H_
+
+#include <gst/gst.h>
+#include <string>
+#include <vector>
+#include "H264Index.h"
+
+/**
+ * Part of the ride, in stream time.
+ */
+struct TimeRange {
+        TimeRange (GstClockTime b = 0, GstClockTime e = GST_CLOCK_TIME_NONE, int s = 1) : begin (b), end (e), speedup (s) {}
+
+        GstClockTime begin;
+        GstClockTime end;
+        int speedup;                    /// Plays this many times faster (sent as the segment rate).
+};
+
+/**
+ * Creates an appsrc which reads only the given ranges of a raw H.264 file. Every range
+ * starts at the nearest preceding keyframe (with SPS/PPS prepended if the keyframe lacks
+ * them) and is sent with a segment [begin, end), so the decoder drops the extra lead-in
+ * frames and nothing outside the ranges is decoded. Buffers keep their position in the
+ * ride as PTS, while running time continues across ranges, so they play back to back.
+ * A range with speedup > 1 takes proportionally less running time; dropping the frames
+ * which then come too densely is up to the downstream.
+ *
+ * With keyframesOnly every other access unit is skipped, each keyframe lasting until the
+ * next one (for draft renders : nothing but the keyframes gets decoded).
+ *
+ * Returns NULL if the file can't be indexed.
+ */
+GstElement *createClipSource (std::string const &path, std::vector <TimeRange> const &ranges, bool keyframesOnly = false);
+
+/// Same, with the file indexed already (at least as far as the ranges reach, see unitsFor).
+GstElement *createClipSource (std::string const &path, H264Index const &index, std::vector <TimeRange> const &ranges, bool keyframesOnly = false);
+
+/**
+ * Splits range into (at most) chunks consecutive ranges of about the same length, every
+ * one but the first starting at a keyframe, so they can be decoded and encoded
+ * independently. Fewer are returned if the GOPs are too long. Empty if the file can't be
+ * indexed or the range lies outside of it.
+ */
+std::vector <TimeRange> splitAtKeyframes (std::string const &path, TimeRange const &range, size_t chunks);
+
+/// Same, with the file indexed already. Both take one index, so a file is scanned once.
+std::vector <TimeRange> splitAtKeyframes (std::string const &path, H264Index const &index, TimeRange const &range, size_t chunks);
+
+/// Access units to index for range (all of them if it is open ended).
+size_t unitsFor (TimeRange const &range);
+
+#endif /* CLIPSOURCE_H_ */
@@ -0,0 +1,168 @@
+/****************************************************************************
+ *                                                                          *
+ *  Author : lukasz.iwaszkiewicz@gmail.com                                  *
+ *  ~~~~~~~~                                                                *
+ *  License : see COPYING file for details.                                 *
+ *  ~~~~~~~~~                                                               *
+ ****************************************************************************/
+
+
+#include "ContactSheet.h"
+#include "TelemetryCursor.h"
+#include <gst/app/gstappsink.h>
+#include <gst/video/video.h>
+#include <cstdio>
+
+/**
+ * Draws a decoded thumbnail into its tile, with the gauges and a readable caption on top.
+ */
+static void drawTile (cairo_t *cr, GstSample *sample, int x, int y, YamahaPainter *painter, Frame const &frame)
+{
+        GstVideoInfo info;
+        GstBuffer *buffer = gst_sample_get_buffer (sample);
+        GstMapInfo map;
+
+        if (!gst_video_info_from_caps (&info, gst_sample_get_caps (sample)) || !gst_buffer_map (buffer, &map, GST_MAP_READ)) {
+                return;
+        }
+
+        int width = GST_VIDEO_INFO_WIDTH (&info);
+        int height = GST_VIDEO_INFO_HEIGHT (&info);
+        cairo_surface_t *thumbnail = cairo_image_surface_create_for_data (map.data, CAIRO_FORMAT_RGB24, width, height, GST_VIDEO_INFO_PLANE_STRIDE (&info, 0));
+
+        cairo_save (cr);
+        cairo_translate (cr, x, y);
+        cairo_rectangle (cr, 0, 0, width, height);
+        cairo_clip (cr);
+        cairo_set_source_surface (cr, thumbnail, 0, 0);
+        cairo_paint (cr);
+        painter->paint (cr, frame);
+
+        // The gauges are tiny at this size.
+        char caption[64];
+        uint64_t seconds = GST_BUFFER_PTS (buffer) / GST_SECOND;
+        snprintf (caption, sizeof (caption), "%02d:%02d:%02d  %d km/h  %d rpm", int (seconds / 3600), int (seconds / 60 % 60), int (seconds % 60),
+                  int (frame.velocity + 0.5), int (frame.rpm + 0.5));
+
+        cairo_select_font_face (cr, "sans-serif", CAIRO_FONT_SLANT_NORMAL, CAIRO_FONT_WEIGHT_BOLD);
+        cairo_set_font_size (cr, 12.0);
+        cairo_move_to (cr, 6, 16);
+        cairo_text_path (cr, caption);
+        cairo_set_source_rgb (cr, 0, 0, 0);
+        cairo_set_line_width (cr, 3);
+        cairo_stroke_preserve (cr);
+        cairo_set_source_rgb (cr, 1, 1, 1);
+        cairo_fill (cr);
+        cairo_restore (cr);
+
+        cairo_surface_destroy (thumbnail);
+        gst_buffer_unmap (buffer, &map);
+}
+
+bool renderContactSheet (std::string const &h264Path, TimeRange const &range, FrameVector const &frames, FrameIndex const *index,
+                         YamahaAssets *assets, ContactSheetConfig const &config, std::string const &pngPath)
+{
+        // Indexed once for both the split and the source.
+        H264Index units;
+
+        if (!units.scan (h264Path, unitsFor (range))) {
+                g_critical ("Unable to index %s", h264Path.c_str ());
+                return false;
+        }
+
+        // One single frame range at a keyframe per thumbnail.
+        std::vector <TimeRange> ranges = splitAtKeyframes (h264Path, units, range, config.thumbnails);
+
+        if (ranges.empty ()) {
+                return false;
+        }
+
+        for (TimeRange &r : ranges) {
+                r.end = r.begin + VIDEO_FRAME_DURATION_NS;
+        }
+
+        GstElement *pipeline            = gst_pipeline_new ("contact-sheet");
+        GstElement *source              = createClipSource (h264Path, units, ranges, true);
+        GstElement *parser              = gst_element_factory_make ("h264parse", "parser");
+        GstElement *decoder             = gst_element_factory_make ("avdec_h264", "decoder");
+        GstElement *scale               = gst_element_factory_make ("videoscale", "scale");
+        GstElement *convert             = gst_element_factory_make ("videoconvert", "convert");
+        GstElement *appsink             = gst_element_factory_make ("appsink", "thumbnails");
+
+        if (!source) {
+                gst_object_unref (pipeline);
+                return false;
+        }
+
+        // Cairo's RGB24 is BGRx in memory on little endian machines.
+        GstCaps *caps = gst_caps_new_simple ("video/x-raw",
+                                             "format", G_TYPE_STRING, (G_BYTE_ORDER == G_LITTLE_ENDIAN) ? "BGRx" : "xRGB",
+                                             "width", G_TYPE_INT, config.thumbWidth,
+                                             "height", G_TYPE_INT, config.thumbHeight,
+                                             "pixel-aspect-ratio", GST_TYPE_FRACTION, 1, 1,
+                                             NULL);
+
+        g_object_set (G_OBJECT (appsink), "caps", caps, "sync", FALSE, NULL);
+        gst_caps_unref (caps);
+
+        gst_bin_add_many (GST_BIN (pipeline), source, parser, decoder, scale, convert, appsink, NULL);
+
+        if (!gst_element_link_many (source, parser, decoder, scale, convert, appsink, NULL)) {
+                g_warning ("Failed to link elements!");
+        }
+
+        int rows = (int (ranges.size ()) + config.columns - 1) / config.columns;
+        cairo_surface_t *sheet = cairo_image_surface_create (CAIRO_FORMAT_RGB24, config.columns * config.thumbWidth, rows * config.thumbHeight);
+        cairo_t *cr = cairo_create (sheet);
+        YamahaPainter painter (assets);
+        TelemetryFanout telemetry (&frames, index);
+        painter.bake (config.thumbWidth);
+
+        gst_element_set_state (pipeline, GST_STATE_PLAYING);
+
+        bool ok = true;
+        int tile = 0;
+        GstBus *bus = gst_pipeline_get_bus (GST_PIPELINE (pipeline));
+
+        while (!gst_app_sink_is_eos (GST_APP_SINK (appsink))) {
+                GstSample *sample = gst_app_sink_try_pull_sample (GST_APP_SINK (appsink), 100 * GST_MSECOND);
+
+                if (!sample) {
+                        GstMessage *message = gst_bus_pop_filtered (bus, GST_MESSAGE_ERROR);
+
+                        if (message) {
+                                GError *err = NULL;
+                                gst_message_parse_error (message, &err, NULL);
+                                g_critical ("Making contact sheet of %s failed : %s", h264Path.c_str (), err->message);
+                                g_error_free (err);
+                                gst_message_unref (message);
+                                ok = false;
+                                break;
+                        }
+
+                        continue;
+                }
+
+                // The same lookup the video pipeline does, so a thumbnail shows what the video would.
+                uint64_t pts = GST_BUFFER_PTS (gst_sample_get_buffer (sample));
+                telemetry.resolve (pts);
+                Frame frame = telemetry.lookup (pts);
+                drawTile (cr, sample, (tile % config.columns) * config.thumbWidth, (tile / config.columns) * config.thumbHeight, &painter, frame);
+                gst_sample_unref (sample);
+                ++tile;
+        }
+
+        gst_object_unref (bus);
+        gst_element_set_state (pipeline, GST_STATE_NULL);
+        gst_object_unref (pipeline);
+
+        cairo_destroy (cr);
+
+        if (ok && cairo_surface_write_to_png (sheet, pngPath.c_str ()) != CAIRO_STATUS_SUCCESS) {
+                g_critical ("Unable to write %s", pngPath.c_str ());
+                ok = false;
+        }
+
+        cairo_surface_destroy (sheet);
+        return ok;
+}
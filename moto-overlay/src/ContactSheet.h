@@ -0,0 +1,38 @@
+/****************************************************************************
+ *                                                                          *
+ *  Author : lukasz.iwaszkiewicz@gmail.com                                  *
+ *  ~~~~~~~~                                                                *
+ *  License : see COPYING file for details.                                 *
+ *  ~~~~~~~~~                                                               *
+ ****************************************************************************/
+
+
+#ifndef CONTACTSHEET_H_
+#define CONTACTSHEET_H_
+
+#include <string>
+#include "ClipSource.h"
+#include "FrameIndex.h"
+#include "FrameMap.h"
+#include "YamahaPainter.h"
+
+/**
+ * Layout of a contact sheet.
+ */
+struct ContactSheetConfig {
+        int thumbnails = 24;            /// At most that many, fewer if the keyframes are sparse.
+        int columns = 6;
+        int thumbWidth = 320;
+        int thumbHeight = 180;
+};
+
+/**
+ * Writes a PNG grid of thumbnails evenly spread over range of the H.264 file, each stamped
+ * with its telemetry (matched through the recorder's sidecar index if there is one, see
+ * TelemetryFanout). Only the keyframe of every thumbnail is read and decoded. Returns
+ * false on error.
+ */
+bool renderContactSheet (std::string const &h264Path, TimeRange const &range, FrameVector const &frames, FrameIndex const *index,
+                         YamahaAssets *assets, ContactSheetConfig const &config, std::string const &pngPath);
+
+#endif /* CONTACTSHEET_H_ */
@@ -9,6 +9,7 @@
 #ifndef PAINTERDTO_H_
 #define PAINTERDTO_H_
 
+#include <cstdint>
 #include <ostream>
 
 struct Frame {
@@ -16,7 +17,7 @@ struct Frame {
         Frame () {}
         Frame (float r, float v, float e) : rpm {r}, velocity {v}, engineTemp {e} {}
 
-        uint32_t timestamp = 0;
+        uint64_t timestamp = 0;         /// Microseconds since the start of the recording.
         float velocity = 0;
         float rpm = 0;
         float engineTemp = 0;
@@ -0,0 +1,50 @@
+/****************************************************************************
+ *                                                                          *
+ *  Author : lukasz.iwaszkiewicz@gmail.com                                  *
+ *  ~~~~~~~~                                                                *
+ *  License : see COPYING file for details.                                 *
+ *  ~~~~~~~~~                                                               *
+ ****************************************************************************/
+
+#include "FrameIndex.h"
+#include <cstdio>
+#include <cstring>
+
+bool FrameIndex::read (std::string const &path)
+{
+        entries.clear ();
+        FILE *file = fopen (path.c_str (), "rb");
+
+        if (!file) {
+                return false;
+        }
+
+        FrameIndexHeader header;
+        bool ok = fread (&header, sizeof (header), 1, file) == 1 && memcmp (header.magic, "MBFI", 4) == 0 &&
+                  header.version == FRAME_INDEX_VERSION && header.entrySize == sizeof (FrameIndexEntry);
+
+        if (ok) {
+                entries.resize (header.count);
+                ok = header.count == 0 || fread (&entries[0], sizeof (FrameIndexEntry), header.count, file) == header.count;
+        }
+
+        fclose (file);
+
+        if (!ok) {
+                entries.clear ();
+        }
+
+        return ok;
+}
+
+std::string FrameIndex::pathFor (std::string const &h264Path)
+{
+        std::string::size_type dot = h264Path.rfind ('.');
+        std::string::size_type slash = h264Path.rfind ('/');
+
+        if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) {
+                return h264Path + ".frames";
+        }
+
+        return h264Path.substr (0, dot) + ".frames";
+}
@@ -0,0 +1,65 @@
+/****************************************************************************
+ *                                                                          *
+ *  Author : lukasz.iwaszkiewicz@gmail.com                                  *
+ *  ~~~~~~~~                                                                *
+ *  License : see COPYING file for details.                                 *
+ *  ~~~~~~~~~                                                               *
+ ****************************************************************************/
+
+#ifndef FRAMEINDEX_H_
+#define FRAMEINDEX_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/*
+ * NNNNN.frames, written by moto-raspberry next to every NNNNN.h264 (FrameIndex.h there, keep
+ * both in sync) : a header, then one entry per encoded frame, little endian.
+ */
+
+const uint16_t FRAME_INDEX_VERSION = 1;
+const uint32_t FRAME_INDEX_KEYFRAME = 1 << 0;           /// IDR.
+const uint32_t FRAME_INDEX_CONFIG = 1 << 1;             /// Starts with SPS/PPS.
+const uint32_t FRAME_INDEX_NO_TELEMETRY = UINT32_MAX;
+
+struct FrameIndexHeader {
+        char magic[4];                  /// "MBFI"
+        uint16_t version;
+        uint16_t entrySize;
+        uint32_t count;
+        uint32_t reserved;
+};
+
+struct FrameIndexEntry {
+        int64_t pts;                    /// Encoder PTS [us], INT64_MIN if it had none.
+        uint32_t timeUs;                /// Capture time since the segment start [us], the clock of the CSV timestamps.
+        uint32_t offset;                /// Of the frame (its SPS/PPS included) in NNNNN.h264.
+        uint32_t telemetry;             /// Row of NNNNN.csv nearest to timeUs.
+        uint32_t flags;
+};
+
+static_assert (sizeof (FrameIndexHeader) == 16 && sizeof (FrameIndexEntry) == 24, "FrameIndex layout");
+
+/**
+ * Per frame sidecar of a recorder segment. Frame n is access unit n of the H.264 file, so
+ * the telemetry row shown with it and its byte offset are one lookup away.
+ */
+class FrameIndex {
+public:
+
+        /// False if the file is missing or not a sidecar of a known version.
+        bool read (std::string const &path);
+
+        size_t size () const { return entries.size (); }
+        FrameIndexEntry const &operator[] (size_t n) const { return entries[n]; }
+
+        /// NNNNN.frames for NNNNN.h264.
+        static std::string pathFor (std::string const &h264Path);
+
+private:
+
+        std::vector <FrameIndexEntry> entries;
+};
+
+#endif /* FRAMEINDEX_H_ */
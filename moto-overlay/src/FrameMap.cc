@@ -8,6 +8,7 @@
 
 #include "FrameMap.h"
 #include <fstream>
+#include <sstream>
 #include <boost/tokenizer.hpp>
 #include <boost/lexical_cast.hpp>
 #include "Frame.h"
@@ -15,15 +16,41 @@
 /**
  * CSV : timestamp, velocity, rpm, engineTemp, airTemp, frontBrake, rearBrake, leftTurn, rightTurn, parkingLight
  */
+Frame parseFrame (std::string const &line)
+{
+        typedef boost::tokenizer <boost::escaped_list_separator <char>> Tokenizer;
+        Tokenizer tok (line);
+        Tokenizer::const_iterator i = tok.begin ();
+        Frame frame;
+
+        frame.timestamp = boost::lexical_cast <uint64_t> (*i++);
+        frame.velocity = boost::lexical_cast <float> (*i++);
+        frame.rpm = boost::lexical_cast <float> (*i++);
+        frame.engineTemp = boost::lexical_cast <float> (*i++);
+        frame.airTemp = boost::lexical_cast <float> (*i++);
+        frame.frontBrake = boost::lexical_cast <bool> (*i++);
+        frame.rearBrake = boost::lexical_cast <bool> (*i++);
+        frame.leftTurn = boost::lexical_cast <bool> (*i++);
+        frame.rightTurn = boost::lexical_cast <bool> (*i++);
+        frame.parkingLight = boost::lexical_cast <bool> (*i++);
+        return frame;
+}
+
+/**
+ * Inverse of parseFrame.
+ */
+std::string formatFrame (Frame const &f)
+{
+        std::ostringstream o;
+        o << f.timestamp << "," << f.velocity << "," << f.rpm << "," << f.engineTemp << "," << f.airTemp << "," << f.frontBrake << ","
+          << f.rearBrake << "," << f.leftTurn << "," << f.rightTurn << "," << f.parkingLight;
+        return o.str ();
+}
+
 FrameVector readFrames (std::string const &path)
 {
         FrameVector frames;
         std::ifstream file (path);
-
-        Frame frame;
-        uint32_t time;
-
-        typedef boost::tokenizer <boost::escaped_list_separator <char>> Tokenizer;
         std::string line;
 
         while (std::getline (file, line)) {
@@ -31,19 +58,7 @@ FrameVector readFrames (std::string const &path)
                 std::cerr << line << std::endl;
 #endif
 
-                Tokenizer tok (line);
-                Tokenizer::const_iterator i = tok.begin ();
-                frame.timestamp = boost::lexical_cast <uint32_t> (*i++);
-                frame.velocity = boost::lexical_cast <float> (*i++);
-                frame.rpm = boost::lexical_cast <float> (*i++);
-                frame.engineTemp = boost::lexical_cast <float> (*i++);
-                frame.airTemp = boost::lexical_cast <float> (*i++);
-                frame.frontBrake = boost::lexical_cast <bool> (*i++);
-                frame.rearBrake = boost::lexical_cast <bool> (*i++);
-                frame.leftTurn = boost::lexical_cast <bool> (*i++);
-                frame.rightTurn = boost::lexical_cast <bool> (*i++);
-                frame.parkingLight = boost::lexical_cast <bool> (*i++);
-                frames.push_back (frame);
+                frames.push_back (parseFrame (line));
         }
 
         return frames;
@@ -16,6 +16,12 @@
 
 typedef std::vector <Frame> FrameVector;
 
+/// Parses one CSV telemetry line.
+Frame parseFrame (std::string const &line);
+
+/// Formats a frame as a CSV line understood by parseFrame (no trailing newline).
+std::string formatFrame (Frame const &frame);
+
 FrameVector readFrames (std::string const &path);
 
 std::ostream &operator<< (std::ostream &o, FrameVector const &map);
@@ -0,0 +1,320 @@
+/****************************************************************************
+ *                                                                          *
+ *  Author : lukasz.iwaszkiewicz@gmail.com                                  *
+ *  ~~~~~~~~                                                                *
+ *  License : see COPYING file for details.                                 *
+ *  ~~~~~~~~~                                                               *
+ ****************************************************************************/
+
+#include "H264Index.h"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+enum NalType { NAL_SLICE = 1, NAL_IDR = 5, NAL_SEI = 6, NAL_SPS = 7, NAL_PPS = 8, NAL_AUD = 9 };
+
+/*
+ * NAME.units, the scan of NAME.h264 kept for the next run : a header, then one entry per
+ * access unit, native endian (it never leaves the machine which wrote it).
+ */
+
+const uint16_t UNIT_CACHE_VERSION = 1;
+
+struct UnitCacheHeader {
+        char magic[4];                  /// "MBUI"
+        uint16_t version;
+        uint16_t entrySize;
+        uint64_t fileSize;              /// The cache is stale if the size or the modification time of the file differs.
+        int64_t mtimeNs;
+        uint64_t count;
+        uint32_t complete;              /// The scan reached the end of the file.
+        uint32_t reserved;
+};
+
+struct UnitCacheEntry {
+        uint64_t offset;
+        uint32_t size;
+        uint32_t flags;                 /// FRAME_INDEX_KEYFRAME, FRAME_INDEX_CONFIG.
+};
+
+static_assert (sizeof (UnitCacheHeader) == 40 && sizeof (UnitCacheEntry) == 16, "H264Index cache layout");
+
+static int64_t mtimeNs (struct stat const &st)
+{
+        return int64_t (st.st_mtim.tv_sec) * 1000000000LL + st.st_mtim.tv_nsec;
+}
+
+/**
+ * Returns pointer to the next 00 00 01 at or after p, or end.
+ */
+static const uint8_t *nextStartCode (const uint8_t *p, const uint8_t *end)
+{
+        p += 2;
+
+        while (p < end) {
+                p = static_cast <const uint8_t *> (memchr (p, 0x01, end - p));
+
+                if (!p) {
+                        return end;
+                }
+
+                if (p[-1] == 0 && p[-2] == 0) {
+                        return p - 2;
+                }
+
+                ++p;
+        }
+
+        return end;
+}
+
+bool H264Index::scan (std::string const &path, size_t maxUnits)
+{
+        FrameIndex sidecar;
+
+        if (sidecar.read (FrameIndex::pathFor (path)) && load (path, sidecar, maxUnits)) {
+                return true;
+        }
+
+        if (loadCache (path, maxUnits)) {
+                return true;
+        }
+
+        if (!scanStream (path, maxUnits)) {
+                return false;
+        }
+
+        writeCache (path, accessUnits.size () < maxUnits);
+        return true;
+}
+
+std::string H264Index::cachePathFor (std::string const &h264Path)
+{
+        std::string frames = FrameIndex::pathFor (h264Path);
+        return frames.substr (0, frames.size () - std::string (".frames").size ()) + ".units";
+}
+
+/**
+ * Units from NAME.units, if it is of this very file and covers maxUnits. The parameter sets
+ * come from the stream, as with the sidecar.
+ */
+bool H264Index::loadCache (std::string const &path, size_t maxUnits)
+{
+        FILE *file = fopen (cachePathFor (path).c_str (), "rb");
+
+        if (!file) {
+                return false;
+        }
+
+        struct stat st;
+        UnitCacheHeader header;
+        std::vector <UnitCacheEntry> entries;
+        bool ok = stat (path.c_str (), &st) == 0 && fread (&header, sizeof (header), 1, file) == 1 && memcmp (header.magic, "MBUI", 4) == 0 &&
+                  header.version == UNIT_CACHE_VERSION && header.entrySize == sizeof (UnitCacheEntry) && header.fileSize == uint64_t (st.st_size) &&
+                  header.mtimeNs == mtimeNs (st) && (header.complete || header.count >= maxUnits);
+
+        if (ok) {
+                entries.resize (std::min <uint64_t> (header.count, maxUnits));
+                ok = !entries.empty () && fread (&entries[0], sizeof (UnitCacheEntry), entries.size (), file) == entries.size ();
+        }
+
+        fclose (file);
+
+        if (!ok || !scanStream (path, 1) || accessUnits.empty () || accessUnits[0].offset != entries[0].offset) {
+                accessUnits.clear ();
+                return false;
+        }
+
+        accessUnits.clear ();
+
+        for (UnitCacheEntry const &e : entries) {
+                AccessUnit unit;
+                unit.offset = e.offset;
+                unit.size = e.size;
+                unit.keyframe = e.flags & FRAME_INDEX_KEYFRAME;
+                unit.parameterSets = e.flags & FRAME_INDEX_CONFIG;
+                accessUnits.push_back (unit);
+        }
+
+        return true;
+}
+
+/**
+ * Written aside and renamed, so a concurrent run never reads half of it. Not being able to
+ * (read only media) only costs the next run the scan.
+ */
+void H264Index::writeCache (std::string const &path, bool complete) const
+{
+        struct stat st;
+
+        if (accessUnits.empty () || stat (path.c_str (), &st) < 0) {
+                return;
+        }
+
+        std::vector <UnitCacheEntry> entries;
+        entries.reserve (accessUnits.size ());
+
+        for (AccessUnit const &unit : accessUnits) {
+                entries.push_back (UnitCacheEntry { unit.offset, unit.size, (unit.keyframe ? FRAME_INDEX_KEYFRAME : 0) | (unit.parameterSets ? FRAME_INDEX_CONFIG : 0) });
+        }
+
+        UnitCacheHeader header = { { 'M', 'B', 'U', 'I' }, UNIT_CACHE_VERSION, sizeof (UnitCacheEntry), uint64_t (st.st_size), mtimeNs (st),
+                                   entries.size (), complete, 0 };
+        std::string cache = cachePathFor (path);
+        std::string tmp = cache + ".tmp";
+        FILE *file = fopen (tmp.c_str (), "wb");
+
+        if (!file) {
+                return;
+        }
+
+        bool ok = fwrite (&header, sizeof (header), 1, file) == 1 && fwrite (&entries[0], sizeof (UnitCacheEntry), entries.size (), file) == entries.size ();
+        ok = fclose (file) == 0 && ok;
+
+        if (!ok || rename (tmp.c_str (), cache.c_str ()) != 0) {
+                remove (tmp.c_str ());
+        }
+}
+
+/**
+ * Units from the sidecar. The parameter sets still come from the stream (its first unit).
+ * False if the sidecar doesn't fit the file.
+ */
+bool H264Index::load (std::string const &path, FrameIndex const &sidecar, size_t maxUnits)
+{
+        struct stat st;
+
+        if (sidecar.size () == 0 || stat (path.c_str (), &st) < 0 || !scanStream (path, 1) || accessUnits.empty () ||
+            accessUnits[0].offset != sidecar[0].offset) {
+                return false;
+        }
+
+        accessUnits.clear ();
+
+        for (size_t n = 0; n < sidecar.size () && n < maxUnits; ++n) {
+                uint64_t end = (n + 1 < sidecar.size ()) ? sidecar[n + 1].offset : uint64_t (st.st_size);
+
+                if (sidecar[n].offset >= end || end > uint64_t (st.st_size)) {
+                        accessUnits.clear ();
+                        return false;
+                }
+
+                AccessUnit unit;
+                unit.offset = sidecar[n].offset;
+                unit.size = end - unit.offset;
+                unit.keyframe = sidecar[n].flags & FRAME_INDEX_KEYFRAME;
+                unit.parameterSets = sidecar[n].flags & FRAME_INDEX_CONFIG;
+                accessUnits.push_back (unit);
+        }
+
+        return true;
+}
+
+bool H264Index::scanStream (std::string const &path, size_t maxUnits)
+{
+        accessUnits.clear ();
+        parameterSetBytes.clear ();
+
+        int fd = open (path.c_str (), O_RDONLY);
+
+        if (fd < 0) {
+                return false;
+        }
+
+        struct stat st;
+
+        if (fstat (fd, &st) < 0 || st.st_size == 0) {
+                close (fd);
+                return false;
+        }
+
+        void *mapped = mmap (NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close (fd);
+
+        if (mapped == MAP_FAILED) {
+                return false;
+        }
+
+        madvise (mapped, st.st_size, MADV_SEQUENTIAL);
+
+        const uint8_t *data = static_cast <const uint8_t *> (mapped);
+        const uint8_t *end = data + st.st_size;
+        const uint8_t *sc = nextStartCode (data, end);
+        std::string sps, pps;
+        AccessUnit unit;
+        bool inUnit = false;
+        bool unitHasSlice = false;
+
+        while (sc < end && accessUnits.size () < maxUnits) {
+                // 4 byte start codes : the leading zero belongs to this NAL.
+                const uint8_t *nalBegin = (sc > data && sc[-1] == 0) ? sc - 1 : sc;
+                const uint8_t *payload = sc + 3;
+
+                if (payload >= end) {
+                        break;
+                }
+
+                const uint8_t *next = nextStartCode (payload, end);
+                int type = *payload & 0x1f;
+                bool slice = (type >= NAL_SLICE && type <= NAL_IDR);
+                // first_mb_in_slice is ue(v) and equals 0 exactly when its first bit is set.
+                bool firstSlice = slice && payload + 1 < end && (payload[1] & 0x80);
+                bool startsUnit = type == NAL_AUD || type == NAL_SEI || type == NAL_SPS || type == NAL_PPS || firstSlice;
+
+                if (!inUnit || (startsUnit && unitHasSlice)) {
+                        if (inUnit) {
+                                unit.size = nalBegin - data - unit.offset;
+                                accessUnits.push_back (unit);
+                        }
+
+                        unit = AccessUnit ();
+                        unit.offset = nalBegin - data;
+                        inUnit = true;
+                        unitHasSlice = false;
+                }
+
+                unitHasSlice |= slice;
+                unit.keyframe |= (type == NAL_IDR);
+
+                if (type == NAL_SPS || type == NAL_PPS) {
+                        unit.parameterSets = true;
+                        std::string &dst = (type == NAL_SPS) ? sps : pps;
+
+                        if (dst.empty ()) {
+                                // Always store with a 4 byte start code.
+                                dst.assign ("\0\0\0\1", 4);
+                                dst.append (reinterpret_cast <const char *> (payload), next - payload);
+                        }
+                }
+
+                sc = next;
+        }
+
+        if (inUnit && accessUnits.size () < maxUnits) {
+                unit.size = ((sc < end) ? sc : end) - data - unit.offset;
+                accessUnits.push_back (unit);
+        }
+
+        munmap (mapped, st.st_size);
+        parameterSetBytes = sps + pps;
+        return true;
+}
+
+size_t H264Index::keyframeBefore (size_t unit) const
+{
+        if (accessUnits.empty ()) {
+                return 0;
+        }
+
+        size_t i = std::min (unit, accessUnits.size () - 1);
+
+        while (i > 0 && !accessUnits[i].keyframe) {
+                --i;
+        }
+
+        return i;
+}
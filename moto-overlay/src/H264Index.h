@@ -0,0 +1,75 @@
+/****************************************************************************
+ *                                                                          *
+ *  Author : lukasz.iwaszkiewicz@gmail.com                                  *
+ *  ~~~~~~~~                                                                *
+ *  License : see COPYING file for details.                                 *
+ *  ~~~~~~~~~                                                               *
+ ****************************************************************************/
+
+#ifndef H264INDEX_H_
+#define H264INDEX_H_
+
+#include <cstdint>
+#include <cstddef>
+#include <limits>
+#include <string>
+#include <vector>
+#include "FrameIndex.h"
+
+/// The recorder always runs the camera at this rate, raw H.264 carries no timestamps.
+const int VIDEO_FRAME_RATE = 30;
+const uint64_t VIDEO_FRAME_DURATION_NS = 1000000000ULL / VIDEO_FRAME_RATE;
+
+/**
+ * One coded picture (with any SPS/PPS/SEI preceding it) in an Annex B stream.
+ */
+struct AccessUnit {
+        uint64_t offset = 0;
+        uint32_t size = 0;
+        bool keyframe = false;          /// Contains an IDR slice.
+        bool parameterSets = false;     /// Carries its own SPS/PPS.
+};
+
+/**
+ * Positions of access units in a raw H.264 file as produced by the recorder. Access unit
+ * n is presented at n * VIDEO_FRAME_DURATION_NS.
+ */
+class H264Index {
+public:
+
+        /**
+         * Scans the file (without decoding) until maxUnits access units are found or the
+         * file ends. Returns false if the file can't be read. If the recorder left a sidecar
+         * (FrameIndex) next to the file, the units are taken from it and only the first one is
+         * read. Otherwise the scan is kept in NAME.units (see cachePathFor) and reused while
+         * the file stays the same, so only the first run over a long ride reads all of it.
+         */
+        bool scan (std::string const &path, size_t maxUnits = std::numeric_limits <size_t>::max ());
+
+        std::vector <AccessUnit> const &units () const { return accessUnits; }
+
+        /// First SPS and PPS of the stream (with start codes), for starting decode mid-stream.
+        std::string const &parameterSets () const { return parameterSetBytes; }
+
+        /// Index of the first access unit presented at or after time.
+        static size_t unitAt (uint64_t timeNs) { return (timeNs + VIDEO_FRAME_DURATION_NS - 1) / VIDEO_FRAME_DURATION_NS; }
+        static uint64_t timeOf (size_t unit) { return unit * VIDEO_FRAME_DURATION_NS; }
+
+        /// Nearest keyframe at or before unit (0 if there is none).
+        size_t keyframeBefore (size_t unit) const;
+
+        /// NAME.units for NAME.h264.
+        static std::string cachePathFor (std::string const &h264Path);
+
+private:
+
+        bool scanStream (std::string const &path, size_t maxUnits);
+        bool load (std::string const &path, FrameIndex const &sidecar, size_t maxUnits);
+        bool loadCache (std::string const &path, size_t maxUnits);
+        void writeCache (std::string const &path, bool complete) const;
+
+        std::vector <AccessUnit> accessUnits;
+        std::string parameterSetBytes;
+};
+
+#endif /* H264INDEX_H_ */
@@ -0,0 +1,158 @@
+/****************************************************************************
+ *                                                                          *
+ *  Author : lukasz.iwaszkiewicz@gmail.com                                  *
+ *  ~~~~~~~~                                                                *
+ *  License : see COPYING file for details.                                 *
+ *  ~~~~~~~~~                                                               *
+ ****************************************************************************/
+
+#include "Highlights.h"
+#include <algorithm>
+#include <iomanip>
+#include <limits>
+
+/**
+ * Starts or extends a run of consecutive interesting samples of one kind.
+ */
+static void extendEvent (Highlight *open, Highlight::Kind kind, uint64_t t, float score)
+{
+        if (open->score > 0) {
+                open->endUs = t;
+                open->score = std::max (open->score, score);
+                return;
+        }
+
+        open->kind = kind;
+        open->beginUs = open->endUs = t;
+        open->score = score;
+}
+
+HighlightVector findHighlights (FrameVector const &frames, HighlightConfig const &config)
+{
+        HighlightVector events;
+
+        if (frames.empty ()) {
+                return events;
+        }
+
+        Highlight braking, burst;
+        size_t windowStart = 0;
+        size_t topSpeed = 0;
+
+        for (size_t i = 0; i < frames.size (); ++i) {
+                Frame const &f = frames[i];
+
+                while (f.timestamp - frames[windowStart].timestamp > config.brakingWindowUs) {
+                        ++windowStart;
+                }
+
+                uint64_t dt = f.timestamp - frames[windowStart].timestamp;
+                float decel = (dt) ? (frames[windowStart].velocity - f.velocity) * 1e6f / dt : 0;
+
+                if ((f.frontBrake || f.rearBrake) && decel >= config.brakingDecel) {
+                        extendEvent (&braking, Highlight::BRAKING, f.timestamp, decel / config.brakingDecel);
+                }
+                else if (braking.score > 0) {
+                        events.push_back (braking);
+                        braking.score = 0;
+                }
+
+                if (f.rpm >= config.rpmBurst) {
+                        extendEvent (&burst, Highlight::RPM_BURST, f.timestamp, f.rpm / config.rpmBurst);
+                }
+                else if (burst.score > 0) {
+                        events.push_back (burst);
+                        burst.score = 0;
+                }
+
+                if (f.velocity > frames[topSpeed].velocity) {
+                        topSpeed = i;
+                }
+        }
+
+        for (Highlight *open : { &braking, &burst }) {
+                if (open->score > 0) {
+                        events.push_back (*open);
+                }
+        }
+
+        if (frames[topSpeed].velocity > 0) {
+                Highlight top;
+                top.kind = Highlight::TOP_SPEED;
+                top.beginUs = top.endUs = frames[topSpeed].timestamp;
+                // Always make the reel.
+                top.score = std::numeric_limits <float>::max ();
+                events.push_back (top);
+        }
+
+        for (Highlight &h : events) {
+                h.beginUs = (h.beginUs > config.preRollUs) ? h.beginUs - config.preRollUs : 0;
+                h.endUs += config.postRollUs;
+        }
+
+        std::stable_sort (events.begin (), events.end (), [](Highlight const &a, Highlight const &b) { return a.score > b.score; });
+
+        // Take the best ones, folding each into an already taken one if they overlap.
+        HighlightVector reel;
+        uint64_t total = 0;
+
+        for (Highlight const &h : events) {
+                auto overlapping = std::find_if (reel.begin (), reel.end (), [&h](Highlight const &r) { return h.beginUs <= r.endUs && r.beginUs <= h.endUs; });
+                uint64_t added;
+
+                if (overlapping != reel.end ()) {
+                        uint64_t begin = std::min (overlapping->beginUs, h.beginUs);
+                        uint64_t end = std::max (overlapping->endUs, h.endUs);
+                        added = (end - begin) - (overlapping->endUs - overlapping->beginUs);
+
+                        if (total + added <= config.reelLengthUs) {
+                                overlapping->beginUs = begin;
+                                overlapping->endUs = end;
+                                total += added;
+                        }
+
+                        continue;
+                }
+
+                added = h.endUs - h.beginUs;
+
+                if (total + added <= config.reelLengthUs) {
+                        reel.push_back (h);
+                        total += added;
+                }
+        }
+
+        return reel;
+}
+
+HighlightVector chronological (HighlightVector highlights)
+{
+        std::sort (highlights.begin (), highlights.end (), [](Highlight const &a, Highlight const &b) { return a.beginUs < b.beginUs; });
+
+        // Merging in findHighlights can make neighbours touch.
+        HighlightVector merged;
+
+        for (Highlight const &h : highlights) {
+                if (!merged.empty () && h.beginUs <= merged.back ().endUs) {
+                        merged.back ().endUs = std::max (merged.back ().endUs, h.endUs);
+                }
+                else {
+                        merged.push_back (h);
+                }
+        }
+
+        return merged;
+}
+
+std::ostream &operator<< (std::ostream &o, Highlight const &h)
+{
+        static const char *KINDS[] = { "braking", "rpm burst", "top speed" };
+
+        o << std::fixed << std::setprecision (1) << h.beginUs / 1e6 << " s - " << h.endUs / 1e6 << " s : " << KINDS[h.kind];
+
+        if (h.kind != Highlight::TOP_SPEED) {
+                o << " (score " << std::setprecision (2) << h.score << ")";
+        }
+
+        return o;
+}
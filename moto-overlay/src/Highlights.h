@@ -0,0 +1,60 @@
+/****************************************************************************
+ *                                                                          *
+ *  Author : lukasz.iwaszkiewicz@gmail.com                                  *
+ *  ~~~~~~~~                                                                *
+ *  License : see COPYING file for details.                                 *
+ *  ~~~~~~~~~                                                               *
+ ****************************************************************************/
+
+#ifndef HIGHLIGHTS_H_
+#define HIGHLIGHTS_H_
+
+#include "FrameMap.h"
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+/**
+ * Thresholds for findHighlights.
+ */
+struct HighlightConfig {
+        /// Braking counts when a brake is on and velocity drops faster than this [km/h per s].
+        float brakingDecel = 15;
+        /// Velocity drop is measured over this window.
+        uint64_t brakingWindowUs = 1000000;
+        /// RPM above this is a burst.
+        float rpmBurst = 9000;
+        /// Added before and after every event.
+        uint64_t preRollUs = 4000000;
+        uint64_t postRollUs = 3000000;
+        /// Total length of the ranges returned.
+        uint64_t reelLengthUs = 180000000;
+};
+
+/**
+ * Interesting part of the ride, microseconds of ride time.
+ */
+struct Highlight {
+        enum Kind { BRAKING, RPM_BURST, TOP_SPEED };
+
+        uint64_t beginUs = 0;
+        uint64_t endUs = 0;
+        float score = 0;
+        Kind kind = BRAKING;
+};
+
+typedef std::vector <Highlight> HighlightVector;
+
+/**
+ * Finds hard braking, high RPM bursts and the top speed in one pass over the telemetry.
+ * Returns the best scoring highlights that fit in config.reelLengthUs, ordered by score,
+ * with overlapping ones merged.
+ */
+HighlightVector findHighlights (FrameVector const &frames, HighlightConfig const &config);
+
+/// The same ranges ordered by time, i.e. in the order they should be rendered.
+HighlightVector chronological (HighlightVector highlights);
+
+std::ostream &operator<< (std::ostream &o, Highlight const &h);
+
+#endif /* HIGHLIGHTS_H_ */
@@ -0,0 +1,251 @@
+/****************************************************************************
+ *                                                                          *
+ *  Author : lukasz.iwaszkiewicz@gmail.com                                  *
+ *  ~~~~~~~~                                                                *
+ *  License : see COPYING file for details.                                 *
+ *  ~~~~~~~~~                                                               *
+ ****************************************************************************/
+
+#include "Options.h"
+#include <glib.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+/**
+ * Copies a string option into dst, if it was given, and frees it.
+ */
+static void takeString (gchar *src, std::string *dst)
+{
+        if (src) {
+                *dst = src;
+                g_free (src);
+        }
+}
+
+/**
+ * Parses [[HH:]MM:]SS[.fff] into nanoseconds.
+ */
+static bool parseTime (const gchar *text, uint64_t *ns)
+{
+        double seconds = 0;
+        const char *p = text;
+
+        while (true) {
+                char *end;
+                double field = strtod (p, &end);
+
+                if (end == p || field < 0) {
+                        return false;
+                }
+
+                seconds = seconds * 60 + field;
+
+                if (*end == '\0') {
+                        break;
+                }
+
+                if (*end != ':') {
+                        return false;
+                }
+
+                p = end + 1;
+        }
+
+        *ns = uint64_t (seconds * 1e9 + 0.5);
+        return true;
+}
+
+/**
+ * Converts an optional time string option, and frees it.
+ */
+static bool takeTime (gchar *src, uint64_t *dst, const char *name)
+{
+        bool ok = !src || parseTime (src, dst);
+
+        if (!ok) {
+                g_printerr ("Invalid time for --%s : %s (expected [[HH:]MM:]SS[.fff])\n", name, src);
+        }
+
+        g_free (src);
+        return ok;
+}
+
+/**
+ * Parses WIDTHxHEIGHT[,KBPS[,PRESET]]=FILE.
+ */
+static bool parseRendition (const gchar *text, Rendition *r)
+{
+        const char *eq = strchr (text, '=');
+
+        if (!eq || !eq[1]) {
+                return false;
+        }
+
+        r->output = eq + 1;
+        std::string spec (text, eq);
+        char preset[64] = "";
+        int n = sscanf (spec.c_str (), "%dx%d,%d,%63s", &r->width, &r->height, &r->bitrate, preset);
+        r->preset = preset;
+        return n >= 2 && r->width > 0 && r->height > 0;
+}
+
+bool parseOptions (int argc, char **argv, Options *options)
+{
+        gchar *input = NULL;
+        gchar *telemetry = NULL;
+        gchar *output = NULL;
+        gchar *statsDump = NULL;
+        gchar *from = NULL;
+        gchar *to = NULL;
+        gchar **renditions = NULL;
+        gchar *draftSize = NULL;
+        gchar *contactSheet = NULL;
+        gchar *thumbSize = NULL;
+        gboolean remux = FALSE;
+        gboolean highlights = FALSE;
+        gboolean draft = FALSE;
+        gboolean timelapse = FALSE;
+
+        GOptionEntry entries[] = {
+                { "input", 'i', 0, G_OPTION_ARG_FILENAME, &input, "H.264 elementary stream from the recorder", "FILE" },
+                { "telemetry", 't', 0, G_OPTION_ARG_FILENAME, &telemetry, "Telemetry : CSV from the recorder or .mkv written with --remux", "FILE" },
+                { "output", 'o', 0, G_OPTION_ARG_FILENAME, &output, "Output Matroska file", "FILE" },
+                { "rendition", 'R', 0, G_OPTION_ARG_STRING_ARRAY, &renditions, "Add an output, all of them share one decode. Repeat for more", "WxH[,KBPS[,PRESET]]=FILE" },
+                { "from", 0, 0, G_OPTION_ARG_STRING, &from, "Render from this point of the ride only", "[[HH:]MM:]SS" },
+                { "to", 0, 0, G_OPTION_ARG_STRING, &to, "Render up to this point of the ride only", "[[HH:]MM:]SS" },
+                { "highlights", 'H', 0, G_OPTION_ARG_NONE, &highlights, "Render a reel of hard braking, RPM bursts and top speed only", NULL },
+                { "reel-length", 0, 0, G_OPTION_ARG_INT, &options->reelLength, "Length of the highlight reel", "SECONDS" },
+                { "highlight-rpm", 0, 0, G_OPTION_ARG_DOUBLE, &options->highlightRpm, "RPM counted as a burst", "RPM" },
+                { "highlight-braking", 0, 0, G_OPTION_ARG_DOUBLE, &options->highlightBraking, "Deceleration (with a brake on) counted as hard braking", "KMH_PER_S" },
+                { "timelapse", 'T', 0, G_OPTION_ARG_NONE, &timelapse, "Skip the parts where the bike stands idling (not even decoded)", NULL },
+                { "idle-rpm", 0, 0, G_OPTION_ARG_DOUBLE, &options->idleRpm, "Timelapse : standing still below this RPM is idling", "RPM" },
+                { "slow-speed", 0, 0, G_OPTION_ARG_DOUBLE, &options->slowSpeed, "Timelapse : speed up stretches slower than this (0 = off)", "KMH" },
+                { "speedup", 0, 0, G_OPTION_ARG_INT, &options->speedup, "Timelapse : how many times faster slow stretches play", "N" },
+                { "draft", 'd', 0, G_OPTION_ARG_NONE, &draft, "Fast low resolution preview, for checking sync and gauge placement", NULL },
+                { "draft-step", 0, 0, G_OPTION_ARG_INT, &options->draftStep, "Draft : render every Nth frame (0 = keyframes only, decodes the least)", "N" },
+                { "draft-size", 0, 0, G_OPTION_ARG_STRING, &draftSize, "Draft : output resolution (default 640x360)", "WxH" },
+                { "contact-sheet", 'c', 0, G_OPTION_ARG_FILENAME, &contactSheet, "Write a PNG grid of keyframe thumbnails with telemetry instead of a video", "FILE" },
+                { "thumbnails", 0, 0, G_OPTION_ARG_INT, &options->thumbnails, "Contact sheet : number of thumbnails", "N" },
+                { "columns", 0, 0, G_OPTION_ARG_INT, &options->columns, "Contact sheet : thumbnails per row", "N" },
+                { "thumb-size", 0, 0, G_OPTION_ARG_STRING, &thumbSize, "Contact sheet : thumbnail resolution (default 320x180)", "WxH" },
+                { "remux", 'r', 0, G_OPTION_ARG_NONE, &remux, "Store video and telemetry track in the output without decoding", NULL },
+                { "chunks", 'j', 0, G_OPTION_ARG_INT, &options->chunks, "Render N chunks of the video in parallel and join them", "N" },
+                { "decoder-threads", 0, 0, G_OPTION_ARG_INT, &options->decoderThreads, "avdec_h264 threads (0 = automatic)", "N" },
+                { "encoder-threads", 0, 0, G_OPTION_ARG_INT, &options->encoderThreads, "x264enc threads (0 = automatic)", "N" },
+                { "convert-threads", 0, 0, G_OPTION_ARG_INT, &options->convertThreads, "videoconvert threads (0 = automatic)", "N" },
+                { "queue-size", 0, 0, G_OPTION_ARG_INT, &options->queueSize, "Frames buffered between pipeline stages", "N" },
+                { "stats", 's', 0, G_OPTION_ARG_INT, &options->statsInterval, "Print per-element throughput and latency every N seconds, histograms at the end", "N" },
+                { "stats-dump", 0, 0, G_OPTION_ARG_FILENAME, &statsDump, "Write raw instrumentation samples (CSV) to FILE", "FILE" },
+                { NULL }
+        };
+
+        GOptionContext *context = g_option_context_new ("- render motorcycle telemetry onto the ride video");
+        g_option_context_add_main_entries (context, entries, NULL);
+
+        GError *error = NULL;
+        bool ok = g_option_context_parse (context, &argc, &argv, &error);
+        g_option_context_free (context);
+
+        takeString (input, &options->input);
+        takeString (telemetry, &options->telemetry);
+        takeString (output, &options->output);
+        takeString (statsDump, &options->statsDump);
+        takeString (contactSheet, &options->contactSheet);
+        options->remux = remux;
+        options->highlights = highlights;
+        options->draft = draft;
+        options->timelapse = timelapse;
+
+        if (!ok) {
+                g_printerr ("%s\n", error->message);
+                g_error_free (error);
+        }
+
+        for (gchar **r = renditions; r && *r; ++r) {
+                Rendition rendition;
+
+                if (!parseRendition (*r, &rendition)) {
+                        g_printerr ("Invalid --rendition : %s (expected WIDTHxHEIGHT[,KBPS[,PRESET]]=FILE)\n", *r);
+                        ok = false;
+                }
+
+                options->renditions.push_back (rendition);
+        }
+
+        g_strfreev (renditions);
+
+        if (draftSize && (sscanf (draftSize, "%dx%d", &options->draftWidth, &options->draftHeight) != 2 || options->draftWidth <= 0 || options->draftHeight <= 0)) {
+                g_printerr ("Invalid --draft-size : %s (expected WIDTHxHEIGHT)\n", draftSize);
+                ok = false;
+        }
+
+        g_free (draftSize);
+
+        if (thumbSize && (sscanf (thumbSize, "%dx%d", &options->thumbWidth, &options->thumbHeight) != 2 || options->thumbWidth <= 0 || options->thumbHeight <= 0)) {
+                g_printerr ("Invalid --thumb-size : %s (expected WIDTHxHEIGHT)\n", thumbSize);
+                ok = false;
+        }
+
+        g_free (thumbSize);
+
+        if (options->thumbnails < 1 || options->columns < 1) {
+                g_printerr ("--thumbnails and --columns must be at least 1\n");
+                ok = false;
+        }
+
+        if (options->draft) {
+                if (!options->renditions.empty ()) {
+                        g_printerr ("--draft renders a single output, it can't be combined with --rendition\n");
+                        ok = false;
+                }
+
+                if (options->draftStep < 0) {
+                        g_printerr ("--draft-step can't be negative\n");
+                        ok = false;
+                }
+
+                // The fastest x264 preset, at a reduced resolution.
+                Rendition rendition;
+                rendition.width = options->draftWidth;
+                rendition.height = options->draftHeight;
+                rendition.preset = "ultrafast";
+                rendition.output = options->output;
+                options->renditions.assign (1, rendition);
+        }
+
+        if (options->chunks < 1) {
+                g_printerr ("--chunks must be at least 1\n");
+                ok = false;
+        }
+        else if (options->chunks > 1 && (options->highlights || options->draft || options->remux)) {
+                g_printerr ("--chunks can't be combined with --highlights, --draft or --remux\n");
+                ok = false;
+        }
+
+        if (options->timelapse && (options->highlights || options->chunks > 1 || options->remux)) {
+                g_printerr ("--timelapse can't be combined with --highlights, --chunks or --remux\n");
+                ok = false;
+        }
+
+        if (options->speedup < 1) {
+                g_printerr ("--speedup must be at least 1\n");
+                ok = false;
+        }
+
+        if (options->renditions.empty ()) {
+                Rendition rendition;
+                rendition.output = options->output;
+                options->renditions.push_back (rendition);
+        }
+
+        ok &= takeTime (from, &options->from, "from");
+        ok &= takeTime (to, &options->to, "to");
+
+        if (ok && options->to <= options->from) {
+                g_printerr ("--to must be later than --from\n");
+                ok = false;
+        }
+
+        return ok;
+}
@@ -0,0 +1,104 @@
+/****************************************************************************
+ *                                                                          *
+ *  Author : lukasz.iwaszkiewicz@gmail.com                                  *
+ *  ~~~~~~~~                                                                *
+ *  License : see COPYING file for details.                                 *
+ *  ~~~~~~~~~                                                               *
+ ****************************************************************************/
+
+#ifndef OPTIONS_H_
+#define OPTIONS_H_
+
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <vector>
+
+/// "No time given", same value as GST_CLOCK_TIME_NONE.
+const uint64_t NO_TIME = std::numeric_limits <uint64_t>::max ();
+
+/**
+ * One output of a multi-rendition render.
+ */
+struct Rendition {
+        int width = 0;                  /// 0 : as decoded.
+        int height = 0;
+        int bitrate = 0;                /// kbit/s, 0 : x264enc default.
+        std::string preset;             /// x264 speed preset, empty : x264enc default.
+        std::string output;
+};
+
+/**
+ * Command line options of moto-overlay. Defaults reproduce the old hardcoded
+ * behaviour (00000.h264 + 00000.csv -> video.mkv).
+ */
+struct Options {
+        std::string input = "00000.h264";
+        std::string telemetry = "00000.csv";
+        std::string output = "video.mkv";
+
+        /// Outputs sharing one decode. If none given, a single one (output, unscaled) is made.
+        std::vector <Rendition> renditions;
+
+        /// Render only [from, to) of the ride, nanoseconds of stream time.
+        uint64_t from = 0;
+        uint64_t to = NO_TIME;
+
+        bool hasClip () const { return from > 0 || to != NO_TIME; }
+
+        /// Render only the highlights found in the telemetry, reelLength seconds in total.
+        bool highlights = false;
+        int reelLength = 180;
+        double highlightRpm = 9000;
+        double highlightBraking = 15;
+
+        /// Leave idling out (and speed slow stretches up, if slowSpeed > 0), as seen in the telemetry.
+        bool timelapse = false;
+        double idleRpm = 2000;
+        double slowSpeed = 0;
+        int speedup = 4;
+
+        /// Quick preview : one small, fast encoded output of keyframes (draftStep 0) or of
+        /// every draftStep-th frame.
+        bool draft = false;
+        int draftStep = 0;
+        int draftWidth = 640;
+        int draftHeight = 360;
+
+        /// Instead of a video, write a PNG grid of telemetry stamped keyframe thumbnails here.
+        std::string contactSheet;
+        int thumbnails = 24;
+        int columns = 6;
+        int thumbWidth = 320;
+        int thumbHeight = 180;
+
+        /// Copy the H.264 stream and the telemetry into output as-is, without decoding.
+        bool remux = false;
+
+        /// Split the input at keyframes into that many chunks, render them in parallel and
+        /// join the results without re-encoding. 1 : one pipeline for everything.
+        int chunks = 1;
+
+        /// Threading of the decode/overlay/encode stages. 0 means automatic (one per core,
+        /// or a single thread per stage with chunks).
+        int decoderThreads = 0;
+        int encoderThreads = 0;
+        int convertThreads = 0;
+
+        /// Capacity (in frames) of the queues between pipeline stages.
+        int queueSize = 8;
+
+        /// Print per-element statistics every that many seconds (0 = off).
+        int statsInterval = 0;
+
+        /// Raw instrumentation samples (CSV) go here, if set.
+        std::string statsDump;
+};
+
+/**
+ * Parses argv (gst_init must have been called already so GStreamer options are stripped).
+ * Returns false if the program should exit.
+ */
+bool parseOptions (int argc, char **argv, Options *options);
+
+#endif /* OPTIONS_H_ */
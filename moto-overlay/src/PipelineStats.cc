@@ -0,0 +1,254 @@
+/****************************************************************************
+ *                                                                          *
+ *  Author : lukasz.iwaszkiewicz@gmail.com                                  *
+ *  ~~~~~~~~                                                                *
+ *  License : see COPYING file for details.                                 *
+ *  ~~~~~~~~~                                                               *
+ ****************************************************************************/
+
+#include "PipelineStats.h"
+#include <chrono>
+#include <iomanip>
+
+/// Buffers an element may hold before we assume the rest were dropped.
+static const size_t MAX_IN_FLIGHT = 256;
+
+static const int HISTOGRAM_WIDTH = 40;
+
+static int64_t nowNs ()
+{
+        return std::chrono::duration_cast <std::chrono::nanoseconds> (std::chrono::steady_clock::now ().time_since_epoch ()).count ();
+}
+
+/*****************************************************************************/
+
+void Histogram::add (uint64_t value)
+{
+        int bucket = 0;
+
+        while (bucket < BUCKETS - 1 && (uint64_t (1) << bucket) <= value) {
+                ++bucket;
+        }
+
+        ++buckets[bucket];
+        ++n;
+        sum += value;
+
+        if (value > max) {
+                max = value;
+        }
+}
+
+uint64_t Histogram::percentile (double p) const
+{
+        uint64_t rank = uint64_t (p * n);
+        uint64_t seen = 0;
+
+        for (int i = 0; i < BUCKETS; ++i) {
+                seen += buckets[i];
+
+                if (seen > rank) {
+                        return (uint64_t (1) << i) - 1;
+                }
+        }
+
+        return max;
+}
+
+void Histogram::print (std::ostream &o, std::string const &indent, const char *unit) const
+{
+        uint64_t peak = 0;
+        int first = BUCKETS;
+        int last = 0;
+
+        for (int i = 0; i < BUCKETS; ++i) {
+                if (buckets[i]) {
+                        peak = std::max (peak, buckets[i]);
+                        first = std::min (first, i);
+                        last = i;
+                }
+        }
+
+        for (int i = first; i <= last; ++i) {
+                o << indent << "< " << std::setw (10) << (uint64_t (1) << i) << " " << unit << " "
+                  << std::setw (10) << buckets[i] << " " << std::string (buckets[i] * HISTOGRAM_WIDTH / peak, '#') << "\n";
+        }
+}
+
+/*****************************************************************************/
+
+PipelineStats::PipelineStats (std::string const &dumpPath) : lastSummaryNs (nowNs ())
+{
+        if (!dumpPath.empty ()) {
+                dumpFile.open (dumpPath);
+                dumpFile << "element,metric,pts_ns,value,unit\n";
+        }
+}
+
+PipelineStats::~PipelineStats ()
+{
+        for (auto &q : queues) {
+                gst_object_unref (q->element);
+        }
+}
+
+void PipelineStats::watchElement (GstElement *element)
+{
+        std::unique_ptr <Element> e (new Element);
+        e->name = GST_ELEMENT_NAME (element);
+        e->owner = this;
+
+        GstPad *sink = gst_element_get_static_pad (element, "sink");
+        GstPad *src = gst_element_get_static_pad (element, "src");
+        gst_pad_add_probe (sink, GST_PAD_PROBE_TYPE_BUFFER, onSinkBuffer, e.get (), NULL);
+        gst_pad_add_probe (src, GST_PAD_PROBE_TYPE_BUFFER, onSrcBuffer, e.get (), NULL);
+        gst_object_unref (sink);
+        gst_object_unref (src);
+
+        elements.push_back (std::move (e));
+}
+
+void PipelineStats::watchQueue (GstElement *queue)
+{
+        std::unique_ptr <Queue> q (new Queue);
+        q->name = GST_ELEMENT_NAME (queue);
+        q->element = GST_ELEMENT (gst_object_ref (queue));
+        g_object_get (G_OBJECT (queue), "max-size-buffers", &q->capacity, NULL);
+        queues.push_back (std::move (q));
+}
+
+GstPadProbeReturn PipelineStats::onSinkBuffer (GstPad *, GstPadProbeInfo *info, gpointer user_data)
+{
+        Element *e = static_cast <Element *> (user_data);
+        GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER (info);
+        int64_t now = nowNs ();
+        std::lock_guard <std::mutex> lock (e->mutex);
+
+        e->entryNs = now;
+        e->entryPending = true;
+
+        if (GST_CLOCK_TIME_IS_VALID (GST_BUFFER_PTS (buffer))) {
+                if (e->inFlight.size () >= MAX_IN_FLIGHT) {
+                        e->inFlight.erase (e->inFlight.begin ());
+                }
+
+                e->inFlight[GST_BUFFER_PTS (buffer)] = now;
+        }
+
+        return GST_PAD_PROBE_OK;
+}
+
+GstPadProbeReturn PipelineStats::onSrcBuffer (GstPad *, GstPadProbeInfo *info, gpointer user_data)
+{
+        Element *e = static_cast <Element *> (user_data);
+        GstClockTime pts = GST_BUFFER_PTS (GST_PAD_PROBE_INFO_BUFFER (info));
+        int64_t now = nowNs ();
+        int64_t processingNs = -1;
+        int64_t latencyNs = -1;
+
+        {
+                std::lock_guard <std::mutex> lock (e->mutex);
+                ++e->buffersOut;
+
+                if (e->entryPending) {
+                        e->entryPending = false;
+                        processingNs = now - e->entryNs;
+                        e->processing.add (processingNs / 1000);
+                        e->processingSum += processingNs;
+                        ++e->processingCount;
+                }
+
+                auto i = e->inFlight.find (pts);
+
+                if (i != e->inFlight.end ()) {
+                        latencyNs = now - i->second;
+                        e->latency.add (latencyNs / 1000);
+                        e->inFlight.erase (e->inFlight.begin (), ++i);
+                }
+        }
+
+        if (processingNs >= 0) {
+                e->owner->dump (e->name, "processing", pts, processingNs / 1000.0, "us");
+        }
+
+        if (latencyNs >= 0) {
+                e->owner->dump (e->name, "latency", pts, latencyNs / 1000.0, "us");
+        }
+
+        return GST_PAD_PROBE_OK;
+}
+
+void PipelineStats::dump (std::string const &element, const char *metric, GstClockTime pts, double value, const char *unit)
+{
+        if (!dumpFile.is_open ()) {
+                return;
+        }
+
+        std::lock_guard <std::mutex> lock (dumpMutex);
+        dumpFile << element << "," << metric << "," << pts << "," << value << "," << unit << "\n";
+}
+
+void PipelineStats::sample ()
+{
+        for (auto &q : queues) {
+                guint level = 0;
+                g_object_get (G_OBJECT (q->element), "current-level-buffers", &level, NULL);
+                q->fill.add (level);
+                q->fillSum += level;
+                ++q->samples;
+                dump (q->name, "fill", GST_CLOCK_TIME_NONE, level, "buffers");
+        }
+}
+
+void PipelineStats::printSummary (std::ostream &o)
+{
+        int64_t now = nowNs ();
+        double intervalSec = (now - lastSummaryNs) / 1e9;
+        lastSummaryNs = now;
+
+        o << std::fixed << std::setprecision (1);
+
+        for (auto &e : elements) {
+                std::lock_guard <std::mutex> lock (e->mutex);
+                uint64_t buffers = e->buffersOut - e->buffersOutReported;
+                uint64_t count = e->processingCount - e->processingCountReported;
+                uint64_t sum = e->processingSum - e->processingSumReported;
+
+                o << std::setw (12) << e->name << " : " << std::setw (7) << buffers / intervalSec << " fps, processing "
+                  << std::setw (8) << ((count) ? sum / count / 1000.0 : 0.0) << " us avg, latency p50 < "
+                  << e->latency.percentile (0.5) + 1 << " us\n";
+
+                e->buffersOutReported = e->buffersOut;
+                e->processingCountReported = e->processingCount;
+                e->processingSumReported = e->processingSum;
+        }
+
+        for (auto &q : queues) {
+                o << std::setw (12) << q->name << " : " << std::setw (7) << ((q->samples) ? double (q->fillSum) / q->samples : 0.0)
+                  << " / " << q->capacity << " buffers avg fill\n";
+
+                q->fillSum = 0;
+                q->samples = 0;
+        }
+
+        o << std::endl;
+}
+
+void PipelineStats::printHistograms (std::ostream &o) const
+{
+        for (auto &e : elements) {
+                std::lock_guard <std::mutex> lock (e->mutex);
+                o << e->name << " processing (" << e->processing.count () << " samples, mean " << e->processing.mean ()
+                  << " us, p99 < " << e->processing.percentile (0.99) + 1 << " us, max " << e->processing.maximum () << " us) :\n";
+                e->processing.print (o, "    ", "us");
+                o << e->name << " latency (mean " << e->latency.mean () << " us, max " << e->latency.maximum () << " us) :\n";
+                e->latency.print (o, "    ", "us");
+        }
+
+        for (auto &q : queues) {
+                o << q->name << " fill (capacity " << q->capacity << ") :\n";
+                q->fill.print (o, "    ", "buffers");
+        }
+
+        o.flush ();
+}
@@ -0,0 +1,113 @@
+/****************************************************************************
+ *                                                                          *
+ *  Author : lukasz.iwaszkiewicz@gmail.com                                  *
+ *  ~~~~~~~~                                                                *
+ *  License : see COPYING file for details.                                 *
+ *  ~~~~~~~~~                                                               *
+ ****************************************************************************/
+
+#ifndef PIPELINESTATS_H_
+#define PIPELINESTATS_H_
+
+#include <gst/gst.h>
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/**
+ * Power of two buckets. Bucket n holds values in [2^(n-1), 2^n).
+ */
+class Histogram {
+public:
+        void add (uint64_t value);
+        void print (std::ostream &o, std::string const &indent, const char *unit) const;
+
+        uint64_t count () const { return n; }
+        uint64_t mean () const { return (n) ? (sum / n) : 0; }
+        uint64_t maximum () const { return max; }
+        uint64_t percentile (double p) const;
+
+private:
+        static const int BUCKETS = 32;
+        uint64_t buckets[BUCKETS] = {};
+        uint64_t n = 0;
+        uint64_t sum = 0;
+        uint64_t max = 0;
+};
+
+/**
+ * Pad probe based instrumentation of a running pipeline. For every watched element it
+ * records :
+ * - latency : time between a buffer entering the sink pad and the buffer with the same PTS
+ *   leaving the src pad (includes any frames the element holds back, like x264 lookahead),
+ * - processing time : time between entering the sink pad and the first push on the src pad
+ *   made from within that call,
+ * - output buffer count, for throughput.
+ * Queues are sampled for their fill level whenever sample () is called.
+ */
+class PipelineStats {
+public:
+
+        /// dumpPath, if not empty, receives every raw sample as CSV : element,metric,pts_ns,value,unit (us, or buffers for queue fill).
+        PipelineStats (std::string const &dumpPath);
+        ~PipelineStats ();
+
+        void watchElement (GstElement *element);
+        void watchQueue (GstElement *queue);
+
+        /// Samples queue levels. Call periodically from the main loop.
+        void sample ();
+
+        /// Throughput and averages since the last call.
+        void printSummary (std::ostream &o);
+
+        /// Whole-run histograms.
+        void printHistograms (std::ostream &o) const;
+
+private:
+
+        struct Element {
+                std::string name;
+                mutable std::mutex mutex;
+                std::map <GstClockTime, int64_t> inFlight; // PTS -> sink pad entry time.
+                int64_t entryNs = 0;
+                bool entryPending = false;
+                Histogram latency;
+                Histogram processing;
+                uint64_t buffersOut = 0;
+                uint64_t buffersOutReported = 0;
+                uint64_t processingSum = 0;
+                uint64_t processingSumReported = 0;
+                uint64_t processingCount = 0;
+                uint64_t processingCountReported = 0;
+                PipelineStats *owner = 0;
+        };
+
+        struct Queue {
+                std::string name;
+                GstElement *element = 0;
+                guint capacity = 0;
+                Histogram fill;
+                uint64_t fillSum = 0;
+                uint64_t samples = 0;
+        };
+
+        static GstPadProbeReturn onSinkBuffer (GstPad *pad, GstPadProbeInfo *info, gpointer user_data);
+        static GstPadProbeReturn onSrcBuffer (GstPad *pad, GstPadProbeInfo *info, gpointer user_data);
+        void dump (std::string const &element, const char *metric, GstClockTime pts, double value, const char *unit);
+
+private:
+
+        std::vector <std::unique_ptr <Element>> elements;
+        std::vector <std::unique_ptr <Queue>> queues;
+        std::mutex dumpMutex;
+        std::ofstream dumpFile;
+        int64_t lastSummaryNs;
+};
+
+#endif /* PIPELINESTATS_H_ */
@@ -0,0 +1,59 @@
+/****************************************************************************
+ *                                                                          *
+ *  Author : lukasz.iwaszkiewicz@gmail.com                                  *
+ *  ~~~~~~~~                                                                *
+ *  License : see COPYING file for details.                                 *
+ *  ~~~~~~~~~                                                               *
+ ****************************************************************************/
+
+
+#include "Stitch.h"
+#include "H264Index.h"
+
+std::string chunkPath (std::string const &output, size_t n)
+{
+        return output + ".part" + std::to_string (n) + ".h264";
+}
+
+GstElement *createStitchPipeline (std::vector <std::string> const &chunks, std::string const &output)
+{
+        GstElement *pipeline = gst_pipeline_new ("stitch");
+        GstElement *concat = gst_element_factory_make ("concat", "concat");
+        GstElement *filter = gst_element_factory_make ("capsfilter", "filter");
+        GstElement *parser = gst_element_factory_make ("h264parse", "parser");
+        GstElement *matroska = gst_element_factory_make ("matroskamux", "matroska");
+        GstElement *sink = gst_element_factory_make ("filesink", "sink");
+
+        if (!concat) {
+                g_critical ("The concat element is missing");
+                gst_object_unref (pipeline);
+                return NULL;
+        }
+
+        GstCaps *caps = gst_caps_new_simple ("video/x-h264",
+                                             "framerate", GST_TYPE_FRACTION, VIDEO_FRAME_RATE, 1,
+                                             NULL);
+
+        g_object_set (G_OBJECT (filter), "caps", caps, NULL);
+        gst_caps_unref (caps);
+        g_object_set (G_OBJECT (sink), "location", output.c_str (), NULL);
+
+        gst_bin_add_many (GST_BIN (pipeline), concat, filter, parser, matroska, sink, NULL);
+
+        // concat plays its inputs one after another, in the order the pads were requested.
+        for (size_t n = 0; n < chunks.size (); ++n) {
+                GstElement *source = gst_element_factory_make ("filesrc", ("chunk" + std::to_string (n)).c_str ());
+                g_object_set (G_OBJECT (source), "location", chunks[n].c_str (), NULL);
+                gst_bin_add (GST_BIN (pipeline), source);
+
+                if (!gst_element_link (source, concat)) {
+                        g_warning ("Failed to link elements!");
+                }
+        }
+
+        if (!gst_element_link_many (concat, filter, parser, matroska, sink, NULL)) {
+                g_warning ("Failed to link elements!");
+        }
+
+        return pipeline;
+}
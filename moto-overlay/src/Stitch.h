@@ -0,0 +1,29 @@
+/****************************************************************************
+ *                                                                          *
+ *  Author : lukasz.iwaszkiewicz@gmail.com                                  *
+ *  ~~~~~~~~                                                                *
+ *  License : see COPYING file for details.                                 *
+ *  ~~~~~~~~~                                                               *
+ ****************************************************************************/
+
+
+#ifndef STITCH_H_
+#define STITCH_H_
+
+#include <gst/gst.h>
+#include <string>
+#include <vector>
+
+/**
+ * Where chunk n of a chunked render of output is encoded to (raw H.264).
+ */
+std::string chunkPath (std::string const &output, size_t n);
+
+/**
+ * Builds a pipeline which joins raw H.264 chunks (each starting with an IDR frame and its
+ * SPS/PPS, all encoded with the same settings) into one Matroska file, without
+ * re-encoding. Frames are timestamped at VIDEO_FRAME_RATE, back to back.
+ */
+GstElement *createStitchPipeline (std::vector <std::string> const &chunks, std::string const &output);
+
+#endif /* STITCH_H_ */
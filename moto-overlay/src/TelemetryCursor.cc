@@ -0,0 +1,82 @@
+/****************************************************************************
+ *                                                                          *
+ *  Author : lukasz.iwaszkiewicz@gmail.com                                  *
+ *  ~~~~~~~~                                                                *
+ *  License : see COPYING file for details.                                 *
+ *  ~~~~~~~~~                                                               *
+ ****************************************************************************/
+
+#include "TelemetryCursor.h"
+#include "H264Index.h"
+#include <algorithm>
+
+void TelemetryCursor::seek (uint64_t timestampUs)
+{
+        if (!frames) {
+                return;
+        }
+
+        position = std::lower_bound (frames->begin (), frames->end (), timestampUs, [](Frame const &f, uint64_t t) { return f.timestamp < t; }) - frames->begin ();
+}
+
+Frame const &TelemetryCursor::at (uint64_t timestampUs)
+{
+        if (!frames) {
+                return empty;
+        }
+
+        if (position > 0 && position <= frames->size () && (*frames)[position - 1].timestamp >= timestampUs) {
+                seek (timestampUs);
+        }
+        else {
+                size_t steps = 0;
+
+                while (position < frames->size () && (*frames)[position].timestamp < timestampUs) {
+                        if (++steps > MAX_STEPS) {
+                                seek (timestampUs);
+                                break;
+                        }
+
+                        ++position;
+                }
+        }
+
+        return (position < frames->size ()) ? (*frames)[position] : empty;
+}
+
+/**
+ * Buffers carry their access unit's position in the stream as PTS (see ClipSource), so the
+ * unit number is exact.
+ */
+Frame const &TelemetryFanout::find (TelemetryCursor &c, uint64_t timestampNs)
+{
+        size_t unit = (timestampNs + VIDEO_FRAME_DURATION_NS / 2) / VIDEO_FRAME_DURATION_NS;
+
+        if (index && frames && unit < index->size () && (*index)[unit].telemetry < frames->size ()) {
+                return (*frames)[(*index)[unit].telemetry];
+        }
+
+        return c.at (timestampNs / 1000);
+}
+
+void TelemetryFanout::resolve (uint64_t timestampNs)
+{
+        Frame const &frame = find (cursor, timestampNs);
+        std::lock_guard <std::mutex> lock (mutex);
+        Slot &slot = slots[(timestampNs / VIDEO_FRAME_DURATION_NS) % SLOTS];
+        slot.timestampNs = timestampNs;
+        slot.frame = frame;
+}
+
+Frame TelemetryFanout::lookup (uint64_t timestampNs)
+{
+        std::lock_guard <std::mutex> lock (mutex);
+        Slot const &slot = slots[(timestampNs / VIDEO_FRAME_DURATION_NS) % SLOTS];
+
+        if (slot.timestampNs == timestampNs) {
+                return slot.frame;
+        }
+
+        // Not resolved (or overwritten already), should not happen with sane queue sizes.
+        return find (fallback, timestampNs);
+}
@@ -0,0 +1,82 @@
+/****************************************************************************
+ *                                                                          *
+ *  Author : lukasz.iwaszkiewicz@gmail.com                                  *
+ *  ~~~~~~~~                                                                *
+ *  License : see COPYING file for details.                                 *
+ *  ~~~~~~~~~                                                               *
+ ****************************************************************************/
+
+#ifndef TELEMETRYCURSOR_H_
+#define TELEMETRYCURSOR_H_
+
+#include "FrameMap.h"
+#include "FrameIndex.h"
+#include <cstdint>
+#include <mutex>
+
+/**
+ * Position in the telemetry which follows the video. Video timestamps grow monotonically
+ * within a segment, so the cursor only steps forward and the lookup is O(1) amortized.
+ * Going backwards (or jumping far ahead after a seek) repositions with a binary search.
+ */
+class TelemetryCursor {
+public:
+
+        TelemetryCursor () {}
+        explicit TelemetryCursor (FrameVector const *frames) : frames (frames) {}
+
+        /// Places the cursor directly at the first sample at or after timestampUs.
+        void seek (uint64_t timestampUs);
+
+        /// The first sample at or after timestampUs, or a default Frame past the end of data.
+        Frame const &at (uint64_t timestampUs);
+
+private:
+
+        /// Linear steps tried before falling back to seek.
+        static const size_t MAX_STEPS = 16;
+
+        FrameVector const *frames = 0;
+        size_t position = 0;
+        Frame empty;
+};
+
+/**
+ * Telemetry looked up once per video frame (upstream of a tee) and handed to every branch
+ * rendering that frame. Frames are kept in slots by frame number, enough of them to cover
+ * whatever the branch queues hold.
+ *
+ * With the recorder's sidecar (index) the row for frame n is taken from it directly, the
+ * cursor is only used for frames the sidecar doesn't cover.
+ */
+class TelemetryFanout {
+public:
+
+        explicit TelemetryFanout (FrameVector const *frames, FrameIndex const *index = 0) : frames (frames), index (index), cursor (frames), fallback (frames) {}
+
+        /// Looks telemetry for the frame up. Called from the decoding thread.
+        void resolve (uint64_t timestampNs);
+
+        /// Telemetry resolved for the frame. Called from the branch threads.
+        Frame lookup (uint64_t timestampNs);
+
+private:
+
+        static const size_t SLOTS = 512;
+
+        struct Slot {
+                uint64_t timestampNs = UINT64_MAX;
+                Frame frame;
+        };
+
+        Frame const &find (TelemetryCursor &c, uint64_t timestampNs);
+
+        FrameVector const *frames;
+        FrameIndex const *index;
+        TelemetryCursor cursor;
+        TelemetryCursor fallback;
+        std::mutex mutex;
+        Slot slots[SLOTS];
+};
+
+#endif /* TELEMETRYCURSOR_H_ */
@@ -0,0 +1,212 @@
+/****************************************************************************
+ *                                                                          *
+ *  Author : lukasz.iwaszkiewicz@gmail.com                                  *
+ *  ~~~~~~~~                                                                *
+ *  License : see COPYING file for details.                                 *
+ *  ~~~~~~~~~                                                               *
+ ****************************************************************************/
+
+#include "TelemetryTrack.h"
+#include <gst/app/gstappsrc.h>
+#include <gst/app/gstappsink.h>
+#include <cstring>
+#include <sstream>
+
+static const char *TELEMETRY_CAPS = "text/x-raw, format=(string)utf8";
+
+/// Samples pushed per need-data.
+static const size_t FEED_BATCH = 64;
+
+/// Duration of the last sample (one frame at 30 fps).
+static const uint64_t LAST_SAMPLE_DURATION_US = 33333;
+
+struct TelemetryFeed {
+        FrameVector const *frames;
+        size_t next = 0;
+};
+
+static void deleteFeed (gpointer data)
+{
+        delete static_cast <TelemetryFeed *> (data);
+}
+
+/**
+ * Pushes next batch of samples as text buffers.
+ */
+static void feedTelemetry (GstElement *appsrc, guint, gpointer user_data)
+{
+        TelemetryFeed *feed = static_cast <TelemetryFeed *> (user_data);
+        FrameVector const &frames = *feed->frames;
+
+        for (size_t n = 0; n < FEED_BATCH && feed->next < frames.size (); ++n, ++feed->next) {
+                Frame const &frame = frames[feed->next];
+                std::string line = formatFrame (frame);
+                uint64_t duration = (feed->next + 1 < frames.size ()) ? frames[feed->next + 1].timestamp - frame.timestamp : LAST_SAMPLE_DURATION_US;
+
+                GstBuffer *buffer = gst_buffer_new_allocate (NULL, line.size (), NULL);
+                gst_buffer_fill (buffer, 0, line.data (), line.size ());
+                GST_BUFFER_PTS (buffer) = frame.timestamp * GST_USECOND;
+                GST_BUFFER_DURATION (buffer) = duration * GST_USECOND;
+
+                if (gst_app_src_push_buffer (GST_APP_SRC (appsrc), buffer) != GST_FLOW_OK) {
+                        return;
+                }
+        }
+
+        if (feed->next >= frames.size ()) {
+                gst_app_src_end_of_stream (GST_APP_SRC (appsrc));
+        }
+}
+
+GstElement *createRemuxPipeline (std::string const &h264Path, std::string const &mkvPath, FrameVector const &frames)
+{
+        GstElement *pipeline            = gst_pipeline_new ("remux");
+        GstElement *source              = gst_element_factory_make ("filesrc", "source");
+        GstElement *filter              = gst_element_factory_make ("capsfilter", "filter");
+        GstElement *parser              = gst_element_factory_make ("h264parse", "parser");
+        GstElement *telemetry           = gst_element_factory_make ("appsrc", "telemetry");
+        GstElement *matroska            = gst_element_factory_make ("matroskamux", "matroska");
+        GstElement *sink                = gst_element_factory_make ("filesink", "sink");
+
+        g_assert (telemetry);
+
+        g_object_set (G_OBJECT (source), "location", h264Path.c_str (), NULL);
+        g_object_set (G_OBJECT (sink), "location", mkvPath.c_str (), NULL);
+
+        // Raw H.264 from the Pi has no timestamps, h264parse derives them from the frame rate.
+        GstCaps *caps = gst_caps_new_simple ("video/x-h264",
+                                             "framerate", GST_TYPE_FRACTION, 30, 1,
+                                              NULL);
+        g_object_set (G_OBJECT (filter), "caps", caps, NULL);
+        gst_caps_unref (caps);
+
+        caps = gst_caps_from_string (TELEMETRY_CAPS);
+        g_object_set (G_OBJECT (telemetry), "caps", caps, "format", GST_FORMAT_TIME, NULL);
+        gst_caps_unref (caps);
+
+        TelemetryFeed *feed = new TelemetryFeed;
+        feed->frames = &frames;
+        g_object_set_data_full (G_OBJECT (telemetry), "feed", feed, deleteFeed);
+        g_signal_connect (telemetry, "need-data", G_CALLBACK (feedTelemetry), feed);
+
+        gst_bin_add_many (GST_BIN (pipeline), source, filter, parser, telemetry, matroska, sink, NULL);
+
+        if (!gst_element_link_many (source, filter, parser, matroska, sink, NULL) ||
+            !gst_element_link_pads (telemetry, "src", matroska, "subtitle_%u")) {
+                g_warning ("Failed to link elements!");
+        }
+
+        return pipeline;
+}
+
+/**
+ * Telemetry pad goes to the appsink, everything else is dropped.
+ */
+static void onDemuxPadAdded (GstElement *demux, GstPad *pad, gpointer user_data)
+{
+        GstElement *appsink = GST_ELEMENT (user_data);
+        GstElement *pipeline = GST_ELEMENT (gst_element_get_parent (demux));
+        GstCaps *caps = gst_pad_get_current_caps (pad);
+        bool isTelemetry = caps && g_str_has_prefix (gst_structure_get_name (gst_caps_get_structure (caps, 0)), "text/");
+        GstPad *sinkPad;
+
+        if (isTelemetry) {
+                sinkPad = gst_element_get_static_pad (appsink, "sink");
+        }
+        else {
+                GstElement *fakesink = gst_element_factory_make ("fakesink", NULL);
+                gst_bin_add (GST_BIN (pipeline), fakesink);
+                gst_element_sync_state_with_parent (fakesink);
+                sinkPad = gst_element_get_static_pad (fakesink, "sink");
+        }
+
+        if (GST_PAD_LINK_FAILED (gst_pad_link (pad, sinkPad))) {
+                g_warning ("Failed to link demuxer pad %s", GST_PAD_NAME (pad));
+        }
+
+        gst_object_unref (sinkPad);
+        gst_object_unref (pipeline);
+
+        if (caps) {
+                gst_caps_unref (caps);
+        }
+}
+
+/**
+ * Files without a telemetry track would leave the appsink waiting forever.
+ */
+static void onDemuxNoMorePads (GstElement *demux, gpointer user_data)
+{
+        GstPad *sinkPad = gst_element_get_static_pad (GST_ELEMENT (user_data), "sink");
+
+        if (!gst_pad_is_linked (sinkPad)) {
+                GError *err = g_error_new_literal (GST_STREAM_ERROR, GST_STREAM_ERROR_DEMUX, "No telemetry track");
+                gst_element_post_message (demux, gst_message_new_error (GST_OBJECT (demux), err, NULL));
+                g_error_free (err);
+        }
+
+        gst_object_unref (sinkPad);
+}
+
+FrameVector readFramesFromMkv (std::string const &path)
+{
+        GstElement *pipeline            = gst_pipeline_new ("telemetry-reader");
+        GstElement *source              = gst_element_factory_make ("filesrc", "source");
+        GstElement *demux               = gst_element_factory_make ("matroskademux", "demux");
+        GstElement *appsink             = gst_element_factory_make ("appsink", "telemetry");
+
+        g_object_set (G_OBJECT (source), "location", path.c_str (), NULL);
+        g_object_set (G_OBJECT (appsink), "sync", FALSE, NULL);
+
+        gst_bin_add_many (GST_BIN (pipeline), source, demux, appsink, NULL);
+        gst_element_link (source, demux);
+        g_signal_connect (demux, "pad-added", G_CALLBACK (onDemuxPadAdded), appsink);
+        g_signal_connect (demux, "no-more-pads", G_CALLBACK (onDemuxNoMorePads), appsink);
+
+        gst_element_set_state (pipeline, GST_STATE_PLAYING);
+
+        FrameVector frames;
+        GstBus *bus = gst_pipeline_get_bus (GST_PIPELINE (pipeline));
+
+        while (!gst_app_sink_is_eos (GST_APP_SINK (appsink))) {
+                GstSample *sample = gst_app_sink_try_pull_sample (GST_APP_SINK (appsink), 100 * GST_MSECOND);
+
+                if (!sample) {
+                        GstMessage *message = gst_bus_pop_filtered (bus, GST_MESSAGE_ERROR);
+
+                        if (message) {
+                                GError *err = NULL;
+                                gst_message_parse_error (message, &err, NULL);
+                                g_critical ("Reading telemetry from %s failed : %s", path.c_str (), err->message);
+                                g_error_free (err);
+                                gst_message_unref (message);
+                                break;
+                        }
+
+                        continue;
+                }
+
+                GstBuffer *buffer = gst_sample_get_buffer (sample);
+                GstMapInfo map;
+
+                if (gst_buffer_map (buffer, &map, GST_MAP_READ)) {
+                        std::istringstream text (std::string (reinterpret_cast <char const *> (map.data), map.size));
+                        std::string line;
+
+                        while (std::getline (text, line)) {
+                                if (!line.empty ()) {
+                                        frames.push_back (parseFrame (line));
+                                }
+                        }
+
+                        gst_buffer_unmap (buffer, &map);
+                }
+
+                gst_sample_unref (sample);
+        }
+
+        gst_object_unref (bus);
+        gst_element_set_state (pipeline, GST_STATE_NULL);
+        gst_object_unref (pipeline);
+        return frames;
+}
@@ -0,0 +1,30 @@
+/****************************************************************************
+ *                                                                          *
+ *  Author : lukasz.iwaszkiewicz@gmail.com                                  *
+ *  ~~~~~~~~                                                                *
+ *  License : see COPYING file for details.                                 *
+ *  ~~~~~~~~~                                                               *
+ ****************************************************************************/
+
+#ifndef TELEMETRYTRACK_H_
+#define TELEMETRYTRACK_H_
+
+#include <gst/gst.h>
+#include <string>
+#include "FrameMap.h"
+
+/**
+ * Builds a pipeline which copies the H.264 stream from h264Path into mkvPath without
+ * decoding it, and stores frames alongside as a UTF-8 text track : one CSV line (see
+ * parseFrame) per sample, timestamped with Frame::timestamp. frames must outlive the
+ * pipeline.
+ */
+GstElement *createRemuxPipeline (std::string const &h264Path, std::string const &mkvPath, FrameVector const &frames);
+
+/**
+ * Reads the telemetry track back from a file written by the remux pipeline. Video is
+ * demuxed but discarded, so this is quick.
+ */
+FrameVector readFramesFromMkv (std::string const &path);
+
+#endif /* TELEMETRYTRACK_H_ */
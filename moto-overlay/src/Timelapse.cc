@@ -0,0 +1,127 @@
+/****************************************************************************
+ *                                                                          *
+ *  Author : lukasz.iwaszkiewicz@gmail.com                                  *
+ *  ~~~~~~~~                                                                *
+ *  License : see COPYING file for details.                                 *
+ *  ~~~~~~~~~                                                               *
+ ****************************************************************************/
+
+
+#include "Timelapse.h"
+#include <algorithm>
+#include <iomanip>
+
+namespace {
+
+enum Pace { NORMAL, SLOW, IDLE };
+
+/**
+ * Run of consecutive samples of the same pace.
+ */
+struct Run {
+        uint64_t beginUs;
+        uint64_t endUs;
+        Pace pace;
+};
+
+Pace paceOf (Frame const &f, TimelapseConfig const &config)
+{
+        if (f.velocity <= 0 && f.rpm < config.idleRpm) {
+                return IDLE;
+        }
+
+        if (f.velocity < config.slowVelocity && config.slowSpeedup > 1) {
+                return SLOW;
+        }
+
+        return NORMAL;
+}
+
+/**
+ * Appends [begin, end), merging it with the previous span if they play at the same speed.
+ */
+void addSpan (TimelapseSpanVector *spans, uint64_t begin, uint64_t end, int speedup)
+{
+        if (begin >= end) {
+                return;
+        }
+
+        if (!spans->empty () && spans->back ().endUs == begin && spans->back ().speedup == speedup) {
+                spans->back ().endUs = end;
+                return;
+        }
+
+        TimelapseSpan s;
+        s.beginUs = begin;
+        s.endUs = end;
+        s.speedup = speedup;
+        spans->push_back (s);
+}
+
+} // namespace
+
+TimelapseSpanVector planTimelapse (FrameVector const &frames, TimelapseConfig const &config)
+{
+        TimelapseSpanVector spans;
+
+        if (frames.empty ()) {
+                return spans;
+        }
+
+        std::vector <Run> runs;
+
+        for (Frame const &f : frames) {
+                Pace pace = paceOf (f, config);
+
+                if (runs.empty () || runs.back ().pace != pace) {
+                        if (!runs.empty ()) {
+                                runs.back ().endUs = f.timestamp;
+                        }
+
+                        runs.push_back (Run { f.timestamp, f.timestamp, pace });
+                }
+        }
+
+        // Video starts with the recording, and may outlast the telemetry a bit.
+        runs.front ().beginUs = 0;
+        runs.back ().endUs = SPAN_OPEN_END;
+
+        for (Run const &r : runs) {
+                bool shortRun = r.endUs - r.beginUs < std::max (config.minSpanUs, 2 * config.idleMarginUs);
+
+                if (r.pace == NORMAL || shortRun) {
+                        addSpan (&spans, r.beginUs, r.endUs, 1);
+                }
+                else if (r.pace == SLOW) {
+                        addSpan (&spans, r.beginUs, r.endUs, config.slowSpeedup);
+                }
+                else {
+                        addSpan (&spans, r.beginUs, r.beginUs + config.idleMarginUs, 1);
+
+                        // Idling at the very end is simply cut off.
+                        if (r.endUs != SPAN_OPEN_END) {
+                                addSpan (&spans, r.endUs - config.idleMarginUs, r.endUs, 1);
+                        }
+                }
+        }
+
+        return spans;
+}
+
+std::ostream &operator<< (std::ostream &o, TimelapseSpan const &s)
+{
+        o << std::fixed << std::setprecision (1) << s.beginUs / 1e6 << " s - ";
+
+        if (s.endUs == SPAN_OPEN_END) {
+                o << "end";
+        }
+        else {
+                o << s.endUs / 1e6 << " s";
+        }
+
+        if (s.speedup > 1) {
+                o << " : " << s.speedup << "x";
+        }
+
+        return o;
+}
@@ -0,0 +1,57 @@
+/****************************************************************************
+ *                                                                          *
+ *  Author : lukasz.iwaszkiewicz@gmail.com                                  *
+ *  ~~~~~~~~                                                                *
+ *  License : see COPYING file for details.                                 *
+ *  ~~~~~~~~~                                                               *
+ ****************************************************************************/
+
+
+#ifndef TIMELAPSE_H_
+#define TIMELAPSE_H_
+
+#include "FrameMap.h"
+#include <cstdint>
+#include <limits>
+#include <ostream>
+#include <vector>
+
+/**
+ * Thresholds for planTimelapse.
+ */
+struct TimelapseConfig {
+        /// Standing still (velocity 0) with RPM below this is idling.
+        float idleRpm = 2000;
+        /// Moving slower than this [km/h] is a slow stretch. 0 : nothing is slow.
+        float slowVelocity = 0;
+        /// Slow stretches play this many times faster.
+        int slowSpeedup = 4;
+        /// Idle or slow stretches shorter than this are kept as they are.
+        uint64_t minSpanUs = 5000000;
+        /// Kept at both ends of an idle stretch, so stops don't cut in abruptly.
+        uint64_t idleMarginUs = 1000000;
+};
+
+/// Span end meaning "till the end of the recording".
+const uint64_t SPAN_OPEN_END = std::numeric_limits <uint64_t>::max ();
+
+/**
+ * Part of the ride which makes it to the timelapse, microseconds of ride time.
+ */
+struct TimelapseSpan {
+        uint64_t beginUs = 0;
+        uint64_t endUs = 0;
+        int speedup = 1;                /// Every speedup-th frame is shown.
+};
+
+typedef std::vector <TimelapseSpan> TimelapseSpanVector;
+
+/**
+ * Decides, in one pass over the telemetry, what to render : idle stretches are left out,
+ * slow ones sped up, the rest kept. Spans are chronological, the last one is open ended.
+ */
+TimelapseSpanVector planTimelapse (FrameVector const &frames, TimelapseConfig const &config);
+
+std::ostream &operator<< (std::ostream &o, TimelapseSpan const &s);
+
+#endif /* TIMELAPSE_H_ */
@@ -20,18 +20,44 @@
 #include <cmath>
 #include <boost/lexical_cast.hpp>
 #include <string>
+#include <map>
+#include <mutex>
 
-struct YamahaPainter::Impl {
+namespace {
+const int LAYOUT_WIDTH = 1280;
+const double IMAGE_SCALE = 0.2; // PNGs are drawn 5 times larger than they appear.
+const float RPM_TO_RADIANS = 0.027082695289567187;
+}
+
+struct YamahaAssets::Impl {
         FT_Library ft_library;
         FT_Face ft_face;
         cairo_font_face_t *cairo_ft_face = 0;
         cairo_surface_t *dashSurface = 0;
         cairo_surface_t *pointerSurface = 0;
-        float FULL_SCALE = 3.520750387643734; // 13kRPM.
-        float RPM_TO_RADIANS = 0.027082695289567187;
+        std::mutex mutex;
+        std::map <int, Baked> baked;
 };
 
-YamahaPainter::YamahaPainter ()
+/**
+ * Returns a copy of the source scaled by factor.
+ */
+static cairo_surface_t *scaleSurface (cairo_surface_t *source, double factor)
+{
+        int width = std::ceil (cairo_image_surface_get_width (source) * factor);
+        int height = std::ceil (cairo_image_surface_get_height (source) * factor);
+        cairo_surface_t *scaled = cairo_image_surface_create (CAIRO_FORMAT_ARGB32, width, height);
+        cairo_t *cr = cairo_create (scaled);
+
+        cairo_scale (cr, factor, factor);
+        cairo_set_source_surface (cr, source, 0, 0);
+        cairo_pattern_set_filter (cairo_get_source (cr), CAIRO_FILTER_BEST);
+        cairo_paint (cr);
+        cairo_destroy (cr);
+        return scaled;
+}
+
+YamahaAssets::YamahaAssets ()
 {
         impl = new Impl ();
         double ptSize = 50.0;
@@ -49,15 +75,58 @@ YamahaPainter::YamahaPainter ()
         impl->pointerSurface = cairo_image_surface_create_from_png ("image/pointer.png");
 }
 
-YamahaPainter::~YamahaPainter ()
+YamahaAssets::~YamahaAssets ()
 {
+        for (auto const &entry : impl->baked) {
+                cairo_surface_destroy (entry.second.dash);
+                cairo_surface_destroy (entry.second.pointer);
+        }
+
+        cairo_surface_destroy (impl->dashSurface);
+        cairo_surface_destroy (impl->pointerSurface);
+        cairo_font_face_destroy (impl->cairo_ft_face);
         FT_Done_Face (impl->ft_face);
         FT_Done_FreeType (impl->ft_library);
         delete impl;
 }
 
+YamahaAssets::Baked const *YamahaAssets::bakedFor (int width)
+{
+        std::lock_guard <std::mutex> lock (impl->mutex);
+        auto i = impl->baked.find (width);
+
+        if (i != impl->baked.end ()) {
+                return &i->second;
+        }
+
+        Baked &b = impl->baked[width];
+        b.scale = double (width) / LAYOUT_WIDTH;
+        b.dash = scaleSurface (impl->dashSurface, IMAGE_SCALE * b.scale);
+        b.pointer = scaleSurface (impl->pointerSurface, IMAGE_SCALE * b.scale);
+        return &b;
+}
+
+cairo_font_face_t *YamahaAssets::fontFace () const
+{
+        return impl->cairo_ft_face;
+}
+
+/****************************************************************************/
+
+void YamahaPainter::bake (int width)
+{
+        baked = assets->bakedFor (width);
+}
+
 void YamahaPainter::paint (cairo_t *cr, Frame const &dto)
 {
+        if (!baked) {
+                bake (LAYOUT_WIDTH);
+        }
+
+        double s = baked->scale;
+        double k = IMAGE_SCALE * s;
+
 #if 0
         // Semi-transparent backround
         cairo_set_source_rgba (cr, 1.0, 1.0, 1.0, 0.5);
@@ -65,16 +134,16 @@ void YamahaPainter::paint (cairo_t *cr, Frame const &dto)
         cairo_fill (cr);
 #endif
 
-        // Dash
+        // Dash, baked to its final size, so it is a plain 1:1 blit at whole pixels.
         cairo_save (cr);
-        cairo_translate (cr, 880, 520);
-        cairo_scale (cr, 0.2, 0.2);
-        cairo_set_source_surface (cr, impl->dashSurface, 0, 0);
+        cairo_set_source_surface (cr, baked->dash, std::round (880 * s), std::round (520 * s));
         cairo_paint (cr);
         cairo_restore (cr);
 
         // Velocity
-        cairo_set_font_face (cr, impl->cairo_ft_face);
+        cairo_save (cr);
+        cairo_scale (cr, s, s);
+        cairo_set_font_face (cr, assets->fontFace ());
         cairo_set_font_size (cr, 18.0);
         cairo_set_source_rgba (cr, 0.0, 0.0, 0.0, 1.0);
         cairo_move_to(cr, 1006, 605);
@@ -85,13 +154,15 @@ void YamahaPainter::paint (cairo_t *cr, Frame const &dto)
         cairo_set_source_rgba (cr, 0.0, 0.0, 0.0, 1.0);
         cairo_move_to(cr, 950, 595);
         cairo_show_text(cr, boost::lexical_cast <std::string> (int (dto.engineTemp + 0.5)).c_str ());
+        cairo_restore (cr);
 
         // Pointer
-        cairo_translate (cr, 1115.5, 611);
-        cairo_scale (cr, 0.2, 0.2);
-        cairo_translate (cr, 308, 71);
-        cairo_rotate (cr, dto.rpm * impl->RPM_TO_RADIANS);
-        cairo_translate (cr, -308, -71);
-        cairo_set_source_surface (cr, impl->pointerSurface, 0, 0);
+        cairo_save (cr);
+        cairo_translate (cr, 1115.5 * s, 611 * s);
+        cairo_translate (cr, 308 * k, 71 * k);
+        cairo_rotate (cr, dto.rpm * RPM_TO_RADIANS);
+        cairo_translate (cr, -308 * k, -71 * k);
+        cairo_set_source_surface (cr, baked->pointer, 0, 0);
         cairo_paint (cr);
+        cairo_restore (cr);
 }
@@ -13,12 +13,31 @@
 #include <cairo.h>
 #include "Frame.h"
 
-class YamahaPainter : public IPainter {
+/**
+ * Font and gauge images of the Yamaha layout, loaded once and shared (read only) by any
+ * number of painters, also across threads.
+ */
+class YamahaAssets {
 public:
-        YamahaPainter ();
-        virtual ~YamahaPainter ();
+        YamahaAssets ();
+        ~YamahaAssets ();
 
-        virtual void paint (cairo_t *cr, Frame const &dto);
+        YamahaAssets (YamahaAssets const &) = delete;
+        YamahaAssets &operator= (YamahaAssets const &) = delete;
+
+        /**
+         * Gauge images pre-rendered for frames width pixels wide (the layout is made for
+         * 1280). Made on first request for the given width, then reused.
+         */
+        struct Baked {
+                double scale;
+                cairo_surface_t *dash;
+                cairo_surface_t *pointer;
+        };
+
+        Baked const *bakedFor (int width);
+
+        cairo_font_face_t *fontFace () const;
 
 private:
 
@@ -26,4 +45,23 @@ private:
         Impl *impl = 0;
 };
 
+class YamahaPainter : public IPainter {
+public:
+        explicit YamahaPainter (YamahaAssets *assets) : assets (assets) {}
+        virtual ~YamahaPainter () {}
+
+        virtual void paint (cairo_t *cr, Frame const &dto);
+
+        /**
+         * Picks the gauge images pre-rendered for frames width pixels wide, so paint only
+         * blits them. Call when the frame size is known.
+         */
+        void bake (int width);
+
+private:
+
+        YamahaAssets *assets;
+        YamahaAssets::Baked const *baked = 0;
+};
+
 #endif /* YAMAHAPAINTER_H_ */
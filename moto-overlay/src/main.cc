@@ -35,21 +35,38 @@
 #include FT_TRUETYPE_IDS_H
 
 #include <glib.h>
+#include <glib/gstdio.h>
 #include <cassert>
+#include <cmath>
 #include <iostream>
 #include <algorithm>
 #include "YamahaPainter.h"
 #include "FrameMap.h"
+#include "Options.h"
+#include "TelemetryTrack.h"
+#include "PipelineStats.h"
+#include "TelemetryCursor.h"
+#include "ClipSource.h"
+#include "Highlights.h"
+#include "Timelapse.h"
+#include "Stitch.h"
+#include "ContactSheet.h"
 
-YamahaPainter painter;
-FrameVector frames;
+/**
+ * Pipelines run by the main loop. It quits when all of them reach EOS, or on the first error.
+ */
+struct RunState {
+        GMainLoop *loop;
+        size_t running;
+        bool failed;
+};
 
 /**
  *
  */
 static gboolean on_message (GstBus * bus, GstMessage * message, gpointer user_data)
 {
-        GMainLoop *loop = (GMainLoop *) user_data;
+        RunState *run = (RunState *) user_data;
 
         switch (GST_MESSAGE_TYPE (message)) {
         case GST_MESSAGE_ERROR:
@@ -59,7 +76,8 @@ static gboolean on_message (GstBus * bus, GstMessage * message, gpointer user_da
 
                 gst_message_parse_error (message, &err, &debug);
                 g_critical ("Got ERROR: %s (%s)", err->message, GST_STR_NULL (debug));
-                g_main_loop_quit (loop);
+                run->failed = true;
+                g_main_loop_quit (run->loop);
                 break;
         }
         case GST_MESSAGE_WARNING:
@@ -68,12 +86,14 @@ static gboolean on_message (GstBus * bus, GstMessage * message, gpointer user_da
                 gchar *debug;
 
                 gst_message_parse_warning (message, &err, &debug);
+                // Not fatal : quitting here would leave the other pipelines half written, and no failure reported.
                 g_warning ("Got WARNING: %s (%s)", err->message, GST_STR_NULL (debug));
-                g_main_loop_quit (loop);
                 break;
         }
         case GST_MESSAGE_EOS:
-                g_main_loop_quit (loop);
+                if (--run->running == 0) {
+                        g_main_loop_quit (run->loop);
+                }
                 break;
         default:
                 break;
@@ -87,128 +107,680 @@ static gboolean on_message (GstBus * bus, GstMessage * message, gpointer user_da
 typedef struct {
         gboolean valid;
         GstVideoInfo vinfo;
+        guint64 frames;                 /// Frames drawn so far, for the real-time factor.
+        GstClockTime mediaTime;         /// Sum of their durations.
 } CairoOverlayState;
 
+/**
+ * State of one rendition branch, given to its cairooverlay callbacks.
+ */
+struct OverlayBranch {
+        OverlayBranch (TelemetryFanout *t, YamahaAssets *assets) : state (), painter (assets), telemetry (t) {}
+
+        CairoOverlayState state;
+        YamahaPainter painter;
+        TelemetryFanout *telemetry;
+};
+
+/**
+ * Everything one pipeline (one render) uses : its telemetry, lookup state, painters and
+ * instrumentation. Nothing is global, so any number of renders can run at once. frames,
+ * index and assets are read only and may be shared between renders.
+ */
+struct Render {
+        Render (FrameVector const *frames, YamahaAssets *assets, size_t renditions, FrameIndex const *index = 0) : telemetry (frames, index)
+        {
+                for (size_t n = 0; n < renditions; ++n) {
+                        branches.push_back (new OverlayBranch (&telemetry, assets));
+                }
+        }
+
+        ~Render ()
+        {
+                if (pipeline) {
+                        gst_element_set_state (pipeline, GST_STATE_NULL);
+                        gst_object_unref (pipeline);
+                }
+
+                for (OverlayBranch *branch : branches) {
+                        delete branch;
+                }
+
+                delete stats;
+        }
+
+        TelemetryFanout telemetry;
+        std::vector <OverlayBranch *> branches;
+        GstElement *pipeline = NULL;
+        PipelineStats *stats = NULL;
+};
+
 /* Store the information from the caps that we are interested in. */
 static void prepare_overlay (GstElement * overlay, GstCaps * caps, gpointer user_data)
 {
-        CairoOverlayState *state = (CairoOverlayState *) user_data;
+        OverlayBranch *branch = (OverlayBranch *) user_data;
+        CairoOverlayState *state = &branch->state;
 
         state->valid = gst_video_info_from_caps (&state->vinfo, caps);
+
+        if (state->valid) {
+                branch->painter.bake (GST_VIDEO_INFO_WIDTH (&state->vinfo));
+        }
 }
 
 /* Draw the overlay.
  * This function draws a cute "beating" heart. */
 static void draw_overlay (GstElement *overlay, cairo_t * cr, guint64 timestamp, guint64 duration, gpointer user_data)
 {
-        CairoOverlayState *s = (CairoOverlayState *) user_data;
-        float rpm = 2 * (((timestamp / (int) 1e7) % 70) + 30) / 100.0;
-        int width, height;
+        OverlayBranch *branch = (OverlayBranch *) user_data;
+        CairoOverlayState *s = &branch->state;
 
         if (!s->valid)
                 return;
 
-        width = GST_VIDEO_INFO_WIDTH (&s->vinfo);
-        height = GST_VIDEO_INFO_HEIGHT (&s->vinfo);
+        ++s->frames;
+        s->mediaTime += duration;
 
         // TODO more careful timing here.
-        FrameVector::const_iterator i = std::lower_bound (frames.begin (), frames.end (), timestamp / 1000, [](Frame const &f, uint32_t t) { return f.timestamp < t; });
-        Frame currentFrame;
-
-        if (i != frames.end ()) {
-               currentFrame = *i;
-        }
-
+        Frame currentFrame = branch->telemetry->lookup (timestamp);
 
 #if 0
         std::cerr << "GST TIME=" << timestamp << ", " << currentFrame << std::endl;
 #endif
 
-        painter.paint (cr, currentFrame);
+        branch->painter.paint (cr, currentFrame);
 }
 
-static GstElement *
-setup_gst_pipeline (CairoOverlayState * overlay_state)
+/**
+ * Telemetry is looked up once per decoded frame, before the tee.
+ */
+static GstPadProbeReturn resolve_telemetry (GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
+{
+        GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER (info);
+
+        if (GST_CLOCK_TIME_IS_VALID (GST_BUFFER_PTS (buffer))) {
+                static_cast <TelemetryFanout *> (user_data)->resolve (GST_BUFFER_PTS (buffer));
+        }
+
+        return GST_PAD_PROBE_OK;
+}
+
+/**
+ * Which decoded frames go on : every draftStep-th with --draft-step, and every
+ * speedup-th (the segment rate) in sped up parts of a timelapse.
+ */
+struct FrameThinning {
+        explicit FrameThinning (guint64 d) : draftStep (d), step (d) {}
+
+        guint64 draftStep;
+        guint64 step;
+};
+
+static void delete_thinning (gpointer data)
+{
+        delete static_cast <FrameThinning *> (data);
+}
+
+/**
+ * Drops the frames FrameThinning says nobody will see, stretching the kept ones over them.
+ */
+static GstPadProbeReturn thin_frames (GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
+{
+        FrameThinning *thinning = static_cast <FrameThinning *> (user_data);
+
+        if (GST_PAD_PROBE_INFO_TYPE (info) & GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM) {
+                GstEvent *event = GST_PAD_PROBE_INFO_EVENT (info);
+
+                if (GST_EVENT_TYPE (event) == GST_EVENT_SEGMENT) {
+                        const GstSegment *segment;
+                        gst_event_parse_segment (event, &segment);
+                        thinning->step = thinning->draftStep * std::max (1L, std::lround (segment->rate));
+                }
+
+                return GST_PAD_PROBE_OK;
+        }
+
+        GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER (info);
+
+        if (thinning->step <= 1 || !GST_CLOCK_TIME_IS_VALID (GST_BUFFER_PTS (buffer))) {
+                return GST_PAD_PROBE_OK;
+        }
+
+        guint64 frame = (GST_BUFFER_PTS (buffer) + VIDEO_FRAME_DURATION_NS / 2) / VIDEO_FRAME_DURATION_NS;
+
+        if (frame % thinning->step) {
+                return GST_PAD_PROBE_DROP;
+        }
+
+        buffer = gst_buffer_make_writable (buffer);
+        GST_BUFFER_DURATION (buffer) = thinning->step * VIDEO_FRAME_DURATION_NS;
+        GST_PAD_PROBE_INFO_DATA (info) = buffer;
+        return GST_PAD_PROBE_OK;
+}
+
+/**
+ * Name of a per-branch element.
+ */
+static std::string branch_element_name (const char *name, size_t n)
+{
+        return name + std::to_string (n);
+}
+
+/**
+ * Queue which decouples two pipeline stages : everything downstream of it runs in its own
+ * streaming thread. Bounded by buffer count only, so raw video does not pile up in RAM.
+ */
+static GstElement *make_stage_queue (std::string const &name, Options const &options)
+{
+        GstElement *queue = gst_element_factory_make ("queue", name.c_str ());
+        g_object_set (G_OBJECT (queue), "max-size-buffers", options.queueSize, "max-size-bytes", 0, "max-size-time", (guint64) 0, NULL);
+        return queue;
+}
+
+/**
+ * Adds branch n of the tee : stages 2 - 4 (see setup_gst_pipeline) for one rendition.
+ */
+static void add_rendition_branch (GstElement *pipeline, GstElement *tee, size_t n, Rendition const &rendition, OverlayBranch *branch, Options const &options)
 {
         /* Adaptors needed because cairooverlay only supports ARGB data */
-        GstElement *pipeline            = gst_pipeline_new ("cairo-overlay-example");
-        GstElement *source              = gst_element_factory_make ("filesrc", "source");
-        GstElement *filter              = gst_element_factory_make ("capsfilter", "filter");
-        GstElement *parser              = gst_element_factory_make ("h264parse", "parser");
-        GstElement *decoder             = gst_element_factory_make ("avdec_h264", "decoder");
-        GstElement *adaptor1            = gst_element_factory_make ("videoconvert", "adaptor1");
-        GstElement *cairo_overlay       = gst_element_factory_make ("cairooverlay", "overlay");
-        GstElement *adaptor2            = gst_element_factory_make ("videoconvert", "adaptor2");
+        GstElement *decoded             = make_stage_queue (branch_element_name ("decoded", n), options);
+        GstElement *scale               = gst_element_factory_make ("videoscale", branch_element_name ("scale", n).c_str ());
+        GstElement *size                = gst_element_factory_make ("capsfilter", branch_element_name ("size", n).c_str ());
+        GstElement *adaptor1            = gst_element_factory_make ("videoconvert", branch_element_name ("adaptor1", n).c_str ());
+        GstElement *cairo_overlay       = gst_element_factory_make ("cairooverlay", branch_element_name ("overlay", n).c_str ());
+        GstElement *overlaid            = make_stage_queue (branch_element_name ("overlaid", n), options);
+        GstElement *adaptor2            = gst_element_factory_make ("videoconvert", branch_element_name ("adaptor2", n).c_str ());
+        GstElement *converted           = make_stage_queue (branch_element_name ("converted", n), options);
 //        GstElement *videorate           = gst_element_factory_make ("videorate", "rate");
 //        GstElement *sink                = gst_element_factory_make ("autovideosink", "sink");
 
 //        ! x264enc byte-stream=true ! filesink location=$2
 
-        GstElement *encoder             = gst_element_factory_make ("x264enc", "encoder");
-        GstElement *matroska            = gst_element_factory_make ("matroskamux", "matroska");
-        GstElement *sink                = gst_element_factory_make ("filesink", "sink");
-        g_object_set (G_OBJECT (sink), "location", "video.mkv", NULL);
+        GstElement *encoder             = gst_element_factory_make ("x264enc", branch_element_name ("encoder", n).c_str ());
+        // Chunks of a chunked render stay raw H.264 (x264enc output as is), to be joined later.
+        const char *muxerType           = (g_str_has_suffix (rendition.output.c_str (), ".h264")) ? "identity" : "matroskamux";
+        GstElement *muxer               = gst_element_factory_make (muxerType, branch_element_name ("muxer", n).c_str ());
+        GstElement *sink                = gst_element_factory_make ("filesink", branch_element_name ("sink", n).c_str ());
+        g_object_set (G_OBJECT (sink), "location", rendition.output.c_str (), NULL);
 
         /* If failing, the element could not be created */
         g_assert (cairo_overlay);
 
         g_object_set (G_OBJECT (encoder), "byte-stream", 1, NULL);
-        g_object_set (G_OBJECT (source), "location", "00000.h264", NULL);
+
+        // 0 means "as many as there are cores".
+        g_object_set (G_OBJECT (encoder), "threads", (guint) options.encoderThreads, NULL);
+        g_object_set (G_OBJECT (adaptor1), "n-threads", (guint) options.convertThreads, NULL);
+        g_object_set (G_OBJECT (adaptor2), "n-threads", (guint) options.convertThreads, NULL);
+
+        if (rendition.bitrate > 0) {
+                g_object_set (G_OBJECT (encoder), "bitrate", (guint) rendition.bitrate, NULL);
+        }
+
+        if (!rendition.preset.empty ()) {
+                gst_util_set_object_arg (G_OBJECT (encoder), "speed-preset", rendition.preset.c_str ());
+        }
+
+        // Scale before converting to ARGB : less data to convert and overlay.
+        if (rendition.width > 0) {
+                GstCaps *caps = gst_caps_new_simple ("video/x-raw",
+                                                     "width", G_TYPE_INT, rendition.width,
+                                                     "height", G_TYPE_INT, rendition.height,
+                                                     "pixel-aspect-ratio", GST_TYPE_FRACTION, 1, 1,
+                                                     NULL);
+                g_object_set (G_OBJECT (size), "caps", caps, NULL);
+                gst_caps_unref (caps);
+        }
+
+        /* Hook up the neccesary signals for cairooverlay */
+        g_signal_connect (cairo_overlay, "draw", G_CALLBACK (draw_overlay), branch);
+        g_signal_connect (cairo_overlay, "caps-changed", G_CALLBACK (prepare_overlay), branch);
+
+        gst_bin_add_many (GST_BIN (pipeline), decoded, scale, size, adaptor1, cairo_overlay, overlaid, adaptor2, converted, /*videorate,*/ encoder, muxer, sink, NULL);
+
+        if (!gst_element_link_many (tee, decoded, scale, size, adaptor1, cairo_overlay, overlaid, adaptor2, converted, /*videorate,*/ encoder, muxer, sink, NULL)) {
+                g_warning ("Failed to link elements!");
+        }
+}
+
+/**
+ * Stages (each in its own thread) :
+ * 1. filesrc ! capsfilter ! h264parse ! avdec_h264 ! tee (appsrc from ClipSource instead of filesrc when rendering ranges
+ *    or keyframe drafts)
+ * and then for every rendition :
+ * 2. videoscale ! capsfilter ! videoconvert ! cairooverlay
+ * 3. videoconvert
+ * 4. x264enc ! matroskamux ! filesink
+ */
+static GstElement *
+setup_gst_pipeline (std::vector <OverlayBranch *> const &branches, TelemetryFanout *telemetry, Options const &options, std::vector <TimeRange> const &ranges)
+{
+        GstElement *pipeline            = gst_pipeline_new ("cairo-overlay-example");
+        GstElement *source              = NULL;
+        GstElement *filter              = gst_element_factory_make ("capsfilter", "filter");
+        GstElement *parser              = gst_element_factory_make ("h264parse", "parser");
+        GstElement *decoder             = gst_element_factory_make ("avdec_h264", "decoder");
+        GstElement *tee                 = gst_element_factory_make ("tee", "tee");
+
+        g_object_set (G_OBJECT (decoder), "max-threads", options.decoderThreads, NULL);
+
+        if (options.draft && options.draftStep == 0) {
+                // Only the keyframes are read and decoded.
+                std::vector <TimeRange> whole { TimeRange { 0, GST_CLOCK_TIME_NONE } };
+                source = createClipSource (options.input, (ranges.empty ()) ? whole : ranges, true);
+        }
+        else if (!ranges.empty ()) {
+                // Only the ranges (each from its preceding keyframe on) are read and decoded.
+                source = createClipSource (options.input, ranges);
+        }
+        else {
+                source = gst_element_factory_make ("filesrc", "source");
+                g_object_set (G_OBJECT (source), "location", options.input.c_str (), NULL);
+        }
+
+        if (!source) {
+                gst_object_unref (pipeline);
+                return NULL;
+        }
 
         // Set the caps (fps interests us the most).
         GstCaps *caps = gst_caps_new_simple ("video/x-h264",
-                                             "framerate", GST_TYPE_FRACTION, 30, 1,
+                                             "framerate", GST_TYPE_FRACTION, VIDEO_FRAME_RATE, 1,
                                               NULL);
 
         g_object_set (G_OBJECT (filter), "caps", caps, NULL);
         gst_caps_unref (caps);
 
-        /* Hook up the neccesary signals for cairooverlay */
-        g_signal_connect (cairo_overlay, "draw", G_CALLBACK (draw_overlay), overlay_state);
-        g_signal_connect (cairo_overlay, "caps-changed", G_CALLBACK (prepare_overlay), overlay_state);
+        guint64 draftStep = (options.draft && options.draftStep > 1) ? options.draftStep : 1;
+
+        if (draftStep > 1 || options.timelapse) {
+                GstPad *decoderSrc = gst_element_get_static_pad (decoder, "src");
+                gst_pad_add_probe (decoderSrc, GstPadProbeType (GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM), thin_frames, new FrameThinning (draftStep), delete_thinning);
+                gst_object_unref (decoderSrc);
+        }
+
+        GstPad *teeSink = gst_element_get_static_pad (tee, "sink");
+        gst_pad_add_probe (teeSink, GST_PAD_PROBE_TYPE_BUFFER, resolve_telemetry, telemetry, NULL);
+        gst_object_unref (teeSink);
 
-        gst_bin_add_many (GST_BIN (pipeline), source, filter, parser, decoder, adaptor1, cairo_overlay, adaptor2, /*videorate,*/ encoder, matroska, sink, NULL);
+        gst_bin_add_many (GST_BIN (pipeline), source, filter, parser, decoder, tee, NULL);
 
-        if (!gst_element_link_many (source, filter, parser, decoder, adaptor1, cairo_overlay, adaptor2, /*videorate,*/ encoder, matroska, sink, NULL)) {
+        if (!gst_element_link_many (source, filter, parser, decoder, tee, NULL)) {
                 g_warning ("Failed to link elements!");
         }
 
+        for (size_t n = 0; n < branches.size (); ++n) {
+                add_rendition_branch (pipeline, tee, n, options.renditions[n], branches[n], options);
+        }
+
         return pipeline;
 }
 
+/**
+ * Prints how many times faster than real time the render went, along with the threading
+ * configuration, so layouts can be compared per machine.
+ */
+static void print_realtime_factor (CairoOverlayState const *state, Options const &options, gint64 wallUs)
+{
+        double mediaSec = double (state->mediaTime) / GST_SECOND;
+        double wallSec = double (wallUs) / G_USEC_PER_SEC;
+
+        if (options.draft) {
+                g_print ("draft %dx%d step=%d : ", options.draftWidth, options.draftHeight, options.draftStep);
+        }
+
+        g_print ("decoder-threads=%d encoder-threads=%d convert-threads=%d queue-size=%d : %" G_GUINT64_FORMAT " frames, %.1f s of video in %.1f s, %.2fx real time (%.1f fps)\n",
+                 options.decoderThreads, options.encoderThreads, options.convertThreads, options.queueSize,
+                 state->frames, mediaSec, wallSec, (wallSec > 0) ? mediaSec / wallSec : 0.0, (wallSec > 0) ? state->frames / wallSec : 0.0);
+}
+
+/// Queue levels are sampled this often when --stats or --stats-dump is on.
+static const guint QUEUE_SAMPLE_INTERVAL_MS = 100;
+
+static gboolean sample_stats (gpointer user_data)
+{
+        static_cast <PipelineStats *> (user_data)->sample ();
+        return G_SOURCE_CONTINUE;
+}
+
+static gboolean print_stats (gpointer user_data)
+{
+        static_cast <PipelineStats *> (user_data)->printSummary (std::cerr);
+        return G_SOURCE_CONTINUE;
+}
+
+/**
+ * Instruments the elements which can be the bottleneck, and the queues between them. The
+ * summary is printed only with --stats, --stats-dump alone just writes the samples.
+ */
+static PipelineStats *setup_stats (GstElement *pipeline, Options const &options)
+{
+        PipelineStats *stats = new PipelineStats (options.statsDump);
+        GstElement *decoder = gst_bin_get_by_name (GST_BIN (pipeline), "decoder");
+        stats->watchElement (decoder);
+        gst_object_unref (decoder);
+
+        for (size_t n = 0; n < options.renditions.size (); ++n) {
+                for (const char *name : { "adaptor1", "overlay", "adaptor2", "encoder" }) {
+                        GstElement *element = gst_bin_get_by_name (GST_BIN (pipeline), branch_element_name (name, n).c_str ());
+                        stats->watchElement (element);
+                        gst_object_unref (element);
+                }
+
+                for (const char *name : { "decoded", "overlaid", "converted" }) {
+                        GstElement *queue = gst_bin_get_by_name (GST_BIN (pipeline), branch_element_name (name, n).c_str ());
+                        stats->watchQueue (queue);
+                        gst_object_unref (queue);
+                }
+        }
+
+        g_timeout_add (QUEUE_SAMPLE_INTERVAL_MS, sample_stats, stats);
+
+        if (options.statsInterval > 0) {
+                g_timeout_add_seconds (options.statsInterval, print_stats, stats);
+        }
+
+        return stats;
+}
+
+/**
+ * Parts of the ride to render : the highlight reel, the timelapse, the --from/--to clip, or
+ * everything (empty).
+ */
+static std::vector <TimeRange> select_ranges (Options const &options, FrameVector const &frames)
+{
+        std::vector <TimeRange> ranges;
+
+        if (options.highlights) {
+                HighlightConfig config;
+                config.rpmBurst = options.highlightRpm;
+                config.brakingDecel = options.highlightBraking;
+                config.reelLengthUs = uint64_t (options.reelLength) * 1000000;
+
+                HighlightVector reel = findHighlights (frames, config);
+                std::cout << "Highlights, best first :\n";
+
+                for (Highlight const &h : reel) {
+                        std::cout << "  " << h << "\n";
+                }
+
+                for (Highlight const &h : chronological (reel)) {
+                        ranges.push_back (TimeRange { h.beginUs * GST_USECOND, h.endUs * GST_USECOND });
+                }
+
+                if (ranges.empty ()) {
+                        g_printerr ("No highlights found\n");
+                }
+        }
+        else if (options.timelapse) {
+                TimelapseConfig config;
+                config.idleRpm = options.idleRpm;
+                config.slowVelocity = options.slowSpeed;
+                config.slowSpeedup = options.speedup;
+
+                TimelapseSpanVector spans = planTimelapse (frames, config);
+                std::cout << "Timelapse :\n";
+
+                for (TimelapseSpan const &s : spans) {
+                        // Cut to --from/--to.
+                        GstClockTime begin = std::max (s.beginUs * GST_USECOND, options.from);
+                        GstClockTime end = (s.endUs == SPAN_OPEN_END) ? options.to : std::min (s.endUs * GST_USECOND, options.to);
+
+                        if (begin < end) {
+                                std::cout << "  " << s << "\n";
+                                ranges.push_back (TimeRange { begin, end, s.speedup });
+                        }
+                }
+
+                if (ranges.empty ()) {
+                        g_printerr ("Nothing but idling to render\n");
+                }
+        }
+        else if (options.hasClip ()) {
+                ranges.push_back (TimeRange { options.from, options.to });
+        }
+
+        return ranges;
+}
+
+/**
+ * Telemetry comes either from the recorder's CSV or from a telemetry track of a remuxed file.
+ */
+static FrameVector load_telemetry (std::string const &path)
+{
+        if (g_str_has_suffix (path.c_str (), ".mkv")) {
+                return readFramesFromMkv (path);
+        }
+
+        return readFrames (path);
+}
+
+/**
+ * The recorder's per frame sidecar (NNNNN.frames) of the input. Its rows number the lines
+ * of the segment's own NNNNN.csv, so it is used only if that is the telemetry given.
+ */
+static bool load_sidecar (Options const &options, FrameIndex *index)
+{
+        std::string sidecar = FrameIndex::pathFor (options.input);
+        std::string csv = sidecar.substr (0, sidecar.size () - std::string (".frames").size ()) + ".csv";
+
+        if (options.telemetry != csv || !index->read (sidecar)) {
+                return false;
+        }
+
+        std::cerr << "Telemetry matched per frame from " << sidecar << " (" << index->size () << " frames)." << std::endl;
+        return true;
+}
+
+/**
+ * --chunks : one pipeline per chunk, every rendition encoded into chunkPath (output, n).
+ * Empty if the input can't be split.
+ */
+static std::vector <Render *> setup_chunks (Options const &options, FrameVector const *frames, FrameIndex const *index, YamahaAssets *assets,
+                                            std::vector <TimeRange> const &ranges)
+{
+        TimeRange whole = (ranges.empty ()) ? TimeRange { 0, GST_CLOCK_TIME_NONE } : ranges.front ();
+        std::vector <TimeRange> parts = splitAtKeyframes (options.input, whole, options.chunks);
+        std::vector <Render *> renders;
+
+        // Chunks run side by side, so each stage gets a single thread unless told otherwise.
+        Options chunkOptions = options;
+        chunkOptions.decoderThreads = (options.decoderThreads) ? options.decoderThreads : 1;
+        chunkOptions.encoderThreads = (options.encoderThreads) ? options.encoderThreads : 1;
+        chunkOptions.convertThreads = (options.convertThreads) ? options.convertThreads : 1;
+
+        for (size_t n = 0; n < parts.size (); ++n) {
+                for (size_t r = 0; r < options.renditions.size (); ++r) {
+                        chunkOptions.renditions[r].output = chunkPath (options.renditions[r].output, n);
+                }
+
+                Render *render = new Render (frames, assets, options.renditions.size (), index);
+                render->pipeline = setup_gst_pipeline (render->branches, &render->telemetry, chunkOptions, { parts[n] });
+                renders.push_back (render);
+        }
+
+        return renders;
+}
+
+/**
+ * Runs pipelines until all of them finish. Returns false on error.
+ */
+static bool run_pipelines (std::vector <GstElement *> const &pipelines, GMainLoop *loop)
+{
+        RunState run { loop, pipelines.size (), false };
+
+        for (GstElement *pipeline : pipelines) {
+                GstBus *bus = gst_pipeline_get_bus (GST_PIPELINE (pipeline));
+                gst_bus_add_signal_watch (bus);
+                g_signal_connect (G_OBJECT (bus), "message", G_CALLBACK (on_message), &run);
+                gst_object_unref (GST_OBJECT (bus));
+        }
+
+        for (GstElement *pipeline : pipelines) {
+                gst_element_set_state (pipeline, GST_STATE_PLAYING);
+        }
+
+        g_main_loop_run (loop);
+
+        for (GstElement *pipeline : pipelines) {
+                gst_element_set_state (pipeline, GST_STATE_NULL);
+                GstBus *bus = gst_pipeline_get_bus (GST_PIPELINE (pipeline));
+                g_signal_handlers_disconnect_by_func (bus, (gpointer) on_message, &run);
+                gst_bus_remove_signal_watch (bus);
+                gst_object_unref (GST_OBJECT (bus));
+        }
+
+        return !run.failed;
+}
+
+/**
+ * Joins the chunks of every rendition into its output, and removes them. A rendition whose
+ * stitch fails keeps its chunks, and the others are stitched anyway.
+ */
+static bool stitch_chunks (Options const &options, size_t chunks, GMainLoop *loop)
+{
+        bool ok = true;
+
+        for (Rendition const &rendition : options.renditions) {
+                std::vector <std::string> paths;
+
+                for (size_t n = 0; n < chunks; ++n) {
+                        paths.push_back (chunkPath (rendition.output, n));
+                }
+
+                GstElement *pipeline = createStitchPipeline (paths, rendition.output);
+                bool stitched = pipeline && run_pipelines ({ pipeline }, loop);
+
+                if (pipeline) {
+                        gst_object_unref (pipeline);
+                }
+
+                if (!stitched) {
+                        g_critical ("Stitching %s failed, its chunks are kept", rendition.output.c_str ());
+                        ok = false;
+                        continue;
+                }
+
+                for (std::string const &path : paths) {
+                        g_remove (path.c_str ());
+                }
+        }
+
+        return ok;
+}
+
+/**
+ * --contact-sheet : thumbnails of the --from/--to clip (or everything) instead of a video.
+ */
+static bool make_contact_sheet (Options const &options, FrameVector const &frames, FrameIndex const *index)
+{
+        ContactSheetConfig config;
+        config.thumbnails = options.thumbnails;
+        config.columns = options.columns;
+        config.thumbWidth = options.thumbWidth;
+        config.thumbHeight = options.thumbHeight;
+
+        YamahaAssets assets;
+        gint64 startUs = g_get_monotonic_time ();
+        bool ok = renderContactSheet (options.input, TimeRange { options.from, options.to }, frames, index, &assets, config, options.contactSheet);
+
+        if (ok) {
+                g_print ("%s written in %.2f s\n", options.contactSheet.c_str (), double (g_get_monotonic_time () - startUs) / G_USEC_PER_SEC);
+        }
+
+        return ok;
+}
 
 int main (int argc, char **argv)
 {
-        frames = readFrames ("00000.csv");
+        gst_init (&argc, &argv);
+
+        Options options;
+
+        if (!parseOptions (argc, argv, &options)) {
+                return 1;
+        }
+
+        FrameVector frames = load_telemetry (options.telemetry);
+        FrameIndex sidecar;
+        FrameIndex const *index = (load_sidecar (options, &sidecar)) ? &sidecar : NULL;
+
+        if (!options.contactSheet.empty ()) {
+                return (make_contact_sheet (options, frames, index)) ? 0 : 1;
+        }
+
+        std::vector <TimeRange> ranges = select_ranges (options, frames);
+
+        if ((options.highlights || options.timelapse) && ranges.empty ()) {
+                return 1;
+        }
 
 #if 0
         std::cerr << frames << std::endl;
 #endif
 
-        GMainLoop *loop;
-        GstElement *pipeline;
-        GstBus *bus;
-        CairoOverlayState *overlay_state;
+        GMainLoop *loop = g_main_loop_new (NULL, FALSE);
+        YamahaAssets assets;
+        std::vector <Render *> renders;
 
-        gst_init (&argc, &argv);
-        loop = g_main_loop_new (NULL, FALSE);
+        if (options.remux) {
+                Render *render = new Render (&frames, &assets, 0);
+                render->pipeline = createRemuxPipeline (options.input, options.output, frames);
+                renders.push_back (render);
+        }
+        else if (options.chunks > 1) {
+                renders = setup_chunks (options, &frames, index, &assets, ranges);
+        }
+        else {
+                Render *render = new Render (&frames, &assets, options.renditions.size (), index);
+                render->pipeline = setup_gst_pipeline (render->branches, &render->telemetry, options, ranges);
+                renders.push_back (render);
+        }
 
-        /* allocate on heap for pedagogical reasons, makes code easier to transfer */
-        overlay_state = g_new0 (CairoOverlayState, 1);
+        std::vector <GstElement *> pipelines;
 
-        pipeline = setup_gst_pipeline (overlay_state);
+        for (Render *render : renders) {
+                if (render->pipeline) {
+                        pipelines.push_back (render->pipeline);
+                }
+        }
 
-        bus = gst_pipeline_get_bus (GST_PIPELINE (pipeline));
-        gst_bus_add_signal_watch (bus);
-        g_signal_connect (G_OBJECT (bus), "message", G_CALLBACK (on_message), loop);
-        gst_object_unref (GST_OBJECT (bus));
+        if (pipelines.empty () || pipelines.size () < renders.size ()) {
+                return 1;
+        }
 
-        gst_element_set_state (pipeline, GST_STATE_PLAYING);
-        g_main_loop_run (loop);
+        // With chunks, the first one is instrumented.
+        if (!options.remux && (options.statsInterval > 0 || !options.statsDump.empty ())) {
+                renders.front ()->stats = setup_stats (renders.front ()->pipeline, options);
+        }
+
+        gint64 startUs = g_get_monotonic_time ();
+        bool ok = run_pipelines (pipelines, loop);
+
+        if (ok && options.chunks > 1) {
+                ok = stitch_chunks (options, renders.size (), loop);
+        }
 
-        gst_element_set_state (pipeline, GST_STATE_NULL);
-        gst_object_unref (pipeline);
+        if (!options.remux) {
+                // All the branches are fed the same frames, the first one is representative.
+                CairoOverlayState total = CairoOverlayState ();
+
+                for (Render *render : renders) {
+                        total.frames += render->branches.front ()->state.frames;
+                        total.mediaTime += render->branches.front ()->state.mediaTime;
+                }
+
+                print_realtime_factor (&total, options, g_get_monotonic_time () - startUs);
+        }
+
+        if (renders.front ()->stats && options.statsInterval > 0) {
+                renders.front ()->stats->printHistograms (std::cerr);
+        }
+
+        for (Render *render : renders) {
+                delete render;
+        }
 
-        g_free (overlay_state);
-        return 0;
+        g_main_loop_unref (loop);
+        return (ok) ? 0 : 1;
 }
@@ -0,0 +1,166 @@
+/****************************************************************************
+ *                                                                          *
+ *  Author : lukasz.iwaszkiewicz@gmail.com                                  *
+ *  ~~~~~~~~                                                                *
+ *  License : see COPYING file for details.                                 *
+ *  ~~~~~~~~~                                                               *
+ ****************************************************************************/
+
+
+/*
+ * Latency of the telemetry bus from publish to observe, across processes.
+ *
+ * bus-bench [DASHBOARDS] [FRAMES] [PERIOD_US] [POLL_US]
+ *      The parent publishes FRAMES frames every PERIOD_US, stamped just before publish.
+ *      DASHBOARDS child processes poll latest () every POLL_US (0 : spin, yielding), and
+ *      one more child logs every frame with read () every 100 ms, as a logger would.
+ *      Each prints its latency distribution, the parent the cost of publish itself.
+ */
+
+#include <sched.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "../src/Histogram.h"
+#include "../src/Realtime.h"
+#include "../src/TelemetryBus.h"
+
+static TelemetryBusReader *attach (std::string const &name)
+{
+        TelemetryBusReader *reader = new TelemetryBusReader;
+
+        while (!reader->attach (name)) {
+                usleep (1000);
+        }
+
+        return reader;
+}
+
+/// Sees frames through latest () : one sample per new frame seen, some are skipped when polling slowly.
+static void dashboard (std::string const &name, int id, int frames, int pollUs)
+{
+        TelemetryBusReader *reader = attach (name);
+        Histogram latency;
+        uint32_t last = UINT32_MAX;
+        int seen = 0;
+        Frame frame;
+        uint32_t sequence;
+
+        while (true) {
+                if (reader->latest (&frame, &sequence) && sequence != last) {
+                        latency.add ((monotonicNs () - frame.timestamp) / 1000);
+                        last = sequence;
+                        ++seen;
+
+                        if (int (sequence) == frames - 1) {
+                                break;
+                        }
+                }
+
+                if (pollUs) {
+                        usleep (pollUs);
+                }
+                else {
+                        sched_yield ();
+                }
+        }
+
+        char title[64];
+        snprintf (title, sizeof (title), "dashboard %d (%d of %d frames seen)", id, seen, frames);
+        latency.printSummary (std::cout, title, "us");
+        delete reader;
+}
+
+/// Every frame through read (), in batches.
+static void logger (std::string const &name, int frames)
+{
+        TelemetryBusReader *reader = attach (name);
+        Histogram latency;
+        std::vector <Frame> batch (256);
+        int seen = 0;
+
+        while (seen + int (reader->lost ()) < frames) {
+                usleep (100000);
+                uint64_t now = monotonicNs ();
+                size_t n;
+
+                while ((n = reader->read (&batch[0], batch.size ())) > 0) {
+                        for (size_t i = 0; i < n; ++i) {
+                                latency.add ((now - batch[i].timestamp) / 1000);
+                        }
+
+                        seen += n;
+                }
+        }
+
+        char title[64];
+        snprintf (title, sizeof (title), "logger (%d frames, %llu lost)", seen, (unsigned long long)reader->lost ());
+        latency.printSummary (std::cout, title, "us");
+        delete reader;
+}
+
+int main (int argc, char **argv)
+{
+        int dashboards = (argc > 1) ? atoi (argv[1]) : 2;
+        int frames = (argc > 2) ? atoi (argv[2]) : 2000;
+        int periodUs = (argc > 3) ? atoi (argv[3]) : 1000;
+        int pollUs = (argc > 4) ? atoi (argv[4]) : 0;
+        std::string name = "/motoblackbox-bench-" + std::to_string (getpid ());
+
+        if (frames < 1 || periodUs < 1) {
+                fprintf (stderr, "Usage : %s [DASHBOARDS] [FRAMES] [PERIOD_US] [POLL_US]\n", argv[0]);
+                return 1;
+        }
+
+        TelemetryBus bus (name);
+
+        if (!bus.open ()) {
+                return 1;
+        }
+
+        std::cout.flush ();
+        std::vector <pid_t> children;
+
+        for (int i = 0; i <= dashboards; ++i) {
+                pid_t pid = fork ();
+
+                if (pid == 0) {
+                        if (i < dashboards) {
+                                dashboard (name, i, frames, pollUs);
+                        }
+                        else {
+                                logger (name, frames);
+                        }
+
+                        std::cout.flush ();
+                        _exit (0);
+                }
+
+                children.push_back (pid);
+        }
+
+        // Let the readers attach.
+        usleep (200000);
+        Histogram publishNs;
+        uint64_t first = monotonicNs ();
+        Frame frame;
+
+        for (int i = 0; i < frames; ++i) {
+                sleepUntil (first + uint64_t (i) * periodUs * 1000ULL);
+                frame.velocity = i;
+                frame.timestamp = monotonicNs ();
+                bus.publish (frame);
+                publishNs.add (monotonicNs () - frame.timestamp);
+        }
+
+        for (pid_t pid : children) {
+                waitpid (pid, NULL, 0);
+        }
+
+        publishNs.printSummary (std::cout, "publish", "ns");
+        return 0;
+}
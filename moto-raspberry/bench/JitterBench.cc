@@ -0,0 +1,132 @@
+/****************************************************************************
+ *                                                                          *
+ *  Author : lukasz.iwaszkiewicz@gmail.com                                  *
+ *  ~~~~~~~~                                                                *
+ *  License : see COPYING file for details.                                 *
+ *  ~~~~~~~~~                                                               *
+ ****************************************************************************/
+
+
+/*
+ * What --sched and --mlock buy a periodic thread, on any Linux box.
+ *
+ * jitter-bench [PERIOD_US] [SECONDS] [LOAD_THREADS] [PRIO[@CPU]] [--mlock]
+ *      A thread wakes every PERIOD_US (10000 : the shield's 100 Hz) and touches a 1 MiB
+ *      buffer of its own, as the recorder's threads do, while LOAD_THREADS threads (one per
+ *      CPU by default) spin and churn memory, faulting pages in and giving them back. With
+ *      PRIO the periodic thread runs SCHED_FIFO (see Realtime.h). Prints its wake-up jitter
+ *      and period error. Run it without, then with PRIO and --mlock, as root.
+ */
+
+#include <unistd.h>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "../src/Histogram.h"
+#include "../src/Realtime.h"
+
+static std::atomic <bool> running (true);
+
+static void load (int id)
+{
+        const size_t CHUNK = 4 << 20;
+        ThreadPolicy policy;
+        applyThreadPolicy (policy, ("load " + std::to_string (id)).c_str ());
+
+        while (running) {
+                // Fresh pages each time : the allocator gives them back to the kernel above its mmap threshold.
+                char *p = static_cast <char *> (malloc (CHUNK));
+
+                for (size_t i = 0; i < CHUNK && running; i += 4096) {
+                        p[i] = char (i);
+                }
+
+                free (p);
+        }
+}
+
+int main (int argc, char **argv)
+{
+        int periodUs = 10000;
+        int seconds = 10;
+        int loadThreads = int (sysconf (_SC_NPROCESSORS_ONLN));
+        ThreadPolicy policy;
+        bool lock = false;
+        int position = 0;
+
+        for (int i = 1; i < argc; ++i) {
+                std::string arg = argv[i];
+
+                if (arg == "--mlock") {
+                        lock = true;
+                }
+                else if (position == 0) {
+                        periodUs = atoi (argv[i]), ++position;
+                }
+                else if (position == 1) {
+                        seconds = atoi (argv[i]), ++position;
+                }
+                else if (position == 2) {
+                        loadThreads = atoi (argv[i]), ++position;
+                }
+                else if (position == 3 && parseThreadPolicy (argv[i], &policy)) {
+                        ++position;
+                }
+                else {
+                        position = -1;
+                        break;
+                }
+        }
+
+        if (position < 0 || periodUs < 1 || seconds < 1) {
+                fprintf (stderr, "Usage : %s [PERIOD_US] [SECONDS] [LOAD_THREADS] [PRIO[@CPU]] [--mlock]\n", argv[0]);
+                return 1;
+        }
+
+        if (lock && !lockMemory ()) {
+                return 1;
+        }
+
+        std::vector <std::thread> loads;
+
+        for (int i = 0; i < loadThreads; ++i) {
+                loads.emplace_back (load, i);
+        }
+
+        const uint64_t periodNs = uint64_t (periodUs) * 1000;
+        LoopStats stats (periodNs);
+
+        std::thread periodic ([&] {
+                applyThreadPolicy (policy, "periodic");
+                std::vector <char> buffer (1 << 20);
+                uint64_t next = monotonicNs ();
+                uint64_t end = next + uint64_t (seconds) * 1000000000ULL;
+
+                while (next < end) {
+                        next += periodNs;
+                        sleepUntil (next);
+                        uint64_t now = monotonicNs ();
+                        stats.woke (next, now);
+                        stats.iteration (now);
+                        memset (&buffer[0], int (next), buffer.size ());
+                }
+        });
+
+        periodic.join ();
+        running = false;
+
+        for (std::thread &t : loads) {
+                t.join ();
+        }
+
+        std::cout << "period " << periodUs << " us, " << loadThreads << " load threads, priority " << policy.priority << ", cpu " << policy.cpu
+                  << ((lock) ? ", memory locked" : "") << std::endl;
+        stats.printSummary (std::cout, "periodic");
+        stats.wakeup ().print (std::cout, "  ", "us");
+        return 0;
+}
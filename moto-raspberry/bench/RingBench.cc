@@ -0,0 +1,156 @@
+/****************************************************************************
+ *                                                                          *
+ *  Author : lukasz.iwaszkiewicz@gmail.com                                  *
+ *  ~~~~~~~~                                                                *
+ *  License : see COPYING file for details.                                 *
+ *  ~~~~~~~~~                                                               *
+ ****************************************************************************/
+
+
+/*
+ * The telemetry queue (SpscRing) under a synthetic shield thread and telemetry writer.
+ *
+ * ring-bench throughput [FRAMES]
+ *      Producer and consumer flat out : ns per frame through SpscRing and, for comparison,
+ *      through the boost::lockfree::spsc_queue it replaced.
+ *
+ * ring-bench stall [SECONDS] [PERIOD_US] [STALL_MS]
+ *      A frame every PERIOD_US, drained every 200 ms as TelemetryWriter does, with one
+ *      STALL_MS pause of the consumer (a slow card) per second. Prints the frames lost and
+ *      the queueing latency with the ring dropping the newest and overwriting the oldest.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <boost/lockfree/spsc_queue.hpp>
+#include "../src/Histogram.h"
+#include "../src/Realtime.h"
+#include "../src/Shield.h"
+#include "../src/SpscRing.h"
+
+typedef SpscRing <Frame, 1024> Ring;
+typedef boost::lockfree::spsc_queue <Frame, boost::lockfree::capacity <1024>> BoostQueue;
+
+/**
+ * Every frame pushed until it goes in, consumer checks the sequence. Returns ns per frame.
+ */
+template <typename Q> static double throughput (Q *queue, uint64_t frames)
+{
+        uint64_t start = monotonicNs ();
+
+        std::thread producer ([queue, frames] {
+                Frame frame;
+
+                for (uint64_t i = 0; i < frames; ++i) {
+                        frame.timestamp = i;
+
+                        while (!queue->push (frame)) {
+                                std::this_thread::yield ();
+                        }
+                }
+        });
+
+        Frame frame;
+        uint64_t expected = 0;
+
+        while (expected < frames) {
+                if (!queue->pop (frame)) {
+                        std::this_thread::yield ();
+                        continue;
+                }
+
+                if (frame.timestamp != expected) {
+                        std::cerr << "Out of order : " << frame.timestamp << " instead of " << expected << std::endl;
+                        exit (1);
+                }
+
+                ++expected;
+        }
+
+        producer.join ();
+        return double (monotonicNs () - start) / frames;
+}
+
+static int benchThroughput (uint64_t frames)
+{
+        static Ring ring;
+        static BoostQueue boost;
+
+        printf ("SpscRing (%zu bytes) : %.1f ns per frame\n", sizeof (Ring), throughput (&ring, frames));
+        printf ("boost spsc_queue : %.1f ns per frame\n", throughput (&boost, frames));
+        ring.counters ().printSummary (std::cout, "SpscRing");
+        return 0;
+}
+
+static void stall (Ring *ring, int seconds, int periodUs, int stallMs)
+{
+        uint64_t frames = uint64_t (seconds) * 1000000 / periodUs;
+        uint64_t first = monotonicNs () + 10000000ULL;
+
+        std::thread producer ([ring, frames, first, periodUs] {
+                Frame frame;
+
+                for (uint64_t i = 0; i < frames; ++i) {
+                        frame.timestamp = first + i * periodUs * 1000ULL;
+                        sleepUntil (frame.timestamp);
+                        ring->push (frame);
+                }
+        });
+
+        Histogram latency;
+        uint64_t end = first + frames * periodUs * 1000ULL + 400000000ULL;
+        uint64_t lastStall = first;
+        Frame frame;
+
+        for (uint64_t wake = first; wake < end; wake += 200000000ULL) {
+                sleepUntil (wake);
+
+                if (wake - lastStall >= 1000000000ULL) {
+                        sleepUntil (wake + stallMs * 1000000ULL);
+                        lastStall = wake;
+                }
+
+                uint64_t now = monotonicNs ();
+
+                while (ring->pop (frame)) {
+                        latency.add ((now - frame.timestamp) / 1000);
+                }
+        }
+
+        producer.join ();
+        RingCounters c = ring->counters ();
+        printf ("%llu of %llu frames lost, max depth %llu/%llu\n", (unsigned long long)c.overflows, (unsigned long long)frames,
+                (unsigned long long)c.maxDepth, (unsigned long long)c.capacity);
+        latency.printSummary (std::cout, "queueing latency", "us");
+}
+
+static int benchStall (int seconds, int periodUs, int stallMs)
+{
+        static Ring dropNewest (false);
+        static Ring overwriteOldest (true);
+
+        printf ("Drop newest : ");
+        stall (&dropNewest, seconds, periodUs, stallMs);
+        printf ("Overwrite oldest : ");
+        stall (&overwriteOldest, seconds, periodUs, stallMs);
+        return 0;
+}
+
+int main (int argc, char **argv)
+{
+        std::string mode = (argc > 1) ? argv[1] : "throughput";
+
+        if (mode == "throughput") {
+                return benchThroughput ((argc > 2) ? strtoull (argv[2], NULL, 10) : 10000000);
+        }
+
+        if (mode == "stall") {
+                return benchStall ((argc > 2) ? atoi (argv[2]) : 5, (argc > 3) ? atoi (argv[3]) : 1000, (argc > 4) ? atoi (argv[4]) : 1500);
+        }
+
+        fprintf (stderr, "Usage : %s throughput [FRAMES] | stall [SECONDS] [PERIOD_US] [STALL_MS]\n", argv[0]);
+        return 1;
+}
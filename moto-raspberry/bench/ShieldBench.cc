@@ -0,0 +1,182 @@
+/****************************************************************************
+ *                                                                          *
+ *  Author : lukasz.iwaszkiewicz@gmail.com                                  *
+ *  ~~~~~~~~                                                                *
+ *  License : see COPYING file for details.                                 *
+ *  ~~~~~~~~~                                                               *
+ ****************************************************************************/
+
+
+/*
+ * Feeds Shield through a pseudo terminal, runs on any Linux box, no shield needed.
+ *
+ * shield-bench cpu [FRAMES] [NOISE_PERCENT]
+ *      CPU time the reading thread spends per decoded frame.
+ *
+ * shield-bench jitter [FRAMES] [PERIOD_MS]
+ *      Bytes are written at the pace of a 38400 baud UART, and frame timestamps are
+ *      compared with the moments the frames really started.
+ */
+
+#include <pty.h>
+#include <time.h>
+#include <unistd.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <thread>
+#include <vector>
+#include "../src/Histogram.h"
+#include "../src/Realtime.h"
+#include "../src/Shield.h"
+
+/// CPU time of the calling thread, wall time comes from monotonicNs.
+static uint64_t threadCpuNs ()
+{
+        timespec ts;
+        clock_gettime (CLOCK_THREAD_CPUTIME_ID, &ts);
+        return uint64_t (ts.tv_sec) * 1000000000ULL + ts.tv_nsec;
+}
+
+/**
+ * frames valid shield frames, with noise percent of random garbage bytes between them.
+ */
+static std::vector <uint8_t> makeStream (int frames, int noise)
+{
+        std::vector <uint8_t> stream;
+        srand (1);
+
+        for (int i = 0; i < frames; ++i) {
+                while (rand () % 100 < noise) {
+                        stream.push_back (rand () % 256);
+                }
+
+                uint8_t data[] = { uint8_t (i >> 8), uint8_t (i), uint8_t (i % 200), 150, uint8_t (i % 32), 20 };
+                uint8_t sum = 0;
+                stream.push_back (0x01);
+
+                for (uint8_t b : data) {
+                        stream.push_back (b);
+                        sum += b;
+                }
+
+                stream.push_back (sum);
+        }
+
+        return stream;
+}
+
+static int benchCpu (Shield &shield, int master, int frames, int noise)
+{
+        std::vector <uint8_t> stream = makeStream (frames, noise);
+
+        // The shield sends one frame at a time, so does the writer.
+        std::thread writer ([&stream, master] {
+                for (size_t i = 0; i < stream.size ();) {
+                        ssize_t n = write (master, &stream[i], std::min <size_t> (8, stream.size () - i));
+
+                        if (n > 0) {
+                                i += n;
+                        }
+                }
+        });
+
+        uint64_t wallStart = monotonicNs ();
+        uint64_t cpuStart = threadCpuNs ();
+        int decoded = 0;
+        Frame frame;
+
+        // Garbage may hide a frame or two (a false start byte swallowing the real one), so stop short.
+        while (decoded < frames * 99 / 100 && shield.read (&frame)) {
+                ++decoded;
+        }
+
+        uint64_t cpu = threadCpuNs () - cpuStart;
+        uint64_t wall = monotonicNs () - wallStart;
+
+        printf ("%d frames (%d%% noise) : %.0f ns CPU per frame, %.1f%% of the wall time\n",
+                decoded, noise, double (cpu) / decoded, 100.0 * cpu / wall);
+
+        writer.detach ();
+        return 0;
+}
+
+static int benchJitter (Shield &shield, int master, int frames, int periodMs)
+{
+        const uint64_t BYTE_TIME = 10 * 1000000000ULL / 38400;
+        const size_t FRAME_SIZE = 8;
+        std::vector <uint8_t> stream = makeStream (frames, 0);
+        std::vector <uint64_t> starts (frames);
+        uint64_t first = monotonicNs () + 100000000ULL;
+
+        for (int i = 0; i < frames; ++i) {
+                starts[i] = first + uint64_t (i) * periodMs * 1000000ULL;
+        }
+
+        // Byte j of a frame is in the tty once it has been received, i.e. (j + 1) byte times after the frame started.
+        std::thread writer ([&stream, &starts, master, BYTE_TIME, FRAME_SIZE] {
+                for (size_t i = 0; i < stream.size (); ++i) {
+                        sleepUntil (starts[i / FRAME_SIZE] + (i % FRAME_SIZE + 1) * BYTE_TIME);
+                        while (write (master, &stream[i], 1) != 1) {
+                        }
+                }
+        });
+
+        std::vector <double> errors;
+
+        Frame frame;
+
+        for (int i = 0; i < frames && shield.read (&frame); ++i) {
+                errors.push_back (double (int64_t (frame.timestamp - starts[i])) / 1000.0);
+        }
+
+        writer.join ();
+
+        double mean = 0, variance = 0;
+
+        for (double e : errors) {
+                mean += e / errors.size ();
+        }
+
+        for (double e : errors) {
+                variance += (e - mean) * (e - mean) / errors.size ();
+        }
+
+        std::sort (errors.begin (), errors.end ());
+        printf ("%d frames every %d ms : timestamp error mean %.1f us, stddev %.1f us, min %.1f us, p99 %.1f us, max %.1f us\n",
+                frames, periodMs, mean, std::sqrt (variance), errors.front (), errors[errors.size () * 99 / 100], errors.back ());
+        return 0;
+}
+
+int main (int argc, char **argv)
+{
+        std::string mode = (argc > 1) ? argv[1] : "cpu";
+        int master, slave;
+        char name[64];
+
+        if (mode != "cpu" && mode != "jitter") {
+                fprintf (stderr, "Usage : %s cpu [FRAMES] [NOISE_PERCENT] | jitter [FRAMES] [PERIOD_MS]\n", argv[0]);
+                return 1;
+        }
+
+        if (openpty (&master, &slave, name, NULL, NULL) < 0) {
+                perror ("openpty");
+                return 1;
+        }
+
+        Shield shield (name);
+        int ret;
+
+        if (mode == "cpu") {
+                ret = benchCpu (shield, master, (argc > 2) ? atoi (argv[2]) : 100000, (argc > 3) ? atoi (argv[3]) : 5);
+        }
+        else {
+                ret = benchJitter (shield, master, (argc > 2) ? atoi (argv[2]) : 500, (argc > 3) ? atoi (argv[3]) : 10);
+        }
+
+        close (slave);
+        return ret;
+}
@@ -0,0 +1,170 @@
+/****************************************************************************
+ *                                                                          *
+ *  Author : lukasz.iwaszkiewicz@gmail.com                                  *
+ *  ~~~~~~~~                                                                *
+ *  License : see COPYING file for details.                                 *
+ *  ~~~~~~~~~                                                               *
+ ****************************************************************************/
+
+
+/*
+ * Writes segments the way the recorder does, once with plain appends and once preallocated,
+ * and prints the write latency percentiles and the fragments per segment of both.
+ *
+ * storage-bench DIR [SEGMENTS] [MBIT_S] [SEGMENT_MS]
+ *      Segments are written in 256 KiB writes paced at MBIT_S (0 : flat out), with a
+ *      telemetry row appended to NNNNN.csv every 10 ms in between, as on the Pi.
+ *
+ * Run it on a filesystem image so the card's layout doesn't decide the result :
+ *
+ *      truncate -s 2G sd.img && mkfs.vfat sd.img      # or mkfs.ext4
+ *      sudo mount -o loop sd.img /mnt/sd
+ *      storage-bench /mnt/sd 100 17
+ */
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/fiemap.h>
+#include <linux/fs.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "../src/Histogram.h"
+#include "../src/Realtime.h"
+#include "../src/SegmentStorage.h"
+
+static const size_t WRITE_SIZE = 256 << 10;
+
+/// Physically contiguous runs the file is made of, -1 if the filesystem can't tell (FIEMAP).
+static int fragments (std::string const &path)
+{
+        const int MAX_EXTENTS = 512;
+        int fd = open (path.c_str (), O_RDONLY);
+
+        if (fd < 0) {
+                return -1;
+        }
+
+        std::vector <uint8_t> buffer (sizeof (fiemap) + MAX_EXTENTS * sizeof (fiemap_extent));
+        fiemap *map = reinterpret_cast <fiemap *> (&buffer[0]);
+        map->fm_length = FIEMAP_MAX_OFFSET;
+        map->fm_flags = FIEMAP_FLAG_SYNC;
+        map->fm_extent_count = MAX_EXTENTS;
+        int ret = -1;
+
+        if (ioctl (fd, FS_IOC_FIEMAP, map) == 0) {
+                ret = 0;
+
+                // Extents split only by their state (unwritten -> written) still lie back to back.
+                for (unsigned int i = 0; i < map->fm_mapped_extents; ++i) {
+                        fiemap_extent const &e = map->fm_extents[i];
+
+                        if (i == 0 || e.fe_physical != map->fm_extents[i - 1].fe_physical + map->fm_extents[i - 1].fe_length) {
+                                ++ret;
+                        }
+                }
+        }
+
+        close (fd);
+        return ret;
+}
+
+static void run (std::string const &dir, bool preallocate, int segments, int mbits, int segmentMs)
+{
+        uint64_t segmentSize = uint64_t (mbits ? mbits : 17) * 1000000 / 8 * segmentMs / 1000;
+        SegmentStorage storage (dir, preallocate ? SegmentStorage::expectedSize ((mbits ? mbits : 17) * 1000000, segmentMs) : 0);
+        std::vector <uint8_t> data (WRITE_SIZE, 0x55);
+        Histogram writeUs, rotationUs;
+        uint64_t writePeriod = (mbits) ? WRITE_SIZE * 8 * 1000 / mbits : 0;
+        uint64_t next = monotonicNs ();
+        char const row[] = "12345678,50,150,20,3,1,20\n";
+        int rowsPerWrite = (mbits) ? int (writePeriod / 10000000ULL) : 1;
+
+        for (int s = 0; s < segments; ++s) {
+                uint64_t begin = monotonicNs ();
+                storage.open (s);
+                rotationUs.add ((monotonicNs () - begin) / 1000);
+
+                char csv[64];
+                snprintf (csv, sizeof (csv), "%s/%05d.csv", dir.c_str (), s);
+                FILE *telemetry = fopen (csv, "w");
+
+                for (uint64_t w = 0; w < segmentSize; w += WRITE_SIZE) {
+                        iovec part = { &data[0], size_t (std::min <uint64_t> (WRITE_SIZE, segmentSize - w)) };
+                        begin = monotonicNs ();
+
+                        if (storage.write (&part, 1) != ssize_t (part.iov_len)) {
+                                perror ("write");
+                                return;
+                        }
+
+                        writeUs.add ((monotonicNs () - begin) / 1000);
+
+                        for (int r = 0; telemetry && r < std::max (rowsPerWrite, 1); ++r) {
+                                fputs (row, telemetry);
+                        }
+
+                        if (telemetry) {
+                                fflush (telemetry);
+                        }
+
+                        if (writePeriod) {
+                                next += writePeriod;
+                                sleepUntil (next);
+                        }
+                }
+
+                if (telemetry) {
+                        fclose (telemetry);
+                }
+        }
+
+        storage.close ();
+
+        double fragmentsSum = 0;
+        int fragmentsMax = 0;
+
+        for (int s = 0; s < segments; ++s) {
+                char path[64];
+                snprintf (path, sizeof (path), "%s/%05d.h264", dir.c_str (), s);
+                int f = fragments (path);
+                fragmentsSum += f;
+                fragmentsMax = std::max (fragmentsMax, f);
+        }
+
+        std::cout << ((preallocate) ? "preallocated" : "appended") << ", " << segments << " segments of " << segmentSize / 1024
+                  << " KiB, fragments per segment : mean " << fragmentsSum / segments << ", max " << fragmentsMax << std::endl;
+        writeUs.printSummary (std::cout, "  write", "us");
+        writeUs.print (std::cout, "    ", "us");
+        rotationUs.printSummary (std::cout, "  open", "us");
+
+        for (int s = 0; s < segments; ++s) {
+                char path[64];
+                snprintf (path, sizeof (path), "%s/%05d.h264", dir.c_str (), s);
+                unlink (path);
+                snprintf (path, sizeof (path), "%s/%05d.csv", dir.c_str (), s);
+                unlink (path);
+        }
+}
+
+int main (int argc, char **argv)
+{
+        if (argc < 2) {
+                fprintf (stderr, "Usage : %s DIR [SEGMENTS] [MBIT_S] [SEGMENT_MS]\n", argv[0]);
+                return 1;
+        }
+
+        std::string dir = argv[1];
+        int segments = (argc > 2) ? atoi (argv[2]) : 50;
+        int mbits = (argc > 3) ? atoi (argv[3]) : 0;
+        int segmentMs = (argc > 4) ? atoi (argv[4]) : 3000;
+
+        run (dir, false, segments, mbits, segmentMs);
+        run (dir, true, segments, mbits, segmentMs);
+        return 0;
+}
@@ -0,0 +1,75 @@
+/****************************************************************************
+ *                                                                          *
+ *  Author : lukasz.iwaszkiewicz@gmail.com                                  *
+ *  ~~~~~~~~                                                                *
+ *  License : see COPYING file for details.                                 *
+ *  ~~~~~~~~~                                                               *
+ ****************************************************************************/
+
+
+#ifndef CAPTURESOURCE_H_
+#define CAPTURESOURCE_H_
+
+#include <cstddef>
+#include <cstdint>
+
+const uint32_t CAPTURE_CONFIG = 1 << 0;         /// SPS/PPS, in a buffer of their own.
+const uint32_t CAPTURE_KEYFRAME = 1 << 1;       /// Part of an IDR frame.
+const uint32_t CAPTURE_FRAME_END = 1 << 2;      /// Last buffer of a frame.
+
+/**
+ * What the encoder is asked for. Replay takes only the frame rate, the rest is in the files.
+ */
+struct CaptureSettings {
+        unsigned int width;
+        unsigned int height;
+        int bitrate;                    /// [bit/s]
+        int framerate;                  /// [fps]
+        unsigned int intraperiod;       /// Frames between IDRs, 0 : the encoder's default.
+};
+
+/**
+ * One buffer of H.264 encoder output, as the encoder port hands it out : a frame may take
+ * several buffers. Valid only during the CaptureSink::encoded call.
+ */
+struct EncodedBuffer {
+        uint8_t const *data;
+        uint32_t length;
+        uint32_t flags;
+        int64_t pts;                    /// [us], INT64_MIN if unknown.
+};
+
+/**
+ * Receives the encoder output, from the capture source's own thread.
+ */
+class CaptureSink {
+public:
+        virtual ~CaptureSink () {}
+        virtual void encoded (EncodedBuffer const &buffer) = 0;
+
+        /// True if a frame of length bytes would be taken without dropping anything. The camera doesn't wait for it, a replay at full speed does.
+        virtual bool ready (size_t /*length*/) const { return true; }
+};
+
+/**
+ * Where the encoded video comes from : the camera and the encoder (MmalCapture, Pi only),
+ * or .h264 files (ReplayCapture) on any Linux box.
+ */
+class CaptureSource {
+public:
+        virtual ~CaptureSource () {}
+
+        /// Starts delivering buffers to sink. False if the source could not be set up.
+        virtual bool start (CaptureSink *sink) = 0;
+
+        /// No buffer is delivered after it returns.
+        virtual void stop () = 0;
+
+        /// Asks for an IDR as soon as possible. Not from the sink, the encoder callback can't set parameters.
+        virtual void requestKeyframe () = 0;
+
+        /// True when there is nothing more to deliver (the end of a replay).
+        virtual bool finished () const { return false; }
+};
+
+#endif /* CAPTURESOURCE_H_ */
@@ -0,0 +1,62 @@
+/****************************************************************************
+ *                                                                          *
+ *  Author : lukasz.iwaszkiewicz@gmail.com                                  *
+ *  ~~~~~~~~                                                                *
+ *  License : see COPYING file for details.                                 *
+ *  ~~~~~~~~~                                                               *
+ ****************************************************************************/
+
+
+#include "EventDetector.h"
+
+const char *eventName (EventType type)
+{
+        switch (type) {
+        case EVENT_HARD_BRAKING:
+                return "hard braking";
+
+        case EVENT_BUTTON:
+                return "button";
+
+        default:
+                return "none";
+        }
+}
+
+EventDetector::EventDetector (float brakingThreshold, int windowMs, int holdoffMs) :
+        brakingThreshold (brakingThreshold), windowNs (uint64_t (windowMs) * 1000000ULL), holdoffNs (uint64_t (holdoffMs) * 1000000ULL)
+{
+}
+
+EventType EventDetector::feed (Frame const &frame)
+{
+        EventType type = EVENT_NONE;
+
+        if (frame.eventButton && !buttonWasDown) {
+                type = EVENT_BUTTON;
+        }
+
+        buttonWasDown = frame.eventButton;
+
+        // Keep one sample at least windowNs old, the deceleration is measured against it.
+        history.push_back (Sample { frame.timestamp, frame.velocity });
+
+        while (history.size () > 2 && frame.timestamp - history[1].timestamp >= windowNs) {
+                history.pop_front ();
+        }
+
+        Sample const &old = history.front ();
+        uint64_t dt = frame.timestamp - old.timestamp;
+
+        if (type == EVENT_NONE && dt >= windowNs && (old.velocity - frame.velocity) * 1e9 / dt >= brakingThreshold) {
+                type = EVENT_HARD_BRAKING;
+        }
+
+        if (type == EVENT_NONE || (hadEvent && frame.timestamp - lastEventNs < holdoffNs)) {
+                return EVENT_NONE;
+        }
+
+        hadEvent = true;
+        lastEventNs = frame.timestamp;
+        return type;
+}
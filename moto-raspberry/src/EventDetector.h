@@ -0,0 +1,58 @@
+/****************************************************************************
+ *                                                                          *
+ *  Author : lukasz.iwaszkiewicz@gmail.com                                  *
+ *  ~~~~~~~~                                                                *
+ *  License : see COPYING file for details.                                 *
+ *  ~~~~~~~~~                                                               *
+ ****************************************************************************/
+
+
+#ifndef EVENTDETECTOR_H_
+#define EVENTDETECTOR_H_
+
+#include <cstdint>
+#include <deque>
+#include "Shield.h"
+
+/**
+ * Things worth keeping the video of.
+ */
+enum EventType {
+        EVENT_NONE,
+        EVENT_HARD_BRAKING,     /// Deceleration over the threshold.
+        EVENT_BUTTON            /// Shield's event button pressed.
+};
+
+extern const char *eventName (EventType type);
+
+/**
+ * Spots events in the shield frames : hard braking (the speed falling faster than
+ * brakingThreshold km/h per second, averaged over windowMs) and the event button being
+ * pressed. After an event, new ones are ignored for holdoffMs.
+ */
+class EventDetector {
+public:
+
+        EventDetector (float brakingThreshold = 25, int windowMs = 500, int holdoffMs = 5000);
+
+        /// Frames in the order they came in.
+        EventType feed (Frame const &frame);
+
+private:
+
+        struct Sample {
+                uint64_t timestamp;
+                float velocity;
+        };
+
+        float brakingThreshold;
+        uint64_t windowNs;
+        uint64_t holdoffNs;
+
+        std::deque <Sample> history;
+        bool buttonWasDown = false;
+        uint64_t lastEventNs = 0;
+        bool hadEvent = false;
+};
+
+#endif /* EVENTDETECTOR_H_ */
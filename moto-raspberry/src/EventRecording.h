@@ -0,0 +1,55 @@
+/****************************************************************************
+ *                                                                          *
+ *  Author : lukasz.iwaszkiewicz@gmail.com                                  *
+ *  ~~~~~~~~                                                                *
+ *  License : see COPYING file for details.                                 *
+ *  ~~~~~~~~~                                                               *
+ ****************************************************************************/
+
+
+#ifndef EVENTRECORDING_H_
+#define EVENTRECORDING_H_
+
+#include <atomic>
+#include <cstdint>
+
+/**
+ * Event only recording : SegmentWriter and TelemetryWriter hold the last preEventMs of
+ * video and telemetry in RAM, and nothing goes to the card until an event. Then what they
+ * hold is written out, and recording goes on live until postEventMs after the last event.
+ *
+ * Whether a segment is recorded live is decided by its start time (recording (startNs)),
+ * so both writers split the same way. Shared by the writer threads, all lock free.
+ */
+class EventRecording {
+public:
+
+        EventRecording (int preEventMs, int postEventMs) :
+                preNs (uint64_t (preEventMs) * 1000000ULL), postNs (uint64_t (postEventMs) * 1000000ULL), recordUntil (0), oldest (-1) {}
+
+        /// An event happened at nowNs (CLOCK_MONOTONIC).
+        void trigger (uint64_t nowNs)
+        {
+                uint64_t until = nowNs + postNs;
+                uint64_t current = recordUntil.load ();
+
+                while (current < until && !recordUntil.compare_exchange_weak (current, until)) {
+                }
+        }
+
+        bool recording (uint64_t nowNs) const { return nowNs < recordUntil.load (); }
+        uint64_t preEventNs () const { return preNs; }
+
+        /// Oldest segment the video ring holds, telemetry of older ones isn't needed anymore.
+        void setOldestHeld (int segment) { oldest = segment; }
+        int oldestHeld () const { return oldest; }
+
+private:
+
+        uint64_t preNs;
+        uint64_t postNs;
+        std::atomic <uint64_t> recordUntil;
+        std::atomic <int> oldest;
+};
+
+#endif /* EVENTRECORDING_H_ */
@@ -0,0 +1,64 @@
+/****************************************************************************
+ *                                                                          *
+ *  Author : lukasz.iwaszkiewicz@gmail.com                                  *
+ *  ~~~~~~~~                                                                *
+ *  License : see COPYING file for details.                                 *
+ *  ~~~~~~~~~                                                               *
+ ****************************************************************************/
+
+
+#include "FrameIndex.h"
+
+bool FrameIndexer::add (int newSegment, uint32_t length, bool config, bool keyframe, bool frameEnd, int64_t pts, uint64_t nowNs,
+                        EncodedFrame *frame)
+{
+        if (newSegment >= 0) {
+                segment = newSegment;
+                bytes = 0;
+                inFrame = false;
+                damaged = false;
+        }
+
+        // Before the first segment : nowhere to point to.
+        if (segment < 0) {
+                return false;
+        }
+
+        if (!inFrame) {
+                current.segment = segment;
+                current.captureNs = 0;
+                current.damaged = false;
+                current.entry = FrameIndexEntry { INT64_MIN, 0, bytes, FRAME_INDEX_NO_TELEMETRY, 0 };
+                inFrame = true;
+        }
+
+        if (pts != INT64_MIN && current.entry.pts == INT64_MIN) {
+                int64_t offset = int64_t (nowNs) - pts * 1000;
+
+                if (!synced || offset < clockOffsetNs) {
+                        clockOffsetNs = offset;
+                        synced = true;
+                }
+
+                current.entry.pts = pts;
+                current.captureNs = pts * 1000 + clockOffsetNs;
+        }
+
+        current.entry.flags |= (config) ? FRAME_INDEX_CONFIG : 0;
+        current.entry.flags |= (keyframe) ? FRAME_INDEX_KEYFRAME : 0;
+        bytes += length;
+
+        // SPS/PPS belong to the frame after them.
+        if (!frameEnd || config) {
+                return false;
+        }
+
+        if (!current.captureNs) {
+                current.captureNs = nowNs;
+        }
+
+        *frame = current;
+        frame->damaged = damaged;
+        inFrame = false;
+        return true;
+}
@@ -0,0 +1,85 @@
+/****************************************************************************
+ *                                                                          *
+ *  Author : lukasz.iwaszkiewicz@gmail.com                                  *
+ *  ~~~~~~~~                                                                *
+ *  License : see COPYING file for details.                                 *
+ *  ~~~~~~~~~                                                               *
+ ****************************************************************************/
+
+
+#ifndef FRAMEINDEX_H_
+#define FRAMEINDEX_H_
+
+#include <cstdint>
+
+/*
+ * NNNNN.frames, the per frame sidecar of NNNNN.h264 : a FrameIndexHeader, then one
+ * FrameIndexEntry per encoded frame, little endian. moto-overlay reads it (FrameIndex.h
+ * there), keep both in sync.
+ */
+
+const uint16_t FRAME_INDEX_VERSION = 1;
+const uint32_t FRAME_INDEX_KEYFRAME = 1 << 0;           /// IDR.
+const uint32_t FRAME_INDEX_CONFIG = 1 << 1;             /// Starts with SPS/PPS.
+const uint32_t FRAME_INDEX_NO_TELEMETRY = UINT32_MAX;
+
+struct FrameIndexHeader {
+        char magic[4];                  /// "MBFI"
+        uint16_t version;
+        uint16_t entrySize;
+        uint32_t count;
+        uint32_t reserved;
+};
+
+struct FrameIndexEntry {
+        int64_t pts;                    /// Encoder PTS [us], INT64_MIN if it had none.
+        uint32_t timeUs;                /// Capture time since the segment start [us], the clock of the CSV timestamps.
+        uint32_t offset;                /// Of the frame (its SPS/PPS included) in NNNNN.h264.
+        uint32_t telemetry;             /// Row of NNNNN.csv nearest to timeUs.
+        uint32_t flags;
+};
+
+static_assert (sizeof (FrameIndexHeader) == 16 && sizeof (FrameIndexEntry) == 24, "FrameIndex layout");
+
+/**
+ * Frame seen by the encoder callback, telemetry and timeUs are filled in by TelemetryWriter.
+ */
+struct EncodedFrame {
+        int segment;
+        uint64_t captureNs;             /// CLOCK_MONOTONIC, estimated from the PTS.
+        bool damaged;                   /// Buffers (or frames) of its segment were lost before it : the sidecar wouldn't match the .h264.
+        FrameIndexEntry entry;
+};
+
+/**
+ * Encoder callback side : turns encoder buffers (a frame may take several, and SPS/PPS come
+ * in a buffer of their own) into EncodedFrames. No allocation, no I/O.
+ *
+ * The PTS runs on the camera's clock. It is mapped to CLOCK_MONOTONIC with the smallest
+ * (callback time - PTS) seen, i.e. assuming the fastest frame through the encoder took no
+ * time : a constant offset of a few ms at most, the same for the whole run.
+ */
+class FrameIndexer {
+public:
+
+        /**
+         * Per encoder buffer recorded, after Segmenter::next (newSegment is what it returned). pts [us]
+         * INT64_MIN if unknown. Returns true and fills frame when the buffer ends a frame.
+         */
+        bool add (int newSegment, uint32_t length, bool config, bool keyframe, bool frameEnd, int64_t pts, uint64_t nowNs, EncodedFrame *frame);
+
+        /// A buffer the segment writer didn't take : the frames of the segment from here on are marked damaged.
+        void dropped () { damaged = true; }
+
+private:
+
+        int segment = -1;
+        uint32_t bytes = 0;             /// In the current segment.
+        bool inFrame = false;
+        bool damaged = false;           /// In the current segment.
+        EncodedFrame current;
+        bool synced = false;
+        int64_t clockOffsetNs = 0;      /// CLOCK_MONOTONIC - PTS.
+};
+
+#endif /* FRAMEINDEX_H_ */
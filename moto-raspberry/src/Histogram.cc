@@ -0,0 +1,109 @@
+/****************************************************************************
+ *                                                                          *
+ *  Author : lukasz.iwaszkiewicz@gmail.com                                  *
+ *  ~~~~~~~~                                                                *
+ *  License : see COPYING file for details.                                 *
+ *  ~~~~~~~~~                                                               *
+ ****************************************************************************/
+
+
+#include "Histogram.h"
+#include <time.h>
+#include <algorithm>
+#include <iomanip>
+
+/// Width of the longest histogram bar.
+static const uint64_t HISTOGRAM_WIDTH = 50;
+
+uint64_t monotonicNs ()
+{
+        timespec ts;
+        clock_gettime (CLOCK_MONOTONIC, &ts);
+        return uint64_t (ts.tv_sec) * 1000000000ULL + ts.tv_nsec;
+}
+
+int Histogram::bucket (uint64_t value)
+{
+        if (value < SUB_BUCKETS) {
+                return int (value);
+        }
+
+        int exponent = 63 - __builtin_clzll (value);
+
+        if (exponent > MAX_EXPONENT) {
+                return BUCKETS - 1;
+        }
+
+        return (exponent - SUB_BITS + 1) * SUB_BUCKETS + int ((value >> (exponent - SUB_BITS)) & (SUB_BUCKETS - 1));
+}
+
+uint64_t Histogram::lowest (int bucket)
+{
+        if (bucket < SUB_BUCKETS) {
+                return bucket;
+        }
+
+        int exponent = bucket / SUB_BUCKETS + SUB_BITS - 1;
+        return uint64_t (SUB_BUCKETS + bucket % SUB_BUCKETS) << (exponent - SUB_BITS);
+}
+
+void Histogram::add (uint64_t value)
+{
+        bump (buckets[bucket (value)], 1);
+        bump (n, 1);
+        bump (sum, value);
+
+        if (value > max.load (std::memory_order_relaxed)) {
+                max.store (value, std::memory_order_relaxed);
+        }
+}
+
+uint64_t Histogram::percentile (double p) const
+{
+        uint64_t rank = uint64_t (p * count ());
+        uint64_t seen = 0;
+
+        for (int i = 0; i < BUCKETS - 1; ++i) {
+                seen += buckets[i].load (std::memory_order_relaxed);
+
+                if (seen > rank) {
+                        return std::min (lowest (i + 1) - 1, maximum ());
+                }
+        }
+
+        return maximum ();
+}
+
+void Histogram::print (std::ostream &o, std::string const &indent, const char *unit) const
+{
+        // Shown by powers of two : bucket i holds [2^(i-1), 2^i), bucket 0 the zeros.
+        const int OCTAVES = MAX_EXPONENT + 3;
+        uint64_t octaves[OCTAVES] = {};
+        uint64_t peak = 0;
+        int first = OCTAVES;
+        int last = 0;
+
+        for (int i = 0; i < BUCKETS; ++i) {
+                uint64_t low = lowest (i);
+                octaves[(low) ? 64 - __builtin_clzll (low) : 0] += buckets[i].load (std::memory_order_relaxed);
+        }
+
+        for (int i = 0; i < OCTAVES; ++i) {
+                if (octaves[i]) {
+                        peak = std::max (peak, octaves[i]);
+                        first = std::min (first, i);
+                        last = i;
+                }
+        }
+
+        for (int i = first; i <= last; ++i) {
+                o << indent << "< " << std::setw (10) << (uint64_t (1) << i) << " " << unit << " "
+                  << std::setw (10) << octaves[i] << " " << std::string (octaves[i] * HISTOGRAM_WIDTH / peak, '#') << "\n";
+        }
+}
+
+void Histogram::printSummary (std::ostream &o, const char *name, const char *unit) const
+{
+        o << name << " : n=" << count () << ", mean=" << mean () << " " << unit << ", p50<" << percentile (0.5) + 1 << ", p99<" << percentile (0.99) + 1
+          << ", p99.9<" << percentile (0.999) + 1 << ", max=" << maximum () << " " << unit << "\n";
+}
@@ -0,0 +1,59 @@
+/****************************************************************************
+ *                                                                          *
+ *  Author : lukasz.iwaszkiewicz@gmail.com                                  *
+ *  ~~~~~~~~                                                                *
+ *  License : see COPYING file for details.                                 *
+ *  ~~~~~~~~~                                                               *
+ ****************************************************************************/
+
+
+#ifndef HISTOGRAM_H_
+#define HISTOGRAM_H_
+
+#include <atomic>
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+/**
+ * Distribution of durations (or any non negative values), HDR style : every power of two is
+ * split in 8 linear sub-buckets, so values are kept to within 12.5 % (0..15 exactly) up to
+ * 2^40. Cheap enough for the capture path : no loop, no RMW. One thread adds, any thread
+ * may read as it does, the counts are relaxed atomics (a read may be a sample or so off).
+ */
+class Histogram {
+public:
+        void add (uint64_t value);
+        void print (std::ostream &o, std::string const &indent, const char *unit) const;
+
+        /// One line : count, mean, p50, p99, p99.9 and max.
+        void printSummary (std::ostream &o, const char *name, const char *unit) const;
+
+        uint64_t count () const { return n.load (std::memory_order_relaxed); }
+        uint64_t mean () const { return (count ()) ? (sum.load (std::memory_order_relaxed) / count ()) : 0; }
+        uint64_t maximum () const { return max.load (std::memory_order_relaxed); }
+
+        /// The highest value of the bucket the p-th quantile falls in.
+        uint64_t percentile (double p) const;
+
+private:
+        static const int SUB_BITS = 3;
+        static const int SUB_BUCKETS = 1 << SUB_BITS;
+        static const int MAX_EXPONENT = 39;
+        static const int BUCKETS = (MAX_EXPONENT - SUB_BITS + 2) * SUB_BUCKETS;
+
+        static int bucket (uint64_t value);
+        static uint64_t lowest (int bucket);
+
+        static void bump (std::atomic <uint64_t> &counter, uint64_t by) { counter.store (counter.load (std::memory_order_relaxed) + by, std::memory_order_relaxed); }
+
+        std::atomic <uint64_t> buckets[BUCKETS] = {};
+        std::atomic <uint64_t> n {0};
+        std::atomic <uint64_t> sum {0};
+        std::atomic <uint64_t> max {0};
+};
+
+/// CLOCK_MONOTONIC now [ns].
+uint64_t monotonicNs ();
+
+#endif /* HISTOGRAM_H_ */
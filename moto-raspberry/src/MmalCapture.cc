@@ -0,0 +1,714 @@
+/*
+Copyright (c) 2013, Broadcom Europe Ltd
+Copyright (c) 2013, James Hughes
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/**
+ * \file MmalCapture.cc
+ * Camera and H.264 encoder components, taken from RaspiVid.c (James Hughes). The camera's
+ * video port is tunnelled into the encoder, and the encoder output buffers are handed to
+ * the CaptureSink from the encoder callback.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <memory.h>
+
+extern "C" {
+#include "bcm_host.h"
+#include "interface/vcos/vcos.h"
+
+#include "interface/mmal/mmal.h"
+#include "interface/mmal/mmal_logging.h"
+#include "interface/mmal/mmal_buffer.h"
+#include "interface/mmal/util/mmal_util.h"
+#include "interface/mmal/util/mmal_util_params.h"
+#include "interface/mmal/util/mmal_default_components.h"
+#include "interface/mmal/util/mmal_connection.h"
+
+#include "RaspiCamControl.h"
+};
+
+#include "MmalCapture.h"
+
+/// Camera number to use - we only have one camera, indexed from 0.
+#define CAMERA_NUMBER 0
+
+// Standard port setting for the camera component
+#define MMAL_CAMERA_PREVIEW_PORT 0
+#define MMAL_CAMERA_VIDEO_PORT 1
+#define MMAL_CAMERA_CAPTURE_PORT 2
+
+// Video format information
+#define VIDEO_FRAME_RATE_DEN 1
+
+/// Video render needs at least 2 buffers.
+#define VIDEO_OUTPUT_BUFFERS_NUM 3
+
+extern "C" int mmal_status_to_int(MMAL_STATUS_T status);
+
+/** Structure containing all state information for the camera and encoder
+ */
+struct MmalState
+{
+   unsigned int width;                          /// Requested width of image
+   unsigned int height;                         /// requested height of image
+   int bitrate;                        /// Requested bitrate
+   int framerate;                      /// Requested frame rate (fps)
+   unsigned int intraperiod;                    /// Intra-refresh period (key frame rate)
+   int verbose;                        /// !0 if want detailed run information
+   int immutableInput;                /// Flag to specify whether encoder works in place or creates a new buffer. Result is preview can display either
+                                       /// the camera output or the encoder output (with compression artifacts)
+   RASPICAM_CAMERA_PARAMETERS camera_parameters; /// Camera setup parameters
+
+   MMAL_COMPONENT_T *camera_component;    /// Pointer to the camera component
+   MMAL_COMPONENT_T *encoder_component;   /// Pointer to the encoder component
+   MMAL_CONNECTION_T *encoder_connection; /// Pointer to the connection from camera to encoder
+
+   MMAL_POOL_T *encoder_pool; /// Pointer to the pool of buffers used by encoder output port
+
+   CaptureSink *sink;                   /// Encoded data goes here, from encoder_buffer_callback
+};
+
+typedef MmalState RASPIVID_STATE;
+
+/**
+ *  buffer header callback function for camera control
+ *
+ *  Callback will dump buffer data to the specific file
+ *
+ * @param port Pointer to port from which callback originated
+ * @param buffer mmal buffer header pointer
+ */
+static void camera_control_callback(MMAL_PORT_T *port, MMAL_BUFFER_HEADER_T *buffer)
+{
+   if (buffer->cmd == MMAL_EVENT_PARAMETER_CHANGED)
+   {
+   }
+   else
+   {
+      vcos_log_error("Received unexpected camera control callback event, 0x%08x", buffer->cmd);
+   }
+
+   mmal_buffer_header_release(buffer);
+}
+
+/**
+ *  buffer header callback function for encoder
+ *
+ *  Hands the buffer to the sink, and sends one back to the port.
+ *
+ * @param port Pointer to port from which callback originated
+ * @param buffer mmal buffer header pointer
+ */
+static void encoder_buffer_callback(MMAL_PORT_T *port, MMAL_BUFFER_HEADER_T *buffer)
+{
+        MMAL_BUFFER_HEADER_T *new_buffer;
+        // We pass our state in via the userdata field.
+        RASPIVID_STATE *state = (RASPIVID_STATE *) port->userdata;
+
+        if (state) {
+                mmal_buffer_header_mem_lock(buffer);
+
+                EncodedBuffer encoded;
+                encoded.data = buffer->data;
+                encoded.length = buffer->length;
+                encoded.flags = ((buffer->flags & MMAL_BUFFER_HEADER_FLAG_CONFIG) ? CAPTURE_CONFIG : 0) |
+                                ((buffer->flags & MMAL_BUFFER_HEADER_FLAG_KEYFRAME) ? CAPTURE_KEYFRAME : 0) |
+                                ((buffer->flags & MMAL_BUFFER_HEADER_FLAG_FRAME_END) ? CAPTURE_FRAME_END : 0);
+                // MMAL_TIME_UNKNOWN is INT64_MIN as well.
+                encoded.pts = buffer->pts;
+                state->sink->encoded (encoded);
+
+                mmal_buffer_header_mem_unlock(buffer);
+        } else {
+                vcos_log_error("Received a encoder buffer callback with no state");
+        }
+
+        // release buffer back to the pool
+        mmal_buffer_header_release(buffer);
+
+        // and send one back to the port (if still open)
+        if (port->is_enabled) {
+                MMAL_STATUS_T status;
+
+                new_buffer = mmal_queue_get(state->encoder_pool->queue);
+
+                if (new_buffer) {
+                        status = mmal_port_send_buffer(port, new_buffer);
+                }
+
+                if (!new_buffer || status != MMAL_SUCCESS) {
+                        vcos_log_error("Unable to return a buffer to the encoder port");
+                }
+        }
+}
+
+
+/**
+ * Create the camera component, set up its ports
+ *
+ * @param state Pointer to state control struct
+ *
+ * @return 0 if failed, pointer to component if successful
+ *
+ */
+static MMAL_COMPONENT_T *create_camera_component(RASPIVID_STATE *state)
+{
+   MMAL_COMPONENT_T *camera = 0;
+   MMAL_ES_FORMAT_T *format;
+   MMAL_PORT_T *preview_port = NULL, *video_port = NULL, *still_port = NULL;
+   MMAL_STATUS_T status;
+
+   /* Create the component */
+   status = mmal_component_create(MMAL_COMPONENT_DEFAULT_CAMERA, &camera);
+
+   if (status != MMAL_SUCCESS)
+   {
+      vcos_log_error("Failed to create camera component");
+      goto error;
+   }
+
+   if (!camera->output_num)
+   {
+      vcos_log_error("Camera doesn't have output ports");
+      goto error;
+   }
+
+   preview_port = camera->output[MMAL_CAMERA_PREVIEW_PORT];
+   video_port = camera->output[MMAL_CAMERA_VIDEO_PORT];
+   still_port = camera->output[MMAL_CAMERA_CAPTURE_PORT];
+
+   // Enable the camera, and tell it its control callback function
+   status = mmal_port_enable(camera->control, camera_control_callback);
+
+   if (status)
+   {
+      vcos_log_error("Unable to enable control port : error %d", status);
+      goto error;
+   }
+
+   //  set up the camera configuration
+   {
+      MMAL_PARAMETER_CAMERA_CONFIG_T cam_config =
+      {
+         { MMAL_PARAMETER_CAMERA_CONFIG, sizeof(cam_config) },
+         .max_stills_w = state->width,
+         .max_stills_h = state->height,
+         .stills_yuv422 = 0,
+         .one_shot_stills = 0,
+         .max_preview_video_w = state->width,
+         .max_preview_video_h = state->height,
+         .num_preview_video_frames = 3,
+         .stills_capture_circular_buffer_height = 0,
+         .fast_preview_resume = 0,
+         .use_stc_timestamp = MMAL_PARAM_TIMESTAMP_MODE_RESET_STC
+      };
+      mmal_port_parameter_set(camera->control, &cam_config.hdr);
+   }
+
+   // Now set up the port formats
+
+   // Set the encode format on the Preview port
+   // HW limitations mean we need the preview to be the same size as the required recorded output
+
+   format = preview_port->format;
+
+   format->encoding = MMAL_ENCODING_OPAQUE;
+   format->encoding_variant = MMAL_ENCODING_I420;
+
+   format->encoding = MMAL_ENCODING_OPAQUE;
+   format->es->video.width = state->width;
+   format->es->video.height = state->height;
+   format->es->video.crop.x = 0;
+   format->es->video.crop.y = 0;
+   format->es->video.crop.width = state->width;
+   format->es->video.crop.height = state->height;
+   format->es->video.frame_rate.num = state->framerate;
+   format->es->video.frame_rate.den = VIDEO_FRAME_RATE_DEN;
+
+   status = mmal_port_format_commit(preview_port);
+
+   if (status)
+   {
+      vcos_log_error("camera viewfinder format couldn't be set");
+      goto error;
+   }
+
+   // Set the encode format on the video  port
+
+   format = video_port->format;
+   format->encoding_variant = MMAL_ENCODING_I420;
+
+   format->encoding = MMAL_ENCODING_OPAQUE;
+   format->es->video.width = state->width;
+   format->es->video.height = state->height;
+   format->es->video.crop.x = 0;
+   format->es->video.crop.y = 0;
+   format->es->video.crop.width = state->width;
+   format->es->video.crop.height = state->height;
+   format->es->video.frame_rate.num = state->framerate;
+   format->es->video.frame_rate.den = VIDEO_FRAME_RATE_DEN;
+
+   status = mmal_port_format_commit(video_port);
+
+   if (status)
+   {
+      vcos_log_error("camera video format couldn't be set");
+      goto error;
+   }
+
+   // Ensure there are enough buffers to avoid dropping frames
+   if (video_port->buffer_num < VIDEO_OUTPUT_BUFFERS_NUM)
+      video_port->buffer_num = VIDEO_OUTPUT_BUFFERS_NUM;
+
+
+   // Set the encode format on the still  port
+
+   format = still_port->format;
+
+   format->encoding = MMAL_ENCODING_OPAQUE;
+   format->encoding_variant = MMAL_ENCODING_I420;
+
+   format->es->video.width = state->width;
+   format->es->video.height = state->height;
+   format->es->video.crop.x = 0;
+   format->es->video.crop.y = 0;
+   format->es->video.crop.width = state->width;
+   format->es->video.crop.height = state->height;
+   format->es->video.frame_rate.num = 1;
+   format->es->video.frame_rate.den = 1;
+
+   status = mmal_port_format_commit(still_port);
+
+   if (status)
+   {
+      vcos_log_error("camera still format couldn't be set");
+      goto error;
+   }
+
+   /* Ensure there are enough buffers to avoid dropping frames */
+   if (still_port->buffer_num < VIDEO_OUTPUT_BUFFERS_NUM)
+      still_port->buffer_num = VIDEO_OUTPUT_BUFFERS_NUM;
+
+   /* Enable component */
+   status = mmal_component_enable(camera);
+
+   if (status)
+   {
+      vcos_log_error("camera component couldn't be enabled");
+      goto error;
+   }
+
+   raspicamcontrol_set_all_parameters(camera, &state->camera_parameters);
+
+   state->camera_component = camera;
+
+   if (state->verbose)
+      fprintf(stderr, "Camera component done\n");
+
+   return camera;
+
+error:
+
+   if (camera)
+      mmal_component_destroy(camera);
+
+   return 0;
+}
+
+/**
+ * Destroy the camera component
+ *
+ * @param state Pointer to state control struct
+ *
+ */
+static void destroy_camera_component(RASPIVID_STATE *state)
+{
+   if (state->camera_component)
+   {
+      mmal_component_destroy(state->camera_component);
+      state->camera_component = NULL;
+   }
+}
+
+/**
+ * Create the encoder component, set up its ports
+ *
+ * @param state Pointer to state control struct
+ *
+ * @return 0 if failed, pointer to component if successful
+ *
+ */
+static MMAL_COMPONENT_T *create_encoder_component(RASPIVID_STATE *state)
+{
+   MMAL_COMPONENT_T *encoder = 0;
+   MMAL_PORT_T *encoder_input = NULL, *encoder_output = NULL;
+   MMAL_STATUS_T status;
+   MMAL_POOL_T *pool;
+
+   status = mmal_component_create(MMAL_COMPONENT_DEFAULT_VIDEO_ENCODER, &encoder);
+
+   if (status != MMAL_SUCCESS)
+   {
+      vcos_log_error("Unable to create video encoder component");
+      goto error;
+   }
+
+   if (!encoder->input_num || !encoder->output_num)
+   {
+      vcos_log_error("Video encoder doesn't have input/output ports");
+      goto error;
+   }
+
+   encoder_input = encoder->input[0];
+   encoder_output = encoder->output[0];
+
+   // We want same format on input and output
+   mmal_format_copy(encoder_output->format, encoder_input->format);
+
+   // Only supporting H264 at the moment
+   encoder_output->format->encoding = MMAL_ENCODING_H264;
+
+   encoder_output->format->bitrate = state->bitrate;
+
+   encoder_output->buffer_size = encoder_output->buffer_size_recommended;
+
+   if (encoder_output->buffer_size < encoder_output->buffer_size_min)
+      encoder_output->buffer_size = encoder_output->buffer_size_min;
+
+   encoder_output->buffer_num = encoder_output->buffer_num_recommended;
+
+   if (encoder_output->buffer_num < encoder_output->buffer_num_min)
+      encoder_output->buffer_num = encoder_output->buffer_num_min;
+
+   // Commit the port changes to the output port
+   status = mmal_port_format_commit(encoder_output);
+
+   if (status != MMAL_SUCCESS)
+   {
+      vcos_log_error("Unable to set format on video encoder output port");
+      goto error;
+   }
+
+
+   // Set the rate control parameter
+   if (0)
+   {
+      MMAL_PARAMETER_VIDEO_RATECONTROL_T param = {{ MMAL_PARAMETER_RATECONTROL, sizeof(param)}, MMAL_VIDEO_RATECONTROL_DEFAULT};
+      status = mmal_port_parameter_set(encoder_output, &param.hdr);
+      if (status != MMAL_SUCCESS)
+      {
+         vcos_log_error("Unable to set ratecontrol");
+         goto error;
+      }
+
+   }
+
+   if (state->intraperiod)
+   {
+      MMAL_PARAMETER_UINT32_T param = {{ MMAL_PARAMETER_INTRAPERIOD, sizeof(param)}, state->intraperiod};
+      status = mmal_port_parameter_set(encoder_output, &param.hdr);
+      if (status != MMAL_SUCCESS)
+      {
+         vcos_log_error("Unable to set intraperiod");
+         goto error;
+      }
+
+   }
+
+   // SPS/PPS in front of every IDR, so each segment starts with its own.
+   if (mmal_port_parameter_set_boolean(encoder_output, MMAL_PARAMETER_VIDEO_ENCODE_INLINE_HEADER, 1) != MMAL_SUCCESS)
+   {
+      vcos_log_error("Unable to set inline headers, segments after the first won't decode on their own");
+      // Continue rather than abort..
+   }
+
+   if (mmal_port_parameter_set_boolean(encoder_input, MMAL_PARAMETER_VIDEO_IMMUTABLE_INPUT, state->immutableInput) != MMAL_SUCCESS)
+   {
+      vcos_log_error("Unable to set immutable input flag");
+      // Continue rather than abort..
+   }
+
+   //  Enable component
+   status = mmal_component_enable(encoder);
+
+   if (status)
+   {
+      vcos_log_error("Unable to enable video encoder component");
+      goto error;
+   }
+
+   /* Create pool of buffer headers for the output port to consume */
+   pool = mmal_port_pool_create(encoder_output, encoder_output->buffer_num, encoder_output->buffer_size);
+
+   if (!pool)
+   {
+      vcos_log_error("Failed to create buffer header pool for encoder output port %s", encoder_output->name);
+   }
+
+   state->encoder_pool = pool;
+   state->encoder_component = encoder;
+
+   if (state->verbose)
+      fprintf(stderr, "Encoder component done\n");
+
+   return encoder;
+
+   error:
+   if (encoder)
+      mmal_component_destroy(encoder);
+
+   return 0;
+}
+
+/**
+ * Destroy the encoder component
+ *
+ * @param state Pointer to state control struct
+ *
+ */
+static void destroy_encoder_component(RASPIVID_STATE *state)
+{
+   // Get rid of any port buffers first
+   if (state->encoder_pool)
+   {
+      mmal_port_pool_destroy(state->encoder_component->output[0], state->encoder_pool);
+   }
+
+   if (state->encoder_component)
+   {
+      mmal_component_destroy(state->encoder_component);
+      state->encoder_component = NULL;
+   }
+}
+
+/**
+ * Connect two specific ports together
+ *
+ * @param output_port Pointer the output port
+ * @param input_port Pointer the input port
+ * @param Pointer to a mmal connection pointer, reassigned if function successful
+ * @return Returns a MMAL_STATUS_T giving result of operation
+ *
+ */
+static MMAL_STATUS_T connect_ports(MMAL_PORT_T *output_port, MMAL_PORT_T *input_port, MMAL_CONNECTION_T **connection)
+{
+   MMAL_STATUS_T status;
+
+   status =  mmal_connection_create(connection, output_port, input_port, MMAL_CONNECTION_FLAG_TUNNELLING | MMAL_CONNECTION_FLAG_ALLOCATION_ON_INPUT);
+
+   if (status == MMAL_SUCCESS)
+   {
+      status =  mmal_connection_enable(*connection);
+      if (status != MMAL_SUCCESS)
+         mmal_connection_destroy(*connection);
+   }
+
+   return status;
+}
+
+/**
+ * Checks if specified port is valid and enabled, then disables it
+ *
+ * @param port  Pointer the port
+ *
+ */
+static void check_disable_port(MMAL_PORT_T *port)
+{
+   if (port && port->is_enabled)
+      mmal_port_disable(port);
+}
+
+/*****************************************************************************/
+
+MmalCapture::MmalCapture (CaptureSettings const &settings, bool verbose) : state (new MmalState ())
+{
+   bcm_host_init();
+
+   // Register our application with the logging system
+   vcos_log_register("RaspiVid", VCOS_LOG_CATEGORY);
+
+   memset(state, 0, sizeof(MmalState));
+   state->width = settings.width;
+   state->height = settings.height;
+   state->bitrate = settings.bitrate;
+   state->framerate = settings.framerate;
+   state->intraperiod = settings.intraperiod;
+   state->verbose = verbose;
+   state->immutableInput = 1;
+
+   // Set up the camera_parameters to default
+   raspicamcontrol_set_defaults(&state->camera_parameters);
+
+   if (state->verbose)
+      raspicamcontrol_dump_parameters(&state->camera_parameters);
+}
+
+MmalCapture::~MmalCapture ()
+{
+   stop ();
+   delete state;
+}
+
+bool MmalCapture::start (CaptureSink *sink)
+{
+   MMAL_STATUS_T status = MMAL_SUCCESS;
+   MMAL_PORT_T *camera_video_port = NULL;
+   MMAL_PORT_T *encoder_input_port = NULL;
+   MMAL_PORT_T *encoder_output_port = NULL;
+
+   state->sink = sink;
+
+   // We have two components. Camera and encoder.
+
+   if (!create_camera_component(state))
+   {
+      vcos_log_error("%s: Failed to create camera component", __func__);
+      raspicamcontrol_check_configuration(128);
+      return false;
+   }
+
+   if (!create_encoder_component(state))
+   {
+      vcos_log_error("%s: Failed to create encode component", __func__);
+      destroy_camera_component(state);
+      raspicamcontrol_check_configuration(128);
+      return false;
+   }
+
+   if (state->verbose)
+      fprintf(stderr, "Starting component connection stage\n");
+
+   camera_video_port   = state->camera_component->output[MMAL_CAMERA_VIDEO_PORT];
+   encoder_input_port  = state->encoder_component->input[0];
+   encoder_output_port = state->encoder_component->output[0];
+
+   if (state->verbose)
+      fprintf(stderr, "Connecting camera video port to encoder input port\n");
+
+   // Now connect the camera to the encoder
+   status = connect_ports(camera_video_port, encoder_input_port, &state->encoder_connection);
+
+   if (status != MMAL_SUCCESS)
+   {
+      state->encoder_connection = NULL;
+      vcos_log_error("%s: Failed to connect camera video port to encoder input", __func__);
+      goto error;
+   }
+
+   encoder_output_port->userdata = (struct MMAL_PORT_USERDATA_T *)state;
+
+   if (state->verbose)
+      fprintf(stderr, "Enabling encoder output port\n");
+
+   // Enable the encoder output port and tell it its callback function
+   status = mmal_port_enable(encoder_output_port, encoder_buffer_callback);
+
+   if (status != MMAL_SUCCESS)
+   {
+      vcos_log_error("Failed to setup encoder output");
+      goto error;
+   }
+
+   if (state->verbose)
+      fprintf(stderr, "Starting video capture\n");
+
+   if ((status = mmal_port_parameter_set_boolean(camera_video_port, MMAL_PARAMETER_CAPTURE, 1)) != MMAL_SUCCESS)
+   {
+      goto error;
+   }
+
+   // Send all the buffers to the encoder output port
+   {
+      int num = mmal_queue_length(state->encoder_pool->queue);
+      int q;
+      for (q=0;q<num;q++)
+      {
+         MMAL_BUFFER_HEADER_T *buffer = mmal_queue_get(state->encoder_pool->queue);
+
+         if (!buffer)
+            vcos_log_error("Unable to get a required buffer %d from pool queue", q);
+
+         if (mmal_port_send_buffer(encoder_output_port, buffer)!= MMAL_SUCCESS)
+            vcos_log_error("Unable to send a buffer to encoder output port (%d)", q);
+
+      }
+   }
+
+   return true;
+
+error:
+
+   mmal_status_to_int(status);
+   stop ();
+   raspicamcontrol_check_configuration(128);
+   return false;
+}
+
+void MmalCapture::stop ()
+{
+   if (!state->camera_component && !state->encoder_component)
+      return;
+
+   if (state->verbose)
+      fprintf(stderr, "Closing down\n");
+
+   // Disable all our ports that are not handled by connections
+   if (state->camera_component)
+      check_disable_port(state->camera_component->output[MMAL_CAMERA_CAPTURE_PORT]);
+
+   if (state->encoder_component)
+      check_disable_port(state->encoder_component->output[0]);
+
+   if (state->encoder_connection)
+   {
+      mmal_connection_destroy(state->encoder_connection);
+      state->encoder_connection = NULL;
+   }
+
+   /* Disable components */
+   if (state->encoder_component)
+      mmal_component_disable(state->encoder_component);
+
+   if (state->camera_component)
+      mmal_component_disable(state->camera_component);
+
+   destroy_encoder_component(state);
+   destroy_camera_component(state);
+   state->encoder_pool = NULL;
+
+   if (state->verbose)
+      fprintf(stderr, "Close down completed, all components disconnected, disabled and destroyed\n\n");
+}
+
+void MmalCapture::requestKeyframe ()
+{
+   if (state->encoder_component &&
+       mmal_port_parameter_set_boolean(state->encoder_component->output[0], MMAL_PARAMETER_VIDEO_REQUEST_I_FRAME, 1) != MMAL_SUCCESS)
+      vcos_log_error("Unable to request an I frame");
+}
@@ -0,0 +1,39 @@
+/****************************************************************************
+ *                                                                          *
+ *  Author : lukasz.iwaszkiewicz@gmail.com                                  *
+ *  ~~~~~~~~                                                                *
+ *  License : see COPYING file for details.                                 *
+ *  ~~~~~~~~~                                                               *
+ ****************************************************************************/
+
+
+#ifndef MMALCAPTURE_H_
+#define MMALCAPTURE_H_
+
+#include "CaptureSource.h"
+
+struct MmalState;
+
+/**
+ * The Pi camera through the VideoCore H.264 encoder (MMAL). Buffers are delivered from
+ * the encoder callback, on an MMAL thread. Built only with WITH_MMAL.
+ */
+class MmalCapture : public CaptureSource {
+public:
+
+        MmalCapture (CaptureSettings const &settings, bool verbose = false);
+        ~MmalCapture ();
+
+        MmalCapture (MmalCapture const &) = delete;
+        MmalCapture &operator= (MmalCapture const &) = delete;
+
+        bool start (CaptureSink *sink);
+        void stop ();
+        void requestKeyframe ();
+
+private:
+
+        MmalState *state;
+};
+
+#endif /* MMALCAPTURE_H_ */
@@ -0,0 +1,109 @@
+/****************************************************************************
+ *                                                                          *
+ *  Author : lukasz.iwaszkiewicz@gmail.com                                  *
+ *  ~~~~~~~~                                                                *
+ *  License : see COPYING file for details.                                 *
+ *  ~~~~~~~~~                                                               *
+ ****************************************************************************/
+
+
+#include "Realtime.h"
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+bool parseThreadPolicy (const char *text, ThreadPolicy *policy)
+{
+        int priority, cpu = -1, consumed = 0;
+
+        if (sscanf (text, "%d%n@%d%n", &priority, &consumed, &cpu, &consumed) < 1 || text[consumed] != '\0' || priority < 0 || priority > 99) {
+                return false;
+        }
+
+        policy->priority = priority;
+        policy->cpu = cpu;
+        return true;
+}
+
+bool applyThreadPolicy (ThreadPolicy const &policy, const char *name)
+{
+        bool ok = true;
+        pthread_setname_np (pthread_self (), name);
+
+        if (policy.cpu >= 0) {
+                cpu_set_t set;
+                CPU_ZERO (&set);
+                CPU_SET (policy.cpu, &set);
+
+                if (int error = pthread_setaffinity_np (pthread_self (), sizeof (set), &set)) {
+                        std::cerr << "applyThreadPolicy : can't pin " << name << " to CPU " << policy.cpu << " : " << strerror (error) << std::endl;
+                        ok = false;
+                }
+        }
+
+        if (policy.priority > 0) {
+                sched_param param = {};
+                param.sched_priority = policy.priority;
+
+                if (int error = pthread_setschedparam (pthread_self (), SCHED_FIFO, &param)) {
+                        std::cerr << "applyThreadPolicy : can't run " << name << " SCHED_FIFO " << policy.priority << " : " << strerror (error) << std::endl;
+                        ok = false;
+                }
+        }
+
+        return ok;
+}
+
+bool lockMemory ()
+{
+        if (mlockall (MCL_CURRENT | MCL_FUTURE) != 0) {
+                std::cerr << "lockMemory : mlockall failed : " << strerror (errno) << std::endl;
+                return false;
+        }
+
+        return true;
+}
+
+void sleepUntil (uint64_t ns)
+{
+        timespec ts;
+        ts.tv_sec = ns / 1000000000ULL;
+        ts.tv_nsec = ns % 1000000000ULL;
+        // It returns the error rather than setting errno. Anything but a signal (EINVAL) would fail again the same way.
+        while (clock_nanosleep (CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) {
+        }
+}
+
+/*****************************************************************************/
+
+void LoopStats::iteration (uint64_t nowNs)
+{
+        if (last) {
+                uint64_t period = nowNs - last;
+
+                if (nominalNs) {
+                        period = (period > nominalNs) ? period - nominalNs : nominalNs - period;
+                }
+
+                periodUs.add (period / 1000);
+        }
+
+        last = nowNs;
+}
+
+void LoopStats::printSummary (std::ostream &o, const char *name) const
+{
+        if (periodUs.count ()) {
+                periodUs.printSummary (o, (std::string (name) + ((nominalNs) ? " period error" : " period")).c_str (), "us");
+        }
+
+        if (wakeupUs.count ()) {
+                wakeupUs.printSummary (o, (std::string (name) + " wake-up").c_str (), "us");
+        }
+}
@@ -0,0 +1,72 @@
+/****************************************************************************
+ *                                                                          *
+ *  Author : lukasz.iwaszkiewicz@gmail.com                                  *
+ *  ~~~~~~~~                                                                *
+ *  License : see COPYING file for details.                                 *
+ *  ~~~~~~~~~                                                               *
+ ****************************************************************************/
+
+
+#ifndef REALTIME_H_
+#define REALTIME_H_
+
+#include <cstdint>
+#include <ostream>
+#include "Histogram.h"
+
+/**
+ * Scheduling of one of the recorder's threads. priority 1..99 : SCHED_FIFO at that priority,
+ * 0 : left as it is (SCHED_OTHER). cpu >= 0 : pinned to that CPU.
+ */
+struct ThreadPolicy {
+        int priority = 0;
+        int cpu = -1;
+};
+
+/// "PRIO" or "PRIO@CPU". False if it isn't one.
+bool parseThreadPolicy (const char *text, ThreadPolicy *policy);
+
+/**
+ * Applies policy to the calling thread and names it (ps -L, top -H). SCHED_FIFO needs root
+ * or CAP_SYS_NICE : if refused, says so and returns false, the thread runs on as it was.
+ */
+bool applyThreadPolicy (ThreadPolicy const &policy, const char *name);
+
+/// Sleeps until CLOCK_MONOTONIC ns. Sleeping to absolute deadlines keeps a loop's period from drifting by its own run time.
+void sleepUntil (uint64_t ns);
+
+/// mlockall, current and future pages : no page fault stalls the capture path. Needs root or CAP_IPC_LOCK.
+bool lockMemory ();
+
+/**
+ * Timing of a thread's loop : the period between iterations, and for loops which wait for
+ * a deadline, how late after it they ran (wake-up jitter). Given the nominal period, the
+ * period is recorded as its error, |period - nominal|, which power of two buckets resolve
+ * far better than the period itself. One thread adds.
+ */
+class LoopStats {
+public:
+
+        explicit LoopStats (uint64_t nominalNs = 0) : nominalNs (nominalNs) {}
+
+        /// Once per iteration.
+        void iteration (uint64_t nowNs);
+
+        /// Ran at nowNs, for something due at deadlineNs (CLOCK_MONOTONIC).
+        void woke (uint64_t deadlineNs, uint64_t nowNs) { wakeupUs.add ((nowNs > deadlineNs) ? (nowNs - deadlineNs) / 1000 : 0); }
+
+        Histogram const &period () const { return periodUs; }
+        Histogram const &wakeup () const { return wakeupUs; }
+
+        /// Summary lines of what was recorded : "name period" (or "period error") and "name wake-up".
+        void printSummary (std::ostream &o, const char *name) const;
+
+private:
+
+        uint64_t nominalNs;
+        Histogram periodUs;
+        Histogram wakeupUs;
+        uint64_t last = 0;
+};
+
+#endif /* REALTIME_H_ */
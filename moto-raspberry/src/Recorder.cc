@@ -0,0 +1,76 @@
+/****************************************************************************
+ *                                                                          *
+ *  Author : lukasz.iwaszkiewicz@gmail.com                                  *
+ *  ~~~~~~~~                                                                *
+ *  License : see COPYING file for details.                                 *
+ *  ~~~~~~~~~                                                               *
+ ****************************************************************************/
+
+
+#include "Recorder.h"
+#include <iostream>
+
+void Recorder::encoded (EncodedBuffer const &buffer)
+{
+        // The MMAL callback thread isn't ours to start : it is set up from within.
+        if (!policyApplied) {
+                applyThreadPolicy (policy, "capture");
+                policyApplied = true;
+        }
+
+        uint64_t begin = monotonicNs ();
+        bool config = buffer.flags & CAPTURE_CONFIG;
+        bool keyframe = buffer.flags & CAPTURE_KEYFRAME;
+
+        // The stream's clock, lined up with CLOCK_MONOTONIC at the first PTS. Buffers without one (SPS/PPS) go by the last.
+        if (buffer.pts != INT64_MIN) {
+                if (!ptsSeen) {
+                        ptsOffsetNs = int64_t (begin) - buffer.pts * 1000;
+                        ptsSeen = true;
+                }
+
+                streamNs = uint64_t (buffer.pts * 1000 + ptsOffsetNs);
+        }
+        else if (!ptsSeen) {
+                streamNs = begin;
+        }
+
+        // Segments start at an IDR, with its SPS/PPS, once the current one is long enough.
+        int segment = segmenter->next (buffer.length, config, keyframe, streamNs);
+        bool pushed = segments->push (buffer.data, buffer.length, segment, begin);
+
+        // Only what the segment writer took is announced and indexed. A dropped segment start moves to the next IDR.
+        if (!pushed && segment >= 0) {
+                segmenter->dropped ();
+        }
+
+        if (!pushed) {
+                indexer->dropped ();
+        }
+
+        if (pushed && segment >= 0) {
+                telemetry->segmentStarted (segment, begin);
+        }
+
+        EncodedFrame frame;
+
+        if (pushed && indexer->add (segment, buffer.length, config, keyframe, buffer.flags & CAPTURE_FRAME_END, buffer.pts, begin, &frame)) {
+                telemetry->frameEncoded (frame);
+                frameTiming.iteration (begin);
+                frameTiming.woke (frame.captureNs, begin);
+        }
+
+        // Once per run of drops, SegmentWriter::dropped has the count.
+        if (!pushed && !dropping) {
+                std::cerr << "Recorder::encoded : segment writer can't keep up, dropping buffers" << std::endl;
+        }
+
+        dropping = !pushed;
+
+        if (segments->failed () && !abort) {
+                std::cerr << "Recorder::encoded : failed to write buffer data, aborting" << std::endl;
+                abort = true;
+        }
+
+        callbackTime->add ((monotonicNs () - begin) / 1000);
+}
@@ -0,0 +1,72 @@
+/****************************************************************************
+ *                                                                          *
+ *  Author : lukasz.iwaszkiewicz@gmail.com                                  *
+ *  ~~~~~~~~                                                                *
+ *  License : see COPYING file for details.                                 *
+ *  ~~~~~~~~~                                                               *
+ ****************************************************************************/
+
+
+#ifndef RECORDER_H_
+#define RECORDER_H_
+
+#include <atomic>
+#include "CaptureSource.h"
+#include "FrameIndex.h"
+#include "Histogram.h"
+#include "Realtime.h"
+#include "Segmenter.h"
+#include "SegmentWriter.h"
+#include "TelemetryWriter.h"
+
+/**
+ * The encoder callback, whatever the capture source : decides where segments start
+ * (Segmenter), pushes the data to the segment writer, and only if it took them announces
+ * the segment to the telemetry writer (which starts the matching NNNNN.csv) and indexes the
+ * frames. No I/O, no locks.
+ */
+class Recorder : public CaptureSink {
+public:
+
+        /**
+         * callbackTime : time spent per buffer [us], only added to from the capture thread.
+         * policy : applied to the capture thread (the MMAL callback's, or the replay's) at its first buffer.
+         * framePeriodNs : nominal, the frame period is timed against it (0 : not known).
+         */
+        Recorder (Segmenter *segmenter, FrameIndexer *indexer, TelemetryWriter *telemetry, SegmentWriter *segments, Histogram *callbackTime,
+                  ThreadPolicy const &policy = ThreadPolicy (), uint64_t framePeriodNs = 0)
+            : segmenter (segmenter), indexer (indexer), telemetry (telemetry), segments (segments), callbackTime (callbackTime), policy (policy),
+              abort (false), frameTiming (framePeriodNs)
+        {
+        }
+
+        void encoded (EncodedBuffer const &buffer);
+        bool ready (size_t length) const { return segments->room () >= length && telemetry->frameRoom () > 0; }
+
+        /// Writing failed, capture should stop.
+        bool aborted () const { return abort; }
+
+        /**
+         * Frame period at the callback, and as wake-up : how late a frame's last buffer came,
+         * past its capture time as estimated from the PTS (so 0 for the quickest).
+         */
+        LoopStats const &loopStats () const { return frameTiming; }
+
+private:
+
+        Segmenter *segmenter;
+        FrameIndexer *indexer;
+        TelemetryWriter *telemetry;
+        SegmentWriter *segments;
+        Histogram *callbackTime;
+        ThreadPolicy policy;
+        std::atomic <bool> abort;
+        bool dropping = false;
+        bool policyApplied = false;
+        bool ptsSeen = false;
+        int64_t ptsOffsetNs = 0;
+        uint64_t streamNs = 0;          /// Segmenter's clock : the PTS, or CLOCK_MONOTONIC until there is one.
+        LoopStats frameTiming;
+};
+
+#endif /* RECORDER_H_ */
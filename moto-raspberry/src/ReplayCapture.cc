@@ -0,0 +1,243 @@
+/****************************************************************************
+ *                                                                          *
+ *  Author : lukasz.iwaszkiewicz@gmail.com                                  *
+ *  ~~~~~~~~                                                                *
+ *  License : see COPYING file for details.                                 *
+ *  ~~~~~~~~~                                                               *
+ ****************************************************************************/
+
+
+#include "ReplayCapture.h"
+#include "Histogram.h"
+#include "Realtime.h"
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+
+namespace {
+
+enum NalType {
+        NAL_SLICE = 1,
+        NAL_IDR = 5,
+        NAL_SEI = 6,
+        NAL_SPS = 7,
+        NAL_PPS = 8,
+        NAL_AUD = 9
+};
+
+/// The 00 00 01 at or after p, or end.
+uint8_t const *findStartCode (uint8_t const *p, uint8_t const *end)
+{
+        while (end - p >= 3) {
+                uint8_t const *zero = static_cast <uint8_t const *> (memchr (p, 0, end - p - 2));
+
+                if (!zero) {
+                        break;
+                }
+
+                if (zero[1] == 0 && zero[2] == 1) {
+                        return zero;
+                }
+
+                p = zero + 1;
+        }
+
+        return end;
+}
+
+} // namespace
+
+ReplayCapture::ReplayCapture (std::vector <std::string> const &files, int framerate, bool realTime, int loops, size_t bufferSize) :
+        files (files), frameNs (1000000000ULL / std::max (framerate, 1)), realTime (realTime), loops (loops), bufferSize (bufferSize),
+        running (false), done (false)
+{
+}
+
+ReplayCapture::~ReplayCapture ()
+{
+        stop ();
+}
+
+bool ReplayCapture::start (CaptureSink *sink)
+{
+        for (std::string const &path : files) {
+                if (access (path.c_str (), R_OK) != 0) {
+                        std::cerr << "ReplayCapture::start : can't read " << path << " : " << strerror (errno) << std::endl;
+                        return false;
+                }
+        }
+
+        if (files.empty ()) {
+                std::cerr << "ReplayCapture::start : nothing to replay" << std::endl;
+                return false;
+        }
+
+        this->sink = sink;
+        running = true;
+        done = false;
+        thread = std::thread (&ReplayCapture::run, this);
+        return true;
+}
+
+void ReplayCapture::stop ()
+{
+        running = false;
+
+        if (thread.joinable ()) {
+                thread.join ();
+        }
+}
+
+void ReplayCapture::run ()
+{
+        startNs = monotonicNs ();
+        frames = 0;
+        int played = 0;
+
+        for (int loop = 0; running && (loops == 0 || loop < loops); ++loop) {
+                for (size_t i = 0; running && i < files.size (); ++i) {
+                        if (!play (files[i])) {
+                                running = false;
+                        }
+
+                        ++played;
+                }
+        }
+
+        double seconds = double (monotonicNs () - startNs) / 1e9;
+        std::cerr << "ReplayCapture : " << frames << " frames from " << played << " files in " << seconds << " s ("
+                  << ((seconds > 0) ? frames / seconds : 0) << " fps)" << std::endl;
+        done = true;
+}
+
+/**
+ * Splits the file into access units : a new one starts with an AUD, SEI or SPS/PPS after
+ * a slice, or with the first slice of a picture (first_mb_in_slice == 0, i.e. its ue(v)
+ * code is a single 1 bit). The SPS/PPS (and AUD) an access unit starts with are its config.
+ */
+bool ReplayCapture::play (std::string const &path)
+{
+        int fd = open (path.c_str (), O_RDONLY);
+        struct stat st;
+
+        if (fd < 0 || fstat (fd, &st) != 0) {
+                std::cerr << "ReplayCapture::play : can't open " << path << " : " << strerror (errno) << std::endl;
+
+                if (fd >= 0) {
+                        close (fd);
+                }
+
+                return false;
+        }
+
+        if (st.st_size == 0) {
+                close (fd);
+                return true;
+        }
+
+        void *map = mmap (NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close (fd);
+
+        if (map == MAP_FAILED) {
+                std::cerr << "ReplayCapture::play : can't map " << path << " : " << strerror (errno) << std::endl;
+                return false;
+        }
+
+        madvise (map, st.st_size, MADV_SEQUENTIAL);
+        uint8_t const *data = static_cast <uint8_t const *> (map);
+        uint8_t const *end = data + st.st_size;
+        uint8_t const *code = findStartCode (data, end);
+
+        if (code == end) {
+                std::cerr << "ReplayCapture::play : " << path << " is not an H.264 Annex B stream" << std::endl;
+                munmap (map, st.st_size);
+                return false;
+        }
+
+        uint8_t const *unit = data;
+        uint8_t const *configEnd = NULL;
+        bool leading = true;
+        bool hasSlice = false;
+        bool keyframe = false;
+
+        while (running && code < end) {
+                // A four byte start code (or trailing zeros) go with the NAL which follows.
+                uint8_t const *nal = (code > data && code[-1] == 0) ? code - 1 : code;
+                int type = (code + 3 < end) ? (code[3] & 0x1f) : 0;
+                bool slice = (type == NAL_SLICE || type == NAL_IDR);
+                bool firstSlice = slice && code + 4 < end && (code[4] & 0x80);
+
+                if (hasSlice && (type == NAL_AUD || type == NAL_SEI || type == NAL_SPS || type == NAL_PPS || firstSlice)) {
+                        frame (unit, configEnd, nal, keyframe);
+                        unit = nal;
+                        configEnd = NULL;
+                        leading = true;
+                        hasSlice = keyframe = false;
+                }
+
+                if (leading && type != NAL_SPS && type != NAL_PPS && type != NAL_AUD) {
+                        leading = false;
+                        configEnd = (nal > unit) ? nal : NULL;
+                }
+
+                hasSlice |= slice;
+                keyframe |= (type == NAL_IDR);
+                code = findStartCode (code + 3, end);
+        }
+
+        if (running && end > unit) {
+                frame (unit, (leading) ? NULL : configEnd, end, keyframe);
+        }
+
+        munmap (map, st.st_size);
+        return true;
+}
+
+/**
+ * One access unit : its config in a buffer of its own, then the frame in bufferSize pieces.
+ */
+void ReplayCapture::frame (uint8_t const *begin, uint8_t const *configEnd, uint8_t const *end, bool keyframe)
+{
+        int64_t pts = int64_t (frames * frameNs / 1000);
+
+        if (realTime) {
+                sleepUntil (startNs + frames * frameNs);
+        }
+        else {
+                // The writers set the pace, nothing is dropped.
+                while (running && !sink->ready (end - begin)) {
+                        usleep (1000);
+                }
+        }
+
+        if (configEnd) {
+                deliver (begin, configEnd - begin, CAPTURE_CONFIG, pts);
+                begin = configEnd;
+        }
+
+        uint32_t flags = (keyframe) ? CAPTURE_KEYFRAME : 0;
+
+        while (begin < end) {
+                size_t length = std::min <size_t> (bufferSize, end - begin);
+                deliver (begin, length, flags | ((begin + length == end) ? CAPTURE_FRAME_END : 0), pts);
+                begin += length;
+        }
+
+        ++frames;
+}
+
+void ReplayCapture::deliver (uint8_t const *data, size_t length, uint32_t flags, int64_t pts)
+{
+        EncodedBuffer buffer;
+        buffer.data = data;
+        buffer.length = length;
+        buffer.flags = flags;
+        buffer.pts = pts;
+        sink->encoded (buffer);
+}
@@ -0,0 +1,66 @@
+/****************************************************************************
+ *                                                                          *
+ *  Author : lukasz.iwaszkiewicz@gmail.com                                  *
+ *  ~~~~~~~~                                                                *
+ *  License : see COPYING file for details.                                 *
+ *  ~~~~~~~~~                                                               *
+ ****************************************************************************/
+
+
+#ifndef REPLAYCAPTURE_H_
+#define REPLAYCAPTURE_H_
+
+#include <atomic>
+#include <cstddef>
+#include <string>
+#include <thread>
+#include <vector>
+#include "CaptureSource.h"
+
+/**
+ * Stand-in for the camera and encoder : plays H.264 Annex B files (.h264, as recorded)
+ * into the sink from a thread of its own, buffer by buffer the way the encoder port does.
+ * SPS/PPS in front of a frame come in a CAPTURE_CONFIG buffer of their own, a frame is
+ * split into buffers of at most bufferSize, the last one flagged CAPTURE_FRAME_END.
+ *
+ * realTime : a frame every 1 / framerate s. Otherwise as fast as the sink takes them without
+ * dropping (CaptureSink::ready). Either way the PTS counts frames at the frame rate, so what
+ * follows the stream (segment durations) comes out the same.
+ *
+ * IDRs can't be asked for, segments start at the IDRs the files have.
+ */
+class ReplayCapture : public CaptureSource {
+public:
+
+        /// files are played one after another, loops times (0 : until stopped).
+        ReplayCapture (std::vector <std::string> const &files, int framerate, bool realTime = true, int loops = 1, size_t bufferSize = 64 << 10);
+        ~ReplayCapture ();
+
+        bool start (CaptureSink *sink);
+        void stop ();
+        void requestKeyframe () {}
+        bool finished () const { return done; }
+
+private:
+
+        void run ();
+        bool play (std::string const &path);
+        void frame (uint8_t const *begin, uint8_t const *configEnd, uint8_t const *end, bool keyframe);
+        void deliver (uint8_t const *data, size_t length, uint32_t flags, int64_t pts);
+
+        std::vector <std::string> files;
+        uint64_t frameNs;
+        bool realTime;
+        int loops;
+        size_t bufferSize;
+        CaptureSink *sink = 0;
+        std::atomic <bool> running;
+        std::atomic <bool> done;
+        std::thread thread;
+
+        // Replay thread only.
+        uint64_t startNs = 0;
+        uint64_t frames = 0;
+};
+
+#endif /* REPLAYCAPTURE_H_ */
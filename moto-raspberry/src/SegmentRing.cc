@@ -0,0 +1,259 @@
+/****************************************************************************
+ *                                                                          *
+ *  Author : lukasz.iwaszkiewicz@gmail.com                                  *
+ *  ~~~~~~~~                                                                *
+ *  License : see COPYING file for details.                                 *
+ *  ~~~~~~~~~                                                               *
+ ****************************************************************************/
+
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+#include <sys/syscall.h>
+#include <chrono>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include "SegmentRing.h"
+
+/// Segments this close to the newest one may still be written to : never deleted, sizes re-read every pass.
+static const unsigned int OPEN_SEGMENTS = 3;
+
+/// How often the ring thread looks at the directory.
+static const int PASS_INTERVAL_MS = 1000;
+
+/**
+ * Segment number and extension of NNNNN.ext file names, false for anything else.
+ */
+static bool parseName (const char *name, unsigned int *segment, std::string *extension)
+{
+        char *end;
+        unsigned long n = strtoul (name, &end, 10);
+
+        // At least 5 digits, "%05u" runs past them after 99999.
+        if (end - name < 5 || !isdigit (name[0]) || *end != '.') {
+                return false;
+        }
+
+        *segment = n;
+        *extension = end + 1;
+        return *extension == "h264" || *extension == "csv" || *extension == "frames" || *extension == "lock";
+}
+
+SegmentRing::SegmentRing (std::string const &directory, uint64_t quota, uint64_t reserve, int lockBefore, int lockAfter) :
+        directory (directory), quota (quota), reserve (reserve), lockBefore (lockBefore), lockAfter (lockAfter), running (false)
+{
+}
+
+SegmentRing::~SegmentRing ()
+{
+        stop ();
+}
+
+void SegmentRing::start ()
+{
+        running = true;
+        thread = std::thread (&SegmentRing::run, this);
+}
+
+void SegmentRing::stop ()
+{
+        if (!thread.joinable ()) {
+                return;
+        }
+
+        running = false;
+        thread.join ();
+}
+
+void SegmentRing::lock (unsigned int segment, EventType type)
+{
+        if (!locks.push (Lock { segment, type })) {
+                std::cerr << "SegmentRing : lock of segment " << segment << " dropped" << std::endl;
+        }
+}
+
+unsigned int SegmentRing::nextSegment (std::string const &directory)
+{
+        DIR *dir = opendir (directory.c_str ());
+        unsigned int next = 0;
+
+        if (!dir) {
+                return next;
+        }
+
+        while (dirent *entry = readdir (dir)) {
+                unsigned int segment;
+                std::string extension;
+
+                if (parseName (entry->d_name, &segment, &extension) && segment >= next) {
+                        next = segment + 1;
+                }
+        }
+
+        closedir (dir);
+        return next;
+}
+
+void SegmentRing::run ()
+{
+        // Idle I/O class (IOPRIO_CLASS_IDLE << IOPRIO_CLASS_SHIFT) and lowest CPU priority for this thread only.
+        pid_t tid = syscall (SYS_gettid);
+        syscall (SYS_ioprio_set, 1 /* IOPRIO_WHO_PROCESS */, tid, 3 << 13);
+        setpriority (PRIO_PROCESS, tid, 19);
+
+        while (running) {
+                scan ();
+                applyLocks ();
+                collect ();
+
+                for (int ms = 0; running && ms < PASS_INTERVAL_MS; ms += 100) {
+                        std::this_thread::sleep_for (std::chrono::milliseconds (100));
+                }
+        }
+
+        // Events from the last seconds still get their lock files.
+        scan ();
+        applyLocks ();
+}
+
+/**
+ * Refreshes the list of segments on disk. Only the newest ones are stat'ed again, the
+ * others can't change.
+ */
+void SegmentRing::scan ()
+{
+        DIR *dir = opendir (directory.c_str ());
+
+        if (!dir) {
+                std::cerr << "SegmentRing : unable to open " << directory << " : " << strerror (errno) << std::endl;
+                return;
+        }
+
+        std::map <unsigned int, Entry> found;
+
+        while (dirent *entry = readdir (dir)) {
+                unsigned int segment;
+                std::string extension;
+
+                if (parseName (entry->d_name, &segment, &extension)) {
+                        found[segment].locked |= (extension == "lock");
+                }
+        }
+
+        closedir (dir);
+
+        unsigned int newest = (found.empty ()) ? 0 : found.rbegin ()->first;
+
+        for (auto &f : found) {
+                auto known = segments.find (f.first);
+
+                if (known != segments.end () && f.first + OPEN_SEGMENTS <= newest) {
+                        f.second.bytes = known->second.bytes;
+                        continue;
+                }
+
+                // Blocks really taken, the open segment's preallocation included.
+                for (const char *extension : { "h264", "csv", "frames" }) {
+                        struct stat st;
+
+                        if (stat (path (f.first, extension).c_str (), &st) == 0) {
+                                f.second.bytes += uint64_t (st.st_blocks) * 512;
+                        }
+                }
+        }
+
+        segments.swap (found);
+}
+
+void SegmentRing::applyLocks ()
+{
+        Lock lock;
+
+        while (locks.pop (lock)) {
+                std::cerr << "Event : " << eventName (lock.type) << " in segment " << lock.segment << std::endl;
+                pending.push_back (lock);
+        }
+
+        unsigned int newest = (segments.empty ()) ? 0 : segments.rbegin ()->first;
+
+        for (auto i = pending.begin (); i != pending.end ();) {
+                unsigned int first = (i->segment > unsigned (lockBefore)) ? i->segment - lockBefore : 0;
+                unsigned int last = i->segment + lockAfter;
+
+                for (auto s = segments.lower_bound (first); s != segments.end () && s->first <= last; ++s) {
+                        if (s->second.locked) {
+                                continue;
+                        }
+
+                        FILE *file = fopen (path (s->first, "lock").c_str (), "w");
+
+                        if (file) {
+                                fprintf (file, "%s\n", eventName (i->type));
+                                fclose (file);
+                                s->second.locked = true;
+                        }
+                }
+
+                // Done once the last segment to lock exists.
+                i = (newest >= last) ? pending.erase (i) : i + 1;
+        }
+}
+
+/**
+ * Deletes the oldest unlocked segments until both the quota and the reserve are met.
+ */
+void SegmentRing::collect ()
+{
+        if (segments.empty ()) {
+                return;
+        }
+
+        uint64_t used = 0;
+
+        for (auto const &s : segments) {
+                used += s.second.bytes;
+        }
+
+        struct statvfs fs;
+        uint64_t available = (statvfs (directory.c_str (), &fs) == 0) ? uint64_t (fs.f_bavail) * fs.f_frsize : UINT64_MAX;
+        unsigned int newest = segments.rbegin ()->first;
+        auto s = segments.begin ();
+
+        while ((quota && used > quota) || (reserve && available < reserve)) {
+                while (s != segments.end () && s->second.locked) {
+                        ++s;
+                }
+
+                if (s == segments.end () || s->first + OPEN_SEGMENTS > newest) {
+                        if (!warnedFull) {
+                                std::cerr << "SegmentRing : nothing left to delete, " << used << " bytes used, " << available << " free" << std::endl;
+                                warnedFull = true;
+                        }
+
+                        return;
+                }
+
+                unlink (path (s->first, "h264").c_str ());
+                unlink (path (s->first, "csv").c_str ());
+                unlink (path (s->first, "frames").c_str ());
+                used -= s->second.bytes;
+                available += s->second.bytes;
+                s = segments.erase (s);
+        }
+
+        warnedFull = false;
+}
+
+std::string SegmentRing::path (unsigned int segment, const char *extension) const
+{
+        char name[32];
+        snprintf (name, sizeof (name), "/%05u.%s", segment, extension);
+        return directory + name;
+}
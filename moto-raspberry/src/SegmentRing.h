@@ -0,0 +1,88 @@
+/****************************************************************************
+ *                                                                          *
+ *  Author : lukasz.iwaszkiewicz@gmail.com                                  *
+ *  ~~~~~~~~                                                                *
+ *  License : see COPYING file for details.                                 *
+ *  ~~~~~~~~~                                                               *
+ ****************************************************************************/
+
+
+#ifndef SEGMENTRING_H_
+#define SEGMENTRING_H_
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+#include <boost/lockfree/spsc_queue.hpp>
+#include "EventDetector.h"
+
+/**
+ * Black box mode : keeps the segments (NNNNN.h264, NNNNN.csv and NNNNN.frames) within a
+ * quota by deleting the oldest ones, from a background thread with idle CPU and I/O priority.
+ * The capture path never waits for it, and the card never fills up.
+ *
+ * Segments around an event are locked : an NNNNN.lock file (with the event's name in it) is
+ * created next to them, and locked segments are never deleted. The lock files survive
+ * restarts, deleting one by hand makes its segment ordinary again.
+ */
+class SegmentRing {
+public:
+
+        /**
+         * quota : bytes the segments may take, 0 : no limit. reserve : bytes to be left free
+         * on the filesystem. lockBefore, lockAfter : segments locked before and after the one
+         * an event happened in.
+         */
+        SegmentRing (std::string const &directory, uint64_t quota, uint64_t reserve, int lockBefore, int lockAfter);
+        ~SegmentRing ();
+
+        SegmentRing (SegmentRing const &) = delete;
+        SegmentRing &operator= (SegmentRing const &) = delete;
+
+        void start ();
+        void stop ();
+
+        /// Telemetry thread : an event happened during segment. Lock free.
+        void lock (unsigned int segment, EventType type);
+
+        /// One past the highest segment number in directory, so a new run doesn't overwrite the last one's.
+        static unsigned int nextSegment (std::string const &directory);
+
+private:
+
+        struct Lock {
+                unsigned int segment;
+                EventType type;
+        };
+
+        struct Entry {
+                uint64_t bytes = 0;
+                bool locked = false;
+        };
+
+        void run ();
+        void scan ();
+        void applyLocks ();
+        void collect ();
+        std::string path (unsigned int segment, const char *extension) const;
+
+        std::string directory;
+        uint64_t quota;
+        uint64_t reserve;
+        int lockBefore;
+        int lockAfter;
+
+        boost::lockfree::spsc_queue <Lock, boost::lockfree::capacity <64>> locks;
+        std::atomic <bool> running;
+        std::thread thread;
+
+        // Ring thread only.
+        std::map <unsigned int, Entry> segments;
+        std::vector <Lock> pending;     /// Events whose later segments may not exist yet.
+        bool warnedFull = false;
+};
+
+#endif /* SEGMENTRING_H_ */
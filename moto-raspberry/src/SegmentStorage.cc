@@ -0,0 +1,104 @@
+/****************************************************************************
+ *                                                                          *
+ *  Author : lukasz.iwaszkiewicz@gmail.com                                  *
+ *  ~~~~~~~~                                                                *
+ *  License : see COPYING file for details.                                 *
+ *  ~~~~~~~~~                                                               *
+ ****************************************************************************/
+
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <linux/falloc.h>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include "SegmentStorage.h"
+
+SegmentStorage::SegmentStorage (std::string const &directory, uint64_t expectedSize) :
+        directory (directory), expected (expectedSize), preallocate (expectedSize > 0)
+{
+        std::string index = directory + "/segments.idx";
+        indexFd = ::open (index.c_str (), O_WRONLY | O_CREAT | O_APPEND, 0644);
+
+        if (indexFd < 0) {
+                std::cerr << "SegmentStorage : unable to open " << index << " : " << strerror (errno) << std::endl;
+        }
+}
+
+SegmentStorage::~SegmentStorage ()
+{
+        close ();
+
+        if (indexFd >= 0) {
+                ::close (indexFd);
+        }
+}
+
+bool SegmentStorage::open (int segment)
+{
+        close ();
+
+        char filename[32];
+        snprintf (filename, sizeof (filename), "/%05d.h264", segment);
+        std::string path = directory + filename;
+        fd = ::open (path.c_str (), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+        if (fd < 0) {
+                std::cerr << "SegmentStorage : unable to open " << path << " : " << strerror (errno) << std::endl;
+                return false;
+        }
+
+        this->segment = segment;
+        written = 0;
+
+        if (preallocate && fallocate (fd, FALLOC_FL_KEEP_SIZE, 0, expected) != 0) {
+                // Old kernels (vfat before 4.19) : carry on with plain appends.
+                std::cerr << "SegmentStorage : no preallocation on " << directory << " : " << strerror (errno) << std::endl;
+                preallocate = false;
+        }
+
+        return true;
+}
+
+ssize_t SegmentStorage::write (iovec const *parts, int count)
+{
+        ssize_t n = writev (fd, parts, count);
+
+        if (n > 0) {
+                written += n;
+        }
+
+        return n;
+}
+
+void SegmentStorage::close ()
+{
+        if (fd < 0) {
+                return;
+        }
+
+        // The size is already right, but truncating frees the blocks reserved past it.
+        if (ftruncate (fd, written) != 0) {
+                std::cerr << "SegmentStorage : truncate failed : " << strerror (errno) << std::endl;
+        }
+
+        ::close (fd);
+        fd = -1;
+
+        if (indexFd >= 0) {
+                char line[48];
+                int n = snprintf (line, sizeof (line), "%05d %llu\n", segment, (unsigned long long)written);
+
+                if (::write (indexFd, line, n) != n) {
+                        std::cerr << "SegmentStorage : index write failed : " << strerror (errno) << std::endl;
+                }
+        }
+}
+
+uint64_t SegmentStorage::expectedSize (int bitrate, int durationMs)
+{
+        // Keyframes and scene changes overshoot the average, 25% covers them.
+        return uint64_t (bitrate) / 8 * durationMs / 1000 * 5 / 4;
+}
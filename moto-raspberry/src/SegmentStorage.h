@@ -0,0 +1,72 @@
+/****************************************************************************
+ *                                                                          *
+ *  Author : lukasz.iwaszkiewicz@gmail.com                                  *
+ *  ~~~~~~~~                                                                *
+ *  License : see COPYING file for details.                                 *
+ *  ~~~~~~~~~                                                               *
+ ****************************************************************************/
+
+
+#ifndef SEGMENTSTORAGE_H_
+#define SEGMENTSTORAGE_H_
+
+#include <sys/uio.h>
+#include <cstdint>
+#include <string>
+
+/**
+ * NNNNN.h264 segment files on the card, laid out so they don't fragment.
+ *
+ * Every segment gets its expected size reserved up front (fallocate, FALLOC_FL_KEEP_SIZE :
+ * the blocks are allocated as one run, nothing is zeroed and the file size still grows with
+ * the writes), is then written strictly sequentially, and is truncated to what was written
+ * when closed, which gives the unused reservation back. Growing a file by small appends
+ * instead makes ext4 and FAT allocate it piecemeal, interleaved with the telemetry files,
+ * and update the metadata on every append.
+ *
+ * Closed segments are recorded in segments.idx, one "NNNNN LENGTH" line each. The index is
+ * appended to across runs (segment numbers carry on, see SegmentRing::nextSegment), so
+ * the last line of a number counts.
+ *
+ * Not thread safe, SegmentWriter uses it from its own thread.
+ */
+class SegmentStorage {
+public:
+
+        /**
+         * expectedSize : bytes reserved for every segment, 0 disables the preallocation. Best a
+         * bit over the real segment size, the excess is released on close.
+         */
+        SegmentStorage (std::string const &directory = ".", uint64_t expectedSize = 0);
+        ~SegmentStorage ();
+
+        SegmentStorage (SegmentStorage const &) = delete;
+        SegmentStorage &operator= (SegmentStorage const &) = delete;
+
+        /// Closes the current segment and starts NNNNN.h264 (segment). False if it can't be created.
+        bool open (int segment);
+
+        /// Appends to the current segment. Same as writev.
+        ssize_t write (iovec const *parts, int count);
+
+        /// Truncates the current segment to its length and records it in the index.
+        void close ();
+
+        bool isOpen () const { return fd >= 0; }
+        uint64_t length () const { return written; }
+
+        /// Expected size for segments of durationMs at bitrate [bit/s], with some headroom.
+        static uint64_t expectedSize (int bitrate, int durationMs);
+
+private:
+
+        std::string directory;
+        uint64_t expected;
+        bool preallocate;
+        int fd = -1;
+        int indexFd = -1;
+        int segment = -1;
+        uint64_t written = 0;
+};
+
+#endif /* SEGMENTSTORAGE_H_ */
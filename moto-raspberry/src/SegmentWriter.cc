@@ -0,0 +1,269 @@
+/****************************************************************************
+ *                                                                          *
+ *  Author : lukasz.iwaszkiewicz@gmail.com                                  *
+ *  ~~~~~~~~                                                                *
+ *  License : see COPYING file for details.                                 *
+ *  ~~~~~~~~~                                                               *
+ ****************************************************************************/
+
+
+#include <unistd.h>
+#include <sys/uio.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include "SegmentWriter.h"
+
+SegmentWriter::SegmentWriter (SegmentStorage *storage, size_t poolSize, size_t minWrite, size_t maxWrite, int flushIntervalMs,
+                              EventRecording *events) :
+        storage (storage), minWrite (minWrite), maxWrite (maxWrite), flushIntervalMs (flushIntervalMs), events (events), droppedPayloads (0),
+        tail (0), running (false), writeFailed (false)
+{
+        size_t page = sysconf (_SC_PAGESIZE);
+        this->poolSize = (poolSize + page - 1) / page * page;
+
+        if (posix_memalign ((void **)&pool, page, this->poolSize) != 0) {
+                std::cerr << "SegmentWriter : unable to allocate " << this->poolSize << " bytes" << std::endl;
+                pool = 0;
+                this->poolSize = 0;
+        }
+        else {
+                // Touch every page now, not in the capture path.
+                memset (pool, 0, this->poolSize);
+        }
+
+        sem_init (&wakeup, 0, 0);
+}
+
+SegmentWriter::~SegmentWriter ()
+{
+        stop ();
+        sem_destroy (&wakeup);
+        free (pool);
+}
+
+void SegmentWriter::start (ThreadPolicy const &policy)
+{
+        this->policy = policy;
+        running = true;
+        thread = std::thread (&SegmentWriter::run, this);
+}
+
+void SegmentWriter::stop ()
+{
+        if (!thread.joinable ()) {
+                return;
+        }
+
+        running = false;
+        sem_post (&wakeup);
+        thread.join ();
+}
+
+bool SegmentWriter::push (uint8_t const *data, size_t length, int segment, uint64_t nowNs)
+{
+        if (length > poolSize - (head - tail.load (std::memory_order_acquire))) {
+                ++droppedPayloads;
+                return false;
+        }
+
+        size_t offset = head % poolSize;
+        size_t first = std::min (length, poolSize - offset);
+        memcpy (pool + offset, data, first);
+        memcpy (pool, data + first, length - first);
+
+        if (!chunks.push (Chunk { head, uint32_t (length), int32_t (segment), nowNs })) {
+                ++droppedPayloads;
+                return false;
+        }
+
+        head += length;
+        sem_post (&wakeup);
+        return true;
+}
+
+void SegmentWriter::run ()
+{
+        applyThreadPolicy (policy, "segments");
+
+        while (true) {
+                timespec deadline;
+                clock_gettime (CLOCK_REALTIME, &deadline);
+                deadline.tv_nsec += flushIntervalMs % 1000 * 1000000L;
+                deadline.tv_sec += flushIntervalMs / 1000 + deadline.tv_nsec / 1000000000L;
+                deadline.tv_nsec %= 1000000000L;
+
+                bool timedOut = sem_timedwait (&wakeup, &deadline) != 0 && errno == ETIMEDOUT;
+                bool stopping = !running;
+                bool first = true;
+                Chunk chunk;
+
+                while (chunks.pop (chunk)) {
+                        if (first) {
+                                loop.woke (chunk.timestamp, monotonicNs ());
+                                first = false;
+                        }
+
+                        if (chunk.segment >= 0) {
+                                startSegment (chunk);
+                        }
+
+                        // Chunks are contiguous in the ring, so pending data is always one range.
+                        if (pendingBegin == pendingEnd) {
+                                pendingBegin = pendingEnd = chunk.position;
+                        }
+
+                        pendingEnd += chunk.length;
+
+                        if (!holding && pendingEnd - pendingBegin >= maxWrite) {
+                                writePending ();
+                        }
+                }
+
+                if (holding) {
+                        // Held data is dropped at stop, nothing asked for it.
+                        if (events->recording (monotonicNs ())) {
+                                flushHeld ();
+                        }
+                        else {
+                                trimHeld (monotonicNs ());
+                        }
+                }
+
+                if (!holding && (pendingEnd - pendingBegin >= minWrite || timedOut || stopping)) {
+                        writePending ();
+                }
+
+                if (stopping) {
+                        break;
+                }
+        }
+
+        rotate (-1);
+}
+
+/**
+ * Segment starts : the file is opened if the segment is recorded, or the segment is held.
+ */
+void SegmentWriter::startSegment (Chunk const &chunk)
+{
+        if (!holding && (!events || events->recording (chunk.timestamp))) {
+                writePending ();
+                rotate (chunk.segment);
+                return;
+        }
+
+        // Recording window over (or event only recording just started) : the last file ends here.
+        if (!holding) {
+                writePending ();
+                rotate (-1);
+                holding = true;
+        }
+
+        held.push_back (Held { chunk.position, chunk.segment, chunk.timestamp });
+}
+
+/**
+ * Writes out the held segments, each to its own file, and goes on recording the newest.
+ */
+void SegmentWriter::flushHeld ()
+{
+        for (size_t i = 0; i < held.size (); ++i) {
+                uint64_t end = (i + 1 < held.size ()) ? held[i + 1].position : pendingEnd;
+                rotate (held[i].segment);
+
+                for (uint64_t p = held[i].position; p < end; p += maxWrite) {
+                        writeRange (p, std::min (end, p + maxWrite));
+                }
+        }
+
+        if (!held.empty ()) {
+                pendingBegin = pendingEnd;
+        }
+
+        held.clear ();
+        holding = false;
+}
+
+/**
+ * Lets the oldest held segments go : once the ones after them cover the pre event time,
+ * or to make room. The last one goes too if it alone fills the ring, the data up to the
+ * next segment is useless without its IDR then.
+ */
+void SegmentWriter::trimHeld (uint64_t nowNs)
+{
+        size_t limit = poolSize - poolSize / 8;
+
+        while (!held.empty ()) {
+                bool full = pendingEnd - held.front ().position > limit;
+                bool covered = held.size () > 1 && nowNs - held[1].startNs >= events->preEventNs ();
+
+                if (!full && !covered) {
+                        break;
+                }
+
+                held.pop_front ();
+        }
+
+        pendingBegin = (held.empty ()) ? pendingEnd : held.front ().position;
+        tail.store (pendingBegin, std::memory_order_release);
+        events->setOldestHeld ((held.empty ()) ? -1 : held.front ().segment);
+}
+
+void SegmentWriter::writePending ()
+{
+        writeRange (pendingBegin, pendingEnd);
+        pendingBegin = pendingEnd;
+}
+
+/**
+ * Writes [begin, end) of the ring (one writev, two parts if it wraps around the ring's end)
+ * and gives the space back to the producer.
+ */
+void SegmentWriter::writeRange (uint64_t begin, uint64_t end)
+{
+        size_t length = end - begin;
+
+        if (!length) {
+                return;
+        }
+
+        if (storage->isOpen ()) {
+                size_t offset = begin % poolSize;
+                size_t first = std::min (length, poolSize - offset);
+                iovec parts[2] = { { pool + offset, first }, { pool, length - first } };
+                uint64_t start = monotonicNs ();
+                ssize_t written = storage->write (parts, (first < length) ? 2 : 1);
+                writeUs.add ((monotonicNs () - start) / 1000);
+
+                if (written != ssize_t (length)) {
+                        std::cerr << "SegmentWriter : write failed : " << strerror (errno) << std::endl;
+                        writeFailed = true;
+                }
+        }
+
+        tail.store (end, std::memory_order_release);
+}
+
+/**
+ * Closes the current segment file and, if segment >= 0, opens the next one.
+ */
+void SegmentWriter::rotate (int segment)
+{
+        uint64_t begin = monotonicNs ();
+
+        if (segment < 0) {
+                storage->close ();
+                return;
+        }
+
+        if (!storage->open (segment)) {
+                writeFailed = true;
+        }
+
+        rotationUs.add ((monotonicNs () - begin) / 1000);
+        std::cerr << "New segment : " << segment << std::endl;
+}
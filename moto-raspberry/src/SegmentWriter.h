@@ -0,0 +1,139 @@
+/****************************************************************************
+ *                                                                          *
+ *  Author : lukasz.iwaszkiewicz@gmail.com                                  *
+ *  ~~~~~~~~                                                                *
+ *  License : see COPYING file for details.                                 *
+ *  ~~~~~~~~~                                                               *
+ ****************************************************************************/
+
+
+#ifndef SEGMENTWRITER_H_
+#define SEGMENTWRITER_H_
+
+#include <semaphore.h>
+#include <atomic>
+#include <deque>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+#include <boost/lockfree/spsc_queue.hpp>
+#include "Histogram.h"
+#include "SegmentStorage.h"
+#include "EventRecording.h"
+#include "Realtime.h"
+
+/**
+ * Writes encoded video into NNNNN.h264 segment files from its own thread, so SD card
+ * latency never holds up the encoder callback.
+ *
+ * The callback copies each payload into a preallocated, page aligned ring (push : no
+ * allocation, no locks, no syscalls but a sem_post) and the writer thread writes whatever
+ * has accumulated in large sequential writes. Opening and closing the segment files happens
+ * in the writer thread too, through storage (SegmentStorage).
+ *
+ * With events (EventRecording), segments outside the recording window are held in the ring
+ * instead : the oldest whole segments are let go once the newer ones cover preEventMs, or
+ * when the ring is 7/8 full, so what is held always starts with an IDR. RAM use is fixed by
+ * poolSize, which has to fit preEventMs of video plus a segment. On an event the held
+ * segments are written out, oldest first, and recording goes on live.
+ */
+class SegmentWriter {
+public:
+
+        /**
+         * storage : where the segments go, only touched from the writer thread. poolSize : ring
+         * capacity, rounded up to whole pages, must hold the encoder output for as long as the
+         * card may stall. Writes are coalesced up to maxWrite bytes, and issued once minWrite
+         * bytes are pending or flushIntervalMs has passed. events : event only recording, 0 :
+         * record everything.
+         */
+        SegmentWriter (SegmentStorage *storage, size_t poolSize = 8 << 20, size_t minWrite = 256 << 10, size_t maxWrite = 1 << 20,
+                       int flushIntervalMs = 200, EventRecording *events = 0);
+        ~SegmentWriter ();
+
+        SegmentWriter (SegmentWriter const &) = delete;
+        SegmentWriter &operator= (SegmentWriter const &) = delete;
+
+        /// policy : the writer thread's, it applies it itself.
+        void start (ThreadPolicy const &policy = ThreadPolicy ());
+
+        /// Writes out everything pushed so far, closes the file and joins the thread.
+        void stop ();
+
+        /**
+         * Encoder callback side. Copies length bytes into the ring. If segment >= 0, file
+         * NNNNN.h264 (segment) is started with them, at CLOCK_MONOTONIC nowNs. Returns false if
+         * the ring is full (the payload is dropped).
+         */
+        bool push (uint8_t const *data, size_t length, int segment, uint64_t nowNs);
+
+        /// Bytes push can take now. Encoder callback side.
+        size_t room () const { return poolSize - (head - tail.load (std::memory_order_acquire)); }
+
+        /// A write failed (card full, removed...).
+        bool failed () const { return writeFailed; }
+
+        uint64_t dropped () const { return droppedPayloads; }
+
+        /// Writer thread statistics, readable as it runs (see Histogram).
+        Histogram const &writeLatency () const { return writeUs; }
+        Histogram const &rotationLatency () const { return rotationUs; }
+
+        /// Wake-up : from a push to the writer thread picking it up, for the first push of every wait.
+        LoopStats const &loopStats () const { return loop; }
+
+private:
+
+        struct Chunk {
+                uint64_t position;      /// In the ring, counted from the start (not wrapped).
+                uint32_t length;
+                int32_t segment;        /// >= 0 : starts this segment.
+                uint64_t timestamp;     /// Pushed at, the segment's start if it starts one.
+        };
+
+        /// Segment held in the ring, waiting for an event.
+        struct Held {
+                uint64_t position;
+                int segment;
+                uint64_t startNs;
+        };
+
+        void run ();
+        void startSegment (Chunk const &chunk);
+        void writePending ();
+        void writeRange (uint64_t begin, uint64_t end);
+        void flushHeld ();
+        void trimHeld (uint64_t nowNs);
+        void rotate (int segment);
+
+        SegmentStorage *storage;
+        uint8_t *pool = 0;
+        size_t poolSize;
+        size_t minWrite;
+        size_t maxWrite;
+        int flushIntervalMs;
+        EventRecording *events;
+
+        // Producer (encoder callback) side.
+        uint64_t head = 0;
+        std::atomic <uint64_t> droppedPayloads;
+
+        // Consumer (writer thread) side.
+        std::atomic <uint64_t> tail;
+        uint64_t pendingBegin = 0;
+        uint64_t pendingEnd = 0;
+        bool holding = false;
+        std::deque <Held> held;
+        Histogram writeUs;
+        Histogram rotationUs;
+        LoopStats loop;
+
+        boost::lockfree::spsc_queue <Chunk, boost::lockfree::capacity <1024>> chunks;
+        sem_t wakeup;
+        std::atomic <bool> running;
+        std::atomic <bool> writeFailed;
+        std::thread thread;
+        ThreadPolicy policy;
+};
+
+#endif /* SEGMENTWRITER_H_ */
@@ -0,0 +1,53 @@
+/****************************************************************************
+ *                                                                          *
+ *  Author : lukasz.iwaszkiewicz@gmail.com                                  *
+ *  ~~~~~~~~                                                                *
+ *  License : see COPYING file for details.                                 *
+ *  ~~~~~~~~~                                                               *
+ ****************************************************************************/
+
+
+#include "Segmenter.h"
+
+Segmenter::Segmenter (int targetDurationMs, uint64_t targetSize, unsigned int firstSegment) :
+        targetNs (uint64_t (targetDurationMs) * 1000000ULL), targetSize (targetSize), segment (firstSegment), wantKeyframe (false)
+{
+}
+
+int Segmenter::next (uint32_t length, bool config, bool keyframe, uint64_t streamNs)
+{
+        bool due = !started || (targetNs && streamNs - startNs >= targetNs) || (targetSize && bytes >= targetSize);
+        int newSegment = -1;
+
+        // Without inline headers the IDR comes alone, split there then.
+        if (due && (config || keyframe) && !afterConfig) {
+                newSegment = segment++;
+                previousStarted = started;
+                previousStartNs = startNs;
+                previousBytes = bytes;
+                started = true;
+                startNs = streamNs;
+                bytes = 0;
+                requested = false;
+        }
+        else if (due && !requested) {
+                requested = true;
+                wantKeyframe = true;
+        }
+
+        afterConfig = config;
+        bytes += length;
+        return newSegment;
+}
+
+void Segmenter::dropped ()
+{
+        // Still due : the next IDR (or SPS/PPS) starts it, under the same number.
+        --segment;
+        started = previousStarted;
+        startNs = previousStartNs;
+        bytes = previousBytes;
+        afterConfig = false;
+        requested = true;
+        wantKeyframe = true;
+}
@@ -0,0 +1,65 @@
+/****************************************************************************
+ *                                                                          *
+ *  Author : lukasz.iwaszkiewicz@gmail.com                                  *
+ *  ~~~~~~~~                                                                *
+ *  License : see COPYING file for details.                                 *
+ *  ~~~~~~~~~                                                               *
+ ****************************************************************************/
+
+
+#ifndef SEGMENTER_H_
+#define SEGMENTER_H_
+
+#include <atomic>
+#include <cstdint>
+
+/**
+ * Decides which encoder buffer starts a new segment, so that every segment decodes on its
+ * own : a segment ends once it is long enough (targetDurationMs) or big enough
+ * (targetSize), but the next one starts only at an IDR frame, together with the SPS/PPS
+ * buffer the encoder puts in front of it (inline headers).
+ *
+ * The encoder callback calls next for every buffer. When a segment is due and no IDR comes,
+ * keyframeWanted turns true once, for the main thread to ask the encoder for one. If the
+ * buffer a segment was to start with is dropped (dropped), the start moves to the next IDR.
+ */
+class Segmenter {
+public:
+
+        /// 0 disables either limit. Segments are numbered from firstSegment.
+        Segmenter (int targetDurationMs, uint64_t targetSize, unsigned int firstSegment = 0);
+
+        /**
+         * length bytes, config : SPS/PPS (CAPTURE_CONFIG), keyframe : IDR (CAPTURE_KEYFRAME),
+         * streamNs : the stream's clock (its PTS), so a replay faster than real time rotates
+         * the same. Returns the number of the segment this buffer starts, or -1 if it continues
+         * the current one.
+         */
+        int next (uint32_t length, bool config, bool keyframe, uint64_t streamNs);
+
+        /// The buffer next has just started a segment with was not recorded : undone, and an IDR is asked for.
+        void dropped ();
+
+        /// True (once per segment) when the current segment is due and waits for an IDR. Any thread.
+        bool keyframeWanted () { return wantKeyframe.exchange (false); }
+
+private:
+
+        uint64_t targetNs;
+        uint64_t targetSize;
+
+        int segment;
+        bool started = false;
+        uint64_t startNs = 0;
+        uint64_t bytes = 0;
+        bool afterConfig = false;       /// Last buffer was SPS/PPS, the IDR which follows belongs with it.
+        bool requested = false;
+        std::atomic <bool> wantKeyframe;
+
+        // Before the last segment start, for dropped.
+        bool previousStarted = false;
+        uint64_t previousStartNs = 0;
+        uint64_t previousBytes = 0;
+};
+
+#endif /* SEGMENTER_H_ */
@@ -1,19 +1,23 @@
 #include <string.h>
+#include <errno.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <termios.h>
+#include <sys/epoll.h>
 #include <inttypes.h>
 #include <iostream>
 #include <algorithm>
 #include "Shield.h"
+#include "Histogram.h"
 
 const char *PORT = "/dev/ttyAMA0";
 
 std::ostream &operator<< (std::ostream &o, Frame const &f)
 {
-        o << "SPEED=" << f.velocity <<
+        o << "T=" << f.timestamp / 1000 <<
+             " us, SPEED=" << f.velocity <<
              " km/h, RPM=" << f.rpm <<
              " rpm, ENGINE=" << f. engineTemp <<
              " \u2103, AIR=" << f.airTemp <<
@@ -21,11 +25,28 @@ std::ostream &operator<< (std::ostream &o, Frame const &f)
              ", RB=" << f.rearBrake <<
              ", LEFT=" << f.leftTurn <<
              ", RIGHT=" << f.rightTurn <<
-             ", PARKL=" << f.parkingLight;
+             ", PARKL=" << f.parkingLight <<
+             ", EVENT=" << f.eventButton;
         return o;
 }
 
-Shield::Shield (std::string const &port)
+/**
+ * termios constant for a baud rate, B0 if it is not a standard one.
+ */
+static speed_t baudConstant (int baud)
+{
+        switch (baud) {
+        case 9600:      return B9600;
+        case 19200:     return B19200;
+        case 38400:     return B38400;
+        case 57600:     return B57600;
+        case 115200:    return B115200;
+        case 230400:    return B230400;
+        default:        return B0;
+        }
+}
+
+Shield::Shield (std::string const &port, int baud, ShieldCounters *counters) : counters (counters)
 {
 #if 0
         std::cerr << "Shield::Shield : starting serial port communication..." << std::endl;
@@ -40,66 +61,204 @@ Shield::Shield (std::string const &port)
         tio.c_cc[VMIN] = 1;
         tio.c_cc[VTIME] = 2;
 
-        ttyFd = open(PORT, O_RDONLY | O_SYNC);
-        cfsetispeed(&tio, B38400);
+        ttyFd = open(port.c_str (), O_RDONLY | O_SYNC | O_NOCTTY | O_NONBLOCK);
+
+        if (ttyFd < 0) {
+                std::cerr << "Shield::Shield : can't open " << port << " : " << strerror (errno) << std::endl;
+                return;
+        }
+
+        if (baudConstant (baud) == B0) {
+                std::cerr << "Shield::Shield : unsupported baud rate " << baud << ", using 38400" << std::endl;
+                baud = 38400;
+        }
+
+        cfsetispeed(&tio, baudConstant (baud));
+
+        // Not fatal : a pipe or a file replays as well.
+        if (tcsetattr(ttyFd, TCSANOW, &tio) != 0) {
+                std::cerr << "Shield::Shield : can't set up " << port << " : " << strerror (errno) << std::endl;
+        }
+
+        // 8n1 : 10 bits on the wire per byte.
+        byteTime = 10 * 1000000000ULL / baud;
+
+        epollFd = epoll_create1 (0);
+        epoll_event event = {};
+        event.events = EPOLLIN;
+        event.data.fd = ttyFd;
 
-        tcsetattr(ttyFd, TCSANOW, &tio);
+        if (epollFd < 0 || epoll_ctl (epollFd, EPOLL_CTL_ADD, ttyFd, &event) != 0) {
+                std::cerr << "Shield::Shield : can't poll " << port << " : " << strerror (errno) << std::endl;
+                close ();
+        }
 }
 
 Shield::~Shield ()
 {
-        close(ttyFd);
+        close ();
 }
 
-Frame Shield::read ()
+void Shield::close ()
 {
-        uint8_t c;
-        boost::circular_buffer<uint8_t> buffer (FRAME_SIZE);
-        Frame frame;
+        if (epollFd >= 0) {
+                ::close (epollFd);
+                epollFd = -1;
+        }
+
+        if (ttyFd >= 0) {
+                ::close (ttyFd);
+                ttyFd = -1;
+        }
+}
+
+bool Shield::read (Frame *frame)
+{
+        while (true) {
+                while (rxPos < rxLen) {
+                        // Bytes came one after another, the last one finishing at rxTime.
+                        uint64_t arrival = rxTime - (rxLen - rxPos) * byteTime;
+
+                        if (consume (rx[rxPos++], arrival)) {
+                                *frame = decode ();
+                                return true;
+                        }
+                }
 
-        do {
-                if (::read (ttyFd, &c, 1) > 0) {
-                        buffer.push_back (c);
+                if (!receive ()) {
+                        return false;
                 }
         }
-        while (!validateBuffer (buffer));
+}
 
-        frame.velocity = ((buffer[BUF_VELOCITY_MSB] << 8) | (buffer[BUF_VELOCITY_LSB])) * VELOCITY_FACTOR;
-        frame.rpm = buffer[BUF_RPM] * RPM_FACTOR;
-        frame.engineTemp = computeTemp (buffer[BUF_ENGINE_TEMP]);
-        frame.airTemp = buffer[BUF_AIR_TEMP];
-        frame.frontBrake = buffer[BUF_GPIO] & (1 << GPIO_FRONT_BRAKE);
-        frame.rearBrake = buffer[BUF_GPIO] & (1 << GPIO_REAR_BRAKE);
-        frame.leftTurn = buffer[BUF_GPIO] & (1 << GPIO_LEFT_TURN);
-        frame.rightTurn = buffer[BUF_GPIO] & (1 << GPIO_RIGHT_TURN);
-        frame.parkingLight = buffer[BUF_GPIO] & (1 << GPIO_PARKING_LIGHT);
+/**
+ * Waits for bytes and reads all of them that are there. False, with the port closed, if it
+ * hung up or failed : epoll would report it ready for good, and the caller would spin.
+ */
+bool Shield::receive ()
+{
+        epoll_event event;
+        rxPos = rxLen = 0;
 
-        return frame;
+        if (epollFd < 0) {
+                return false;
+        }
+
+        int n = epoll_wait (epollFd, &event, 1, -1);
+
+        if (n < 0 && errno == EINTR) {
+                return true;
+        }
+
+        if (n < 1) {
+                std::cerr << "Shield::receive : epoll_wait failed : " << strerror (errno) << std::endl;
+                close ();
+                return false;
+        }
+
+        rxTime = monotonicNs ();
+        ssize_t got = ::read (ttyFd, rx, RX_BUFFER_SIZE);
+
+        if (got > 0) {
+                rxLen = got;
+
+                if (counters) {
+                        ShieldCounters::bump (counters->bytes, rxLen);
+                }
+
+                return true;
+        }
+
+        // Woken up for nothing.
+        if (got < 0 && (errno == EAGAIN || errno == EINTR) && !(event.events & (EPOLLHUP | EPOLLERR))) {
+                return true;
+        }
+
+        if (got == 0 || (event.events & (EPOLLHUP | EPOLLERR))) {
+                std::cerr << "Shield::receive : port hung up" << std::endl;
+        }
+        else {
+                std::cerr << "Shield::receive : read failed : " << strerror (errno) << std::endl;
+        }
+
+        close ();
+        return false;
 }
 
-bool Shield::validateBuffer (InputData const &d)
+/**
+ * Feeds one byte to the sync state machine. Returns true when frameBytes holds a complete
+ * frame : the command byte, 6 data bytes and their checksum (sum of the data bytes).
+ */
+bool Shield::consume (uint8_t c, uint64_t timestamp)
 {
-#if 0
-        std::cerr << "Shield::validateBuffer ";
+        if (frameLen == 0) {
+                if (c == SHIELD_COMMAND_BYTE) {
+                        frameBytes[frameLen++] = c;
+                        frameSum = 0;
+                        frameTime = timestamp;
+                }
 
-        for (uint8_t b : d) {
-                std::cerr << std::hex << (int)b << ", ";
+                return false;
         }
 
-        std::cerr << "F=" << d.full () << ", FR=" << std::hex << (int)d.front ();
+        if (frameLen < FRAME_SIZE - 1) {
+                frameBytes[frameLen++] = c;
+                frameSum += c;
+                return false;
+        }
+
+        if (frameSum == c) {
+                frameBytes[frameLen] = c;
+                frameLen = 0;
 
-        if (d.full ()) {
-                std::cerr << ", AC=" << std::accumulate (d.begin () + 1, d.end () - 1, 0) << ", B=" << std::hex << (int)d.back ();
+                if (counters) {
+                        ShieldCounters::bump (counters->frames);
+                }
+
+                return true;
         }
 
-        std::cerr << std::endl;
-#endif
+        if (counters) {
+                ShieldCounters::bump (counters->checksumRejects);
+        }
+
+        // Bad checksum, so the start byte was a false one. Look for the next one among the bytes
+        // already received (the same bytes a sliding window would have tried). They are one byte
+        // short of a frame, so none can complete here.
+        uint8_t tail[FRAME_SIZE - 1];
+        std::copy (frameBytes + 1, frameBytes + FRAME_SIZE - 1, tail);
+        tail[FRAME_SIZE - 2] = c;
+        uint64_t tailTime = frameTime + byteTime;
+        frameLen = 0;
+
+        for (unsigned int i = 0; i < FRAME_SIZE - 1; ++i) {
+                consume (tail[i], tailTime + i * byteTime);
+        }
+
+        return false;
+}
+
+Frame Shield::decode () const
+{
+        uint8_t const *buffer = frameBytes;
+        Frame frame;
+
+        frame.timestamp = frameTime;
+        frame.velocity = ((buffer[BUF_VELOCITY_MSB] << 8) | (buffer[BUF_VELOCITY_LSB])) * VELOCITY_FACTOR;
+        frame.rpm = buffer[BUF_RPM] * RPM_FACTOR;
+        frame.engineTemp = computeTemp (buffer[BUF_ENGINE_TEMP]);
+        frame.airTemp = buffer[BUF_AIR_TEMP];
+        frame.frontBrake = buffer[BUF_GPIO] & (1 << GPIO_FRONT_BRAKE);
+        frame.rearBrake = buffer[BUF_GPIO] & (1 << GPIO_REAR_BRAKE);
+        frame.leftTurn = buffer[BUF_GPIO] & (1 << GPIO_LEFT_TURN);
+        frame.rightTurn = buffer[BUF_GPIO] & (1 << GPIO_RIGHT_TURN);
+        frame.parkingLight = buffer[BUF_GPIO] & (1 << GPIO_PARKING_LIGHT);
+        frame.eventButton = buffer[BUF_GPIO] & (1 << GPIO_EVENT_BUTTON);
 
-        // Computer sum of buffer bytes ommiting the first and last ones (COMMAND, and checksum respectively).
-        return d.full () && d.front () == SHIELD_COMMAND_BYTE & static_cast <uint8_t> (std::accumulate (d.begin () + 1, d.end () - 1, 0)) == d.back ();
+        return frame;
 }
 
-float Shield::computeTemp (uint8_t temp)
+float Shield::computeTemp (uint8_t temp) const
 {
         // Empirical equation. Found by my wife with excel.
         return 0.95515 * temp - 25.724;
@@ -9,8 +9,11 @@
 #ifndef SHIELD_H_
 #define SHIELD_H_
 
+#include <atomic>
 #include <ostream>
-#include <boost/circular_buffer.hpp>
+#include <string>
+#include <cstddef>
+#include <cstdint>
 
 extern const char *PORT;
 
@@ -18,6 +21,7 @@ extern const char *PORT;
  * Data frame from AVR shield.
  */
 struct Frame {
+        uint64_t timestamp = 0;         /// CLOCK_MONOTONIC [ns] at which the first byte of the frame started to arrive.
         float velocity = 0;
         float rpm = 0;
         float engineTemp = 0;
@@ -27,31 +31,73 @@ struct Frame {
         bool leftTurn = false;
         bool rightTurn = false;
         bool parkingLight = false;
+        bool eventButton = false;       /// "Keep this" button on the handlebar, locks the segments around.
 };
 
 extern std::ostream &operator<< (std::ostream &o, Frame const &f);
 
+/**
+ * What the shield reader decoded. Added to by its thread only, readable from any.
+ */
+struct ShieldCounters {
+        std::atomic <uint64_t> bytes {0};               /// Read from the tty.
+        std::atomic <uint64_t> frames {0};              /// Decoded.
+        std::atomic <uint64_t> checksumRejects {0};     /// Candidate frames with a bad checksum : noise, or a false start byte.
+
+        static void bump (std::atomic <uint64_t> &counter, uint64_t by = 1) { counter.store (counter.load (std::memory_order_relaxed) + by, std::memory_order_relaxed); }
+};
+
 /**
  * AVR shield on top of the RasPI.
  */
 class Shield {
 public:
 
-        Shield (std::string const &port);
+        /// baud : one of the standard rates, 38400 is what the shield firmware uses. counters : 0, or kept up to date.
+        Shield (std::string const &port, int baud = 38400, ShieldCounters *counters = 0);
         virtual ~Shield ();
 
-        Frame read ();
+        /// False if the port could not be opened (the constructor said why).
+        bool isOpen () const { return epollFd >= 0; }
+
+        /**
+         * Blocks (in epoll_wait) until the next valid frame arrives. Reads as many bytes as
+         * the tty has per syscall, and keeps the unconsumed ones for the next call. False
+         * once the port hung up or failed (said why, closed) : open it anew.
+         */
+        bool read (Frame *frame);
 
 private:
 
-        typedef boost::circular_buffer<uint8_t> InputData;
-        bool validateBuffer (InputData const &d);
-        float computeTemp (uint8_t temp);
+        bool receive ();
+        void close ();
+        bool consume (uint8_t c, uint64_t timestamp);
+        Frame decode () const;
+        float computeTemp (uint8_t temp) const;
 
 private:
 
-        int ttyFd = 0;
-        const unsigned int FRAME_SIZE = 8; // Start (command) byte, 6 data bytes and 1 checksum byte.
+        static const unsigned int FRAME_SIZE = 8; // Start (command) byte, 6 data bytes and 1 checksum byte.
+        static const size_t RX_BUFFER_SIZE = 256;
+
+        int ttyFd = -1;
+        int epollFd = -1;
+        ShieldCounters *counters;
+
+        /// Time on the wire of one byte (start bit, 8 data bits, stop bit) [ns].
+        uint64_t byteTime = 0;
+
+        // Bytes read from the tty, not fed to the sync state machine yet.
+        uint8_t rx[RX_BUFFER_SIZE];
+        size_t rxPos = 0;
+        size_t rxLen = 0;
+        uint64_t rxTime = 0;            /// When the last one finished arriving (~ when epoll woke us up).
+
+        // Sync state machine : the frame collected so far and the running sum of its data bytes.
+        uint8_t frameBytes[FRAME_SIZE];
+        unsigned int frameLen = 0;
+        uint8_t frameSum = 0;
+        uint64_t frameTime = 0;
 
         const unsigned int BUF_VELOCITY_MSB = 1;
         const unsigned int BUF_VELOCITY_LSB = 2;
@@ -65,6 +111,7 @@ private:
         const unsigned int GPIO_FRONT_BRAKE = 2;
         const unsigned int GPIO_REAR_BRAKE = 3;
         const unsigned int GPIO_PARKING_LIGHT = 4;
+        const unsigned int GPIO_EVENT_BUTTON = 5;
 
         const float ENGINE_TEMP_FACTOR = 0.5;
         const float RPM_FACTOR = 50;
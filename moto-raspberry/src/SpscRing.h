@@ -0,0 +1,164 @@
+/****************************************************************************
+ *                                                                          *
+ *  Author : lukasz.iwaszkiewicz@gmail.com                                  *
+ *  ~~~~~~~~                                                                *
+ *  License : see COPYING file for details.                                 *
+ *  ~~~~~~~~~                                                               *
+ ****************************************************************************/
+
+
+#ifndef SPSCRING_H_
+#define SPSCRING_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+
+/// Lines the ring's producer and consumer halves are kept apart by. 64 on the Cortex-A cores, twice the ARM1176's.
+const size_t CACHE_LINE = 64;
+
+/**
+ * Snapshot of an SpscRing's counters.
+ */
+struct RingCounters {
+        uint64_t pushed = 0;
+        uint64_t popped = 0;
+        uint64_t overflows = 0;         /// Pushes into a full ring : the item pushed, or with overwrite the oldest one, was lost.
+        uint64_t underflows = 0;        /// Pops from an empty ring.
+        uint64_t maxDepth = 0;          /// Most items queued at once, as seen by the consumer.
+        uint64_t capacity = 0;
+
+        /// One line : pushed, lost, empty pops and the high water mark.
+        void printSummary (std::ostream &o, const char *name) const
+        {
+                o << name << " : " << pushed << " pushed, " << overflows << " lost to overflow, " << underflows << " empty pops, max depth "
+                  << maxDepth << "/" << capacity << std::endl;
+        }
+};
+
+/**
+ * Lock free single producer, single consumer ring of N (a power of two) items. The producer's
+ * and the consumer's indices and counters live on cache lines of their own, and each side
+ * keeps a copy of the other's index, so neither touches the other's line unless the ring
+ * looks full (or empty).
+ *
+ * When full, push either drops the new item (returns false) or, with overwrite, takes the
+ * oldest one from under the consumer. In that mode pop copies the item and then claims it with
+ * a CAS, and copies again if the producer got there first, so T must be trivially copyable.
+ *
+ * Counters (counters ()) may be read from any thread. Align the storage : with C++11 new
+ * does not honour alignas, keep rings on the stack or static.
+ */
+template <typename T, size_t N>
+class SpscRing {
+public:
+
+        static_assert (N >= 2 && (N & (N - 1)) == 0, "SpscRing capacity has to be a power of two");
+
+        explicit SpscRing (bool overwrite = false) : overwrite (overwrite), head (0), pushed (0), overflows (0), tail (0), popped (0),
+                                                     underflows (0), maxDepth (0) {}
+
+        /// Producer only. False if the ring was full and the item was dropped.
+        bool push (T const &item)
+        {
+                uint64_t h = head.load (std::memory_order_relaxed);
+
+                if (h - tailCache >= N) {
+                        tailCache = tail.load (std::memory_order_acquire);
+
+                        if (h - tailCache >= N) {
+                                overflows.store (overflows.load (std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+
+                                if (!overwrite) {
+                                        return false;
+                                }
+
+                                // Fails only if the consumer has just popped it, which leaves room as well.
+                                uint64_t oldest = tailCache;
+                                tailCache = (tail.compare_exchange_strong (oldest, oldest + 1, std::memory_order_acq_rel, std::memory_order_acquire))
+                                                    ? oldest + 1
+                                                    : oldest;
+                        }
+                }
+
+                slots[h & (N - 1)] = item;
+                head.store (h + 1, std::memory_order_release);
+                pushed.store (pushed.load (std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+                return true;
+        }
+
+        /// Consumer only. False if the ring was empty.
+        bool pop (T &item)
+        {
+                uint64_t t = tail.load ((overwrite) ? std::memory_order_acquire : std::memory_order_relaxed);
+
+                while (true) {
+                        if (t >= headCache) {
+                                headCache = head.load (std::memory_order_acquire);
+
+                                // Sampled when the consumer catches up, i.e. at the start of every batch it drains.
+                                if (t < headCache && headCache - t > maxDepth.load (std::memory_order_relaxed)) {
+                                        maxDepth.store (headCache - t, std::memory_order_relaxed);
+                                }
+
+                                if (t >= headCache) {
+                                        underflows.store (underflows.load (std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+                                        return false;
+                                }
+                        }
+
+                        item = slots[t & (N - 1)];
+
+                        if (!overwrite) {
+                                tail.store (t + 1, std::memory_order_release);
+                                break;
+                        }
+
+                        // On failure the producer overwrote slot t meanwhile, and t is now the oldest.
+                        if (tail.compare_exchange_strong (t, t + 1, std::memory_order_acq_rel, std::memory_order_acquire)) {
+                                break;
+                        }
+                }
+
+                popped.store (popped.load (std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+                return true;
+        }
+
+        /// Items queued, exact only from the consumer's side.
+        size_t size () const { return head.load (std::memory_order_acquire) - tail.load (std::memory_order_acquire); }
+        static size_t capacity () { return N; }
+
+        RingCounters counters () const
+        {
+                RingCounters c;
+                c.pushed = pushed.load (std::memory_order_relaxed);
+                c.popped = popped.load (std::memory_order_relaxed);
+                c.overflows = overflows.load (std::memory_order_relaxed);
+                c.underflows = underflows.load (std::memory_order_relaxed);
+                c.maxDepth = maxDepth.load (std::memory_order_relaxed);
+                c.capacity = N;
+                return c;
+        }
+
+private:
+
+        const bool overwrite;
+
+        // Producer's line.
+        alignas (CACHE_LINE) std::atomic <uint64_t> head;
+        uint64_t tailCache = 0;
+        std::atomic <uint64_t> pushed;
+        std::atomic <uint64_t> overflows;
+
+        // Consumer's line.
+        alignas (CACHE_LINE) std::atomic <uint64_t> tail;
+        uint64_t headCache = 0;
+        std::atomic <uint64_t> popped;
+        std::atomic <uint64_t> underflows;
+        std::atomic <uint64_t> maxDepth;
+
+        alignas (CACHE_LINE) T slots[N];
+};
+
+#endif /* SPSCRING_H_ */
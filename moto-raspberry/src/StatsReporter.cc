@@ -0,0 +1,223 @@
+/****************************************************************************
+ *                                                                          *
+ *  Author : lukasz.iwaszkiewicz@gmail.com                                  *
+ *  ~~~~~~~~                                                                *
+ *  License : see COPYING file for details.                                 *
+ *  ~~~~~~~~~                                                               *
+ ****************************************************************************/
+
+
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/un.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include "StatsReporter.h"
+
+StatsReporter::StatsReporter (RecorderStats const &sources, std::string const &file, std::string const &socketPath, int intervalMs) :
+        sources (sources), file (file), socketPath (socketPath), intervalMs (std::max (intervalMs, 1)), running (false), startNs (monotonicNs ())
+{
+}
+
+StatsReporter::~StatsReporter ()
+{
+        stop ();
+}
+
+bool StatsReporter::start ()
+{
+        bool ok = true;
+
+        if (!socketPath.empty ()) {
+                sockaddr_un address = {};
+                address.sun_family = AF_UNIX;
+                listenFd = socket (AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+
+                if (socketPath.size () >= sizeof (address.sun_path)) {
+                        std::cerr << "StatsReporter::start : socket path " << socketPath << " is too long" << std::endl;
+                        ok = false;
+                }
+                else {
+                        strcpy (address.sun_path, socketPath.c_str ());
+
+                        // Left behind by a run which didn't stop cleanly.
+                        unlink (socketPath.c_str ());
+
+                        if (listenFd < 0 || bind (listenFd, reinterpret_cast <sockaddr *> (&address), sizeof (address)) != 0 || listen (listenFd, 4) != 0) {
+                                std::cerr << "StatsReporter::start : can't listen on " << socketPath << " : " << strerror (errno) << std::endl;
+                                ok = false;
+                        }
+                }
+
+                if (!ok && listenFd >= 0) {
+                        close (listenFd);
+                        listenFd = -1;
+                }
+        }
+
+        running = true;
+        thread = std::thread (&StatsReporter::run, this);
+        return ok;
+}
+
+void StatsReporter::stop ()
+{
+        if (!thread.joinable ()) {
+                return;
+        }
+
+        running = false;
+        thread.join ();
+
+        if (listenFd >= 0) {
+                close (listenFd);
+                listenFd = -1;
+                unlink (socketPath.c_str ());
+        }
+}
+
+void StatsReporter::run ()
+{
+        // Lowest CPU priority for this thread only, as SegmentRing.
+        setpriority (PRIO_PROCESS, syscall (SYS_gettid), 19);
+        applyThreadPolicy (ThreadPolicy (), "stats");
+        uint64_t next = monotonicNs ();
+
+        while (running) {
+                uint64_t now = monotonicNs ();
+
+                if (now >= next) {
+                        sample (now);
+                        writeFile ();
+                        next = std::max <uint64_t> (next + uint64_t (intervalMs) * 1000000ULL, now);
+                }
+
+                // Short enough for stop not to wait.
+                pollfd listening = { listenFd, POLLIN, 0 };
+                int timeout = std::min <uint64_t> (100, (next - std::min (next, monotonicNs ())) / 1000000 + 1);
+
+                if (poll (&listening, (listenFd >= 0) ? 1 : 0, timeout) > 0 && (listening.revents & POLLIN)) {
+                        serve ();
+                }
+        }
+
+        sample (monotonicNs ());
+        writeFile ();
+}
+
+/**
+ * Rates over the interval since the previous sample.
+ */
+void StatsReporter::sample (uint64_t nowNs)
+{
+        if (!sources.shield) {
+                return;
+        }
+
+        uint64_t frames = sources.shield->frames.load (std::memory_order_relaxed);
+        uint64_t rejects = sources.shield->checksumRejects.load (std::memory_order_relaxed);
+        uint64_t bytes = sources.shield->bytes.load (std::memory_order_relaxed);
+
+        if (sampleNs && nowNs > sampleNs) {
+                double seconds = (nowNs - sampleNs) / 1e9;
+                framesPerS = (frames - lastFrames) / seconds;
+                rejectsPerS = (rejects - lastRejects) / seconds;
+                bytesPerS = (bytes - lastBytes) / seconds;
+        }
+
+        sampleNs = nowNs;
+        lastFrames = frames;
+        lastRejects = rejects;
+        lastBytes = bytes;
+}
+
+void StatsReporter::report (std::ostream &o) const
+{
+        o << std::fixed << std::setprecision (1) << "uptime : " << (monotonicNs () - startNs) / 1e9 << " s\n";
+
+        if (sources.shield) {
+                o << "shield : " << sources.shield->frames.load (std::memory_order_relaxed) << " frames (" << framesPerS << "/s), "
+                  << sources.shield->checksumRejects.load (std::memory_order_relaxed) << " checksum rejects (" << rejectsPerS << "/s), "
+                  << sources.shield->bytes.load (std::memory_order_relaxed) << " bytes (" << bytesPerS << "/s)\n";
+        }
+
+        if (sources.shieldTiming) {
+                sources.shieldTiming->printSummary (o, "shield");
+        }
+
+        if (sources.queue) {
+                sources.queue->counters ().printSummary (o, "telemetry queue");
+                o << "telemetry queue depth : " << sources.queue->size () << "\n";
+        }
+
+        if (sources.callbackTime) {
+                sources.callbackTime->printSummary (o, "encoder callback", "us");
+        }
+
+        if (sources.recorder) {
+                sources.recorder->loopStats ().printSummary (o, "capture");
+        }
+
+        if (sources.segments) {
+                o << "encoder buffers dropped : " << sources.segments->dropped () << "\n";
+                sources.segments->writeLatency ().printSummary (o, "segment write", "us");
+                sources.segments->rotationLatency ().printSummary (o, "segment rotation", "us");
+                sources.segments->loopStats ().printSummary (o, "segment writer");
+        }
+
+        if (sources.telemetry) {
+                sources.telemetry->loopStats ().printSummary (o, "telemetry writer");
+        }
+}
+
+void StatsReporter::writeFile ()
+{
+        if (file.empty ()) {
+                return;
+        }
+
+        std::ostringstream text;
+        report (text);
+        std::string const &data = text.str ();
+        std::string aside = file + ".tmp";
+        int fd = open (aside.c_str (), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        bool written = fd >= 0 && write (fd, data.data (), data.size ()) == ssize_t (data.size ());
+
+        if (fd >= 0) {
+                close (fd);
+        }
+
+        written = written && rename (aside.c_str (), file.c_str ()) == 0;
+
+        // Once per run of failures.
+        if (!written && !fileFailed) {
+                std::cerr << "StatsReporter : can't write " << file << " : " << strerror (errno) << std::endl;
+        }
+
+        fileFailed = !written;
+}
+
+/**
+ * One report per connection. A few kB : the socket buffer takes it, nothing waits for the client.
+ */
+void StatsReporter::serve ()
+{
+        int fd;
+
+        while ((fd = accept4 (listenFd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+                std::ostringstream text;
+                report (text);
+                std::string const &data = text.str ();
+                send (fd, data.data (), data.size (), MSG_NOSIGNAL);
+                close (fd);
+        }
+}
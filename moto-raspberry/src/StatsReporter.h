@@ -0,0 +1,88 @@
+/****************************************************************************
+ *                                                                          *
+ *  Author : lukasz.iwaszkiewicz@gmail.com                                  *
+ *  ~~~~~~~~                                                                *
+ *  License : see COPYING file for details.                                 *
+ *  ~~~~~~~~~                                                               *
+ ****************************************************************************/
+
+
+#ifndef STATSREPORTER_H_
+#define STATSREPORTER_H_
+
+#include <atomic>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <thread>
+#include "Recorder.h"
+#include "Shield.h"
+
+/**
+ * What the report is made of. Any of them may be 0 : left out.
+ */
+struct RecorderStats {
+        ShieldCounters const *shield = 0;
+        LoopStats const *shieldTiming = 0;
+        Queue const *queue = 0;
+        Histogram const *callbackTime = 0;
+        Recorder const *recorder = 0;
+        SegmentWriter const *segments = 0;
+        TelemetryWriter const *telemetry = 0;
+};
+
+/**
+ * The recorder's counters and histograms while it runs, for the field : rewritten to a text
+ * file every intervalMs (written aside and renamed, never seen half written), and sent to
+ * whatever connects to a Unix domain socket (socat - UNIX-CONNECT:PATH), then closed.
+ *
+ * All of it is read from its own thread, at the lowest CPU priority : the recording threads
+ * only bump the relaxed atomics they always did (see Histogram), and never wait for this.
+ */
+class StatsReporter {
+public:
+
+        /// file, socketPath : empty for none.
+        StatsReporter (RecorderStats const &sources, std::string const &file, std::string const &socketPath, int intervalMs = 1000);
+        ~StatsReporter ();
+
+        StatsReporter (StatsReporter const &) = delete;
+        StatsReporter &operator= (StatsReporter const &) = delete;
+
+        /// False if the socket could not be set up, the file is written anyway.
+        bool start ();
+
+        /// Writes the file one last time (it is left behind), removes the socket.
+        void stop ();
+
+private:
+
+        void run ();
+
+        /// The report as of now, rates over the last interval.
+        void report (std::ostream &o) const;
+        void sample (uint64_t nowNs);
+        void writeFile ();
+        void serve ();
+
+        RecorderStats sources;
+        std::string file;
+        std::string socketPath;
+        int intervalMs;
+        int listenFd = -1;
+        std::atomic <bool> running;
+        std::thread thread;
+
+        // Reporter thread only.
+        uint64_t startNs;
+        uint64_t sampleNs = 0;
+        uint64_t lastFrames = 0;
+        uint64_t lastRejects = 0;
+        uint64_t lastBytes = 0;
+        double framesPerS = 0;
+        double rejectsPerS = 0;
+        double bytesPerS = 0;
+        bool fileFailed = false;
+};
+
+#endif /* STATSREPORTER_H_ */
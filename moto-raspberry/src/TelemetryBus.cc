@@ -0,0 +1,236 @@
+/****************************************************************************
+ *                                                                          *
+ *  Author : lukasz.iwaszkiewicz@gmail.com                                  *
+ *  ~~~~~~~~                                                                *
+ *  License : see COPYING file for details.                                 *
+ *  ~~~~~~~~~                                                               *
+ ****************************************************************************/
+
+
+#include "TelemetryBus.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+
+namespace {
+
+const uint32_t MAGIC = 0x4254424d; // "MBTB"
+
+void store (BusSlot *slot, uint32_t sequence, Frame const &frame)
+{
+        uint32_t words[BUS_FRAME_WORDS] = {};
+        memcpy (words, &frame, sizeof (Frame));
+
+        slot->sequence.store (sequence - 1, std::memory_order_relaxed);
+        std::atomic_thread_fence (std::memory_order_release);
+
+        for (size_t i = 0; i < BUS_FRAME_WORDS; ++i) {
+                slot->words[i].store (words[i], std::memory_order_relaxed);
+        }
+
+        slot->sequence.store (sequence, std::memory_order_release);
+}
+
+/// False if the slot was being written, or its sequence changed while it was copied.
+bool load (BusSlot const *slot, uint32_t *sequence, Frame *frame)
+{
+        uint32_t before = slot->sequence.load (std::memory_order_acquire);
+
+        if (before & 1) {
+                return false;
+        }
+
+        uint32_t words[BUS_FRAME_WORDS];
+
+        for (size_t i = 0; i < BUS_FRAME_WORDS; ++i) {
+                words[i] = slot->words[i].load (std::memory_order_relaxed);
+        }
+
+        std::atomic_thread_fence (std::memory_order_acquire);
+
+        if (slot->sequence.load (std::memory_order_relaxed) != before) {
+                return false;
+        }
+
+        memcpy (frame, words, sizeof (Frame));
+        *sequence = before;
+        return true;
+}
+
+size_t regionSize (uint32_t capacity) { return sizeof (BusHeader) + (1 + size_t (capacity)) * sizeof (BusSlot); }
+
+} // namespace
+
+/*****************************************************************************/
+
+TelemetryBus::TelemetryBus (std::string const &name, uint32_t capacity) : name (name), capacity (capacity) {}
+
+TelemetryBus::~TelemetryBus ()
+{
+        if (region) {
+                shm_unlink (name.c_str ());
+        }
+}
+
+bool TelemetryBus::open ()
+{
+        if ((capacity & (capacity - 1)) != 0 || capacity == 0) {
+                std::cerr << "TelemetryBus::open : capacity " << capacity << " isn't a power of two" << std::endl;
+                return false;
+        }
+
+        // Readers of a previous run keep their mapping of the old region, new ones get this one.
+        shm_unlink (name.c_str ());
+        int fd = shm_open (name.c_str (), O_CREAT | O_EXCL | O_RDWR, 0644);
+        size = regionSize (capacity);
+
+        if (fd < 0 || ftruncate (fd, size) != 0) {
+                std::cerr << "TelemetryBus::open : can't create " << name << " : " << strerror (errno) << std::endl;
+
+                if (fd >= 0) {
+                        ::close (fd);
+                        shm_unlink (name.c_str ());
+                }
+
+                return false;
+        }
+
+        void *map = mmap (NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        ::close (fd);
+
+        if (map == MAP_FAILED) {
+                std::cerr << "TelemetryBus::open : can't map " << name << " : " << strerror (errno) << std::endl;
+                shm_unlink (name.c_str ());
+                return false;
+        }
+
+        // ftruncate zeroed it : every sequence is 0, nothing published.
+        region = map;
+        header = static_cast <BusHeader *> (region);
+        latest = reinterpret_cast <BusSlot *> (header + 1);
+        ring = latest + 1;
+        header->version = TELEMETRY_BUS_VERSION;
+        header->frameSize = sizeof (Frame);
+        header->capacity = capacity;
+        header->magic.store (MAGIC, std::memory_order_release);
+        return true;
+}
+
+void TelemetryBus::publish (Frame const &frame)
+{
+        if (!header) {
+                return;
+        }
+
+        uint32_t n = header->published.load (std::memory_order_relaxed);
+        uint32_t sequence = 2 * (n + 1);
+        store (&ring[n & (capacity - 1)], sequence, frame);
+        store (latest, sequence, frame);
+        header->published.store (n + 1, std::memory_order_release);
+}
+
+/*****************************************************************************/
+
+TelemetryBusReader::~TelemetryBusReader ()
+{
+        detach ();
+}
+
+bool TelemetryBusReader::attach (std::string const &name)
+{
+        detach ();
+        int fd = shm_open (name.c_str (), O_RDONLY, 0);
+        struct stat st;
+
+        if (fd < 0 || fstat (fd, &st) != 0 || size_t (st.st_size) < sizeof (BusHeader)) {
+                if (fd >= 0) {
+                        ::close (fd);
+                }
+
+                return false;
+        }
+
+        void *map = mmap (NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        ::close (fd);
+
+        if (map == MAP_FAILED) {
+                return false;
+        }
+
+        BusHeader const *h = static_cast <BusHeader const *> (map);
+
+        if (h->magic.load (std::memory_order_acquire) != MAGIC || h->version != TELEMETRY_BUS_VERSION || h->frameSize != sizeof (Frame) ||
+            size_t (st.st_size) < regionSize (h->capacity)) {
+                std::cerr << "TelemetryBusReader::attach : " << name << " is not a telemetry bus of version " << TELEMETRY_BUS_VERSION << std::endl;
+                munmap (map, st.st_size);
+                return false;
+        }
+
+        region = map;
+        size = st.st_size;
+        header = h;
+        latestSlot = reinterpret_cast <BusSlot const *> (header + 1);
+        ring = latestSlot + 1;
+        capacity = header->capacity;
+        next = published ();
+        lostFrames = 0;
+        return true;
+}
+
+void TelemetryBusReader::detach ()
+{
+        if (region) {
+                munmap (region, size);
+                region = 0;
+                header = 0;
+        }
+}
+
+bool TelemetryBusReader::latest (Frame *frame, uint32_t *sequence) const
+{
+        // Bounded : the publisher would have to lap this many times in a row.
+        for (int attempt = 0; attempt < 16; ++attempt) {
+                uint32_t s;
+
+                if (load (latestSlot, &s, frame)) {
+                        if (sequence) {
+                                *sequence = s / 2 - 1;
+                        }
+
+                        return s != 0;
+                }
+        }
+
+        return false;
+}
+
+size_t TelemetryBusReader::read (Frame *frames, size_t max)
+{
+        uint32_t end = published ();
+        size_t count = 0;
+
+        // Whatever is older than the ring has been overwritten for sure.
+        if (end - next > capacity) {
+                lostFrames += end - next - capacity;
+                next = end - capacity;
+        }
+
+        while (count < max && next != end) {
+                uint32_t s;
+
+                if (load (&ring[next & (capacity - 1)], &s, &frames[count]) && s == 2 * (next + 1)) {
+                        ++count;
+                }
+                else {
+                        ++lostFrames;
+                }
+
+                ++next;
+        }
+
+        return count;
+}
@@ -0,0 +1,130 @@
+/****************************************************************************
+ *                                                                          *
+ *  Author : lukasz.iwaszkiewicz@gmail.com                                  *
+ *  ~~~~~~~~                                                                *
+ *  License : see COPYING file for details.                                 *
+ *  ~~~~~~~~~                                                               *
+ ****************************************************************************/
+
+
+#ifndef TELEMETRYBUS_H_
+#define TELEMETRYBUS_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include "Shield.h"
+
+/*
+ * Shield frames published by the recorder into POSIX shared memory (/dev/shm), for a live
+ * dashboard, a logger or anything else to read without the recorder knowing. The region is :
+ *
+ *      BusHeader, the latest frame (BusSlot), then capacity BusSlots : the ring of the last
+ *      capacity frames, frame n in slot n % capacity.
+ *
+ * Every slot is a seqlock : its sequence is odd while the frame is being written, and
+ * 2 * (n + 1) once frame n is in. Readers copy the frame and check that the sequence hasn't
+ * changed, so they never block the publisher nor each other, and need no write access.
+ * Frames are stored as 32 bit atomic words, sequences are 32 bit : 2^31 frames, 248 days at
+ * 100 Hz.
+ */
+
+const char *const TELEMETRY_BUS_NAME = "/motoblackbox-telemetry";
+const uint32_t TELEMETRY_BUS_VERSION = 1;
+const size_t BUS_FRAME_WORDS = (sizeof (Frame) + 3) / 4;
+
+static_assert (ATOMIC_INT_LOCK_FREE == 2, "Shared memory atomics have to be lock free");
+
+struct BusSlot {
+        std::atomic <uint32_t> sequence;
+        std::atomic <uint32_t> words[BUS_FRAME_WORDS];
+};
+
+struct BusHeader {
+        std::atomic <uint32_t> magic;           /// "MBTB", set last : the rest is valid once it is.
+        uint32_t version;
+        uint32_t frameSize;                     /// sizeof (Frame) of the publisher.
+        uint32_t capacity;
+        std::atomic <uint32_t> published;       /// Frames published so far.
+        uint32_t reserved[3];
+};
+
+/**
+ * Publisher side, used by the recorder's shield thread. publish is a handful of stores,
+ * no syscall and no lock. The region's name is removed with the bus, but it stays mapped
+ * until the process exits : the shield thread publishing into it is never joined.
+ */
+class TelemetryBus {
+public:
+
+        /// name : shm_open name, capacity : frames the ring keeps (a power of two).
+        explicit TelemetryBus (std::string const &name = TELEMETRY_BUS_NAME, uint32_t capacity = 1024);
+        ~TelemetryBus ();
+
+        TelemetryBus (TelemetryBus const &) = delete;
+        TelemetryBus &operator= (TelemetryBus const &) = delete;
+
+        /// Creates (or takes over) the region. False if it can't, publish does nothing then.
+        bool open ();
+
+        /// One thread only.
+        void publish (Frame const &frame);
+
+private:
+
+        std::string name;
+        uint32_t capacity;
+        size_t size = 0;
+        void *region = 0;
+        BusHeader *header = 0;
+        BusSlot *latest = 0;
+        BusSlot *ring = 0;
+};
+
+/**
+ * Reader side : attach to the recorder's bus and poll it. Wait free, read only, any number
+ * of readers in any number of processes.
+ */
+class TelemetryBusReader {
+public:
+
+        TelemetryBusReader () {}
+        ~TelemetryBusReader ();
+
+        TelemetryBusReader (TelemetryBusReader const &) = delete;
+        TelemetryBusReader &operator= (TelemetryBusReader const &) = delete;
+
+        /// False if there is no bus (the recorder isn't running) or it is of another version.
+        bool attach (std::string const &name = TELEMETRY_BUS_NAME);
+        void detach ();
+
+        /**
+         * The most recent frame, and its number (counted from 0) if sequence isn't null.
+         * False if nothing was published yet, or the publisher kept overwriting it.
+         */
+        bool latest (Frame *frame, uint32_t *sequence = 0) const;
+
+        /**
+         * Up to max frames published since the previous call (since attach at first), oldest
+         * first. Frames the publisher overwrote before they were read are skipped and counted
+         * in lost.
+         */
+        size_t read (Frame *frames, size_t max);
+
+        uint32_t published () const { return header->published.load (std::memory_order_acquire); }
+        uint64_t lost () const { return lostFrames; }
+
+private:
+
+        size_t size = 0;
+        void *region = 0;
+        BusHeader const *header = 0;
+        BusSlot const *latestSlot = 0;
+        BusSlot const *ring = 0;
+        uint32_t capacity = 0;
+        uint32_t next = 0;
+        uint64_t lostFrames = 0;
+};
+
+#endif /* TELEMETRYBUS_H_ */
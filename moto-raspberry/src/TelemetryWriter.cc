@@ -0,0 +1,343 @@
+/****************************************************************************
+ *                                                                          *
+ *  Author : lukasz.iwaszkiewicz@gmail.com                                  *
+ *  ~~~~~~~~                                                                *
+ *  License : see COPYING file for details.                                 *
+ *  ~~~~~~~~~                                                               *
+ ****************************************************************************/
+
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+#include <chrono>
+#include "TelemetryWriter.h"
+#include "Histogram.h"
+
+TelemetryWriter::TelemetryWriter (Queue *queue, FsyncPolicy fsyncPolicy, int flushIntervalMs, EventDetector *events, SegmentRing *ring,
+                                  EventRecording *recording) :
+        queue (queue), events (events), ring (ring), recording (recording), fsyncPolicy (fsyncPolicy), flushIntervalMs (flushIntervalMs), running (false),
+        loop (uint64_t (flushIntervalMs) * 1000000ULL)
+{
+}
+
+TelemetryWriter::~TelemetryWriter ()
+{
+        stop ();
+}
+
+void TelemetryWriter::start (ThreadPolicy const &policy)
+{
+        this->policy = policy;
+        running = true;
+        thread = std::thread (&TelemetryWriter::run, this);
+}
+
+void TelemetryWriter::stop ()
+{
+        if (!thread.joinable ()) {
+                return;
+        }
+
+        running = false;
+        thread.join ();
+}
+
+void TelemetryWriter::segmentStarted (unsigned int fileNo, uint64_t startNs)
+{
+        if (!segments.push (Segment { fileNo, startNs })) {
+                // Writer stalled for 16 segments, its boundaries can't be kept anyway.
+                std::cerr << "TelemetryWriter : segment " << fileNo << " announcement dropped" << std::endl;
+        }
+}
+
+void TelemetryWriter::frameEncoded (EncodedFrame const &frame)
+{
+        // After frames lost here, the index of the segment is short of them.
+        EncodedFrame copy = frame;
+        copy.damaged |= droppingFrames;
+        bool pushed = encodedFrames.push (copy);
+
+        // Once per run of drops.
+        if (!pushed && !droppingFrames) {
+                std::cerr << "TelemetryWriter : frame of segment " << frame.segment << " dropped from the index" << std::endl;
+        }
+
+        droppingFrames = !pushed;
+}
+
+void TelemetryWriter::run ()
+{
+        applyThreadPolicy (policy, "telemetry");
+        uint64_t next = monotonicNs ();
+
+        while (running) {
+                next += uint64_t (flushIntervalMs) * 1000000ULL;
+                sleepUntil (next);
+                uint64_t now = monotonicNs ();
+                loop.woke (next, now);
+                loop.iteration (now);
+                drain (now - SHIELD_LATENCY_NS);
+
+                // Behind by more than a period (a stalled card) : start over rather than drain in a burst of catch ups.
+                if (now > next + uint64_t (flushIntervalMs) * 1000000ULL) {
+                        next = now;
+                }
+        }
+
+        drain (UINT64_MAX);
+        collectFrames ();
+        closeSegment ();
+}
+
+/**
+ * Sorts queued frames into segments, and writes them out with one write per segment. No
+ * frame stamped before settledNs is still to come.
+ */
+void TelemetryWriter::drain (uint64_t settledNs)
+{
+        Frame frame;
+
+        while (queue->pop (frame)) {
+                // Segment boundaries are announced before the frames which follow them are
+                // drained, since draining lags by up to flushIntervalMs.
+                advance (frame.timestamp);
+
+                // Before the first segment : nothing to align to.
+                if (fd < 0 && !holding) {
+                        continue;
+                }
+
+                if (events) {
+                        EventType type = events->feed (frame);
+
+                        if (type != EVENT_NONE && ring) {
+                                ring->lock (current.fileNo, type);
+                        }
+
+                        if (type != EVENT_NONE && recording) {
+                                recording->trigger (frame.timestamp);
+                        }
+                }
+
+                char line[128];
+                uint64_t us = (frame.timestamp > current.startNs) ? (frame.timestamp - current.startNs) / 1000 : 0;
+                int len = snprintf (line, sizeof (line), "%llu,%g,%g,%g,%g,%d,%d,%d,%d,%d\n", (unsigned long long)us, frame.velocity, frame.rpm,
+                                    frame.engineTemp, frame.airTemp, frame.frontBrake, frame.rearBrake, frame.leftTurn, frame.rightTurn,
+                                    frame.parkingLight);
+                ((holding) ? held.back ().rows : batch).append (line, len);
+                ((holding) ? held.back ().rowTimes : rowTimes).push_back (frame.timestamp);
+        }
+
+        // Segments go on without telemetry too (no shield, or it went quiet).
+        advance (settledNs);
+        collectFrames ();
+
+        if (holding) {
+                if (recording->recording (monotonicNs ())) {
+                        flushHeld ();
+                }
+                else {
+                        trimHeld ();
+                }
+        }
+
+        flush ();
+}
+
+/**
+ * Closes the current segment and opens the announced ones which started by timestampNs.
+ */
+void TelemetryWriter::advance (uint64_t timestampNs)
+{
+        while (true) {
+                if (!hasNext) {
+                        hasNext = segments.pop (next);
+                }
+
+                if (!hasNext || next.startNs > timestampNs) {
+                        break;
+                }
+
+                collectFrames ();
+                flush ();
+                closeSegment ();
+                openSegment (next);
+                hasNext = false;
+        }
+}
+
+/**
+ * Segment starts : its file is opened if it is recorded, or its rows are held.
+ */
+void TelemetryWriter::openSegment (Segment const &segment)
+{
+        current = segment;
+        started = true;
+
+        if (recording && !recording->recording (segment.startNs)) {
+                holding = true;
+                held.push_back (Held { segment, std::string (), std::vector <uint64_t> (), std::vector <EncodedFrame> () });
+                return;
+        }
+
+        if (holding) {
+                flushHeld ();
+                closeSegment ();
+        }
+
+        openFile (segment);
+}
+
+void TelemetryWriter::openFile (Segment const &segment)
+{
+        char filename[32];
+        snprintf (filename, sizeof (filename), "%05d.csv", segment.fileNo);
+        fd = open (filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        fileSegment = segment;
+
+        if (fd < 0) {
+                std::cerr << "TelemetryWriter : unable to open " << filename << std::endl;
+        }
+}
+
+/**
+ * Sorts the encoded frames into segments, up to the current one (the rest stays queued).
+ */
+void TelemetryWriter::collectFrames ()
+{
+        while (started) {
+                if (!hasEncoded) {
+                        hasEncoded = encodedFrames.pop (encoded);
+                }
+
+                if (!hasEncoded || encoded.segment > int (current.fileNo)) {
+                        break;
+                }
+
+                if (holding) {
+                        for (Held &h : held) {
+                                if (int (h.segment.fileNo) == encoded.segment) {
+                                        h.frames.push_back (encoded);
+                                }
+                        }
+                }
+                else if (fd >= 0 && encoded.segment == int (fileSegment.fileNo)) {
+                        frames.push_back (encoded);
+                }
+
+                hasEncoded = false;
+        }
+}
+
+/**
+ * Writes NNNNN.frames for the open file's segment : every frame with the row of the CSV
+ * nearest to it. Not if some were lost : the overlay falls back to its own scan then.
+ */
+void TelemetryWriter::writeFrameIndex ()
+{
+        char filename[32];
+        snprintf (filename, sizeof (filename), "%05d.frames", fileSegment.fileNo);
+
+        if (std::any_of (frames.begin (), frames.end (), [] (EncodedFrame const &f) { return f.damaged; })) {
+                std::cerr << "TelemetryWriter : " << filename << " not written, the segment lost encoder buffers" << std::endl;
+                frames.clear ();
+                rowTimes.clear ();
+                return;
+        }
+
+        std::vector <FrameIndexEntry> entries;
+        entries.reserve (frames.size ());
+
+        for (EncodedFrame const &f : frames) {
+                FrameIndexEntry e = f.entry;
+                e.timeUs = (f.captureNs > fileSegment.startNs) ? (f.captureNs - fileSegment.startNs) / 1000 : 0;
+                auto i = std::lower_bound (rowTimes.begin (), rowTimes.end (), f.captureNs);
+
+                if (i != rowTimes.begin () && (i == rowTimes.end () || f.captureNs - *(i - 1) < *i - f.captureNs)) {
+                        --i;
+                }
+
+                e.telemetry = (i != rowTimes.end ()) ? uint32_t (i - rowTimes.begin ()) : FRAME_INDEX_NO_TELEMETRY;
+                entries.push_back (e);
+        }
+
+        FrameIndexHeader header = { { 'M', 'B', 'F', 'I' }, FRAME_INDEX_VERSION, sizeof (FrameIndexEntry), uint32_t (entries.size ()), 0 };
+        FILE *file = fopen (filename, "wb");
+
+        if (!file || fwrite (&header, sizeof (header), 1, file) != 1 ||
+            (!entries.empty () && fwrite (&entries[0], sizeof (FrameIndexEntry), entries.size (), file) != entries.size ())) {
+                std::cerr << "TelemetryWriter : unable to write " << filename << std::endl;
+        }
+
+        if (file) {
+                fclose (file);
+        }
+
+        frames.clear ();
+        rowTimes.clear ();
+}
+
+/**
+ * Writes out the held segments SegmentWriter still has the video of, and goes on recording
+ * the newest.
+ */
+void TelemetryWriter::flushHeld ()
+{
+        trimHeld ();
+
+        for (Held &h : held) {
+                closeSegment ();
+                openFile (h.segment);
+                batch.swap (h.rows);
+                rowTimes.swap (h.rowTimes);
+                frames.swap (h.frames);
+                flush ();
+        }
+
+        held.clear ();
+        holding = false;
+}
+
+void TelemetryWriter::trimHeld ()
+{
+        // -1 : the video ring holds nothing, only the current segment may still be recorded.
+        int oldest = recording->oldestHeld ();
+
+        while (held.size () > 1 && (oldest < 0 || int (held.front ().segment.fileNo) < oldest)) {
+                held.pop_front ();
+        }
+}
+
+void TelemetryWriter::closeSegment ()
+{
+        if (fd < 0) {
+                return;
+        }
+
+        writeFrameIndex ();
+
+        if (fsyncPolicy != FSYNC_NEVER) {
+                fdatasync (fd);
+        }
+
+        close (fd);
+        fd = -1;
+}
+
+void TelemetryWriter::flush ()
+{
+        if (fd >= 0 && !batch.empty ()) {
+                if (write (fd, batch.data (), batch.size ()) != ssize_t (batch.size ())) {
+                        std::cerr << "TelemetryWriter : write failed" << std::endl;
+                }
+
+                if (fsyncPolicy == FSYNC_BATCH) {
+                        fdatasync (fd);
+                }
+        }
+
+        batch.clear ();
+}
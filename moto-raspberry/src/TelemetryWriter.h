@@ -0,0 +1,143 @@
+/****************************************************************************
+ *                                                                          *
+ *  Author : lukasz.iwaszkiewicz@gmail.com                                  *
+ *  ~~~~~~~~                                                                *
+ *  License : see COPYING file for details.                                 *
+ *  ~~~~~~~~~                                                               *
+ ****************************************************************************/
+
+
+#ifndef TELEMETRYWRITER_H_
+#define TELEMETRYWRITER_H_
+
+#include <atomic>
+#include <deque>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+#include <boost/lockfree/spsc_queue.hpp>
+#include "Shield.h"
+#include "EventDetector.h"
+#include "SegmentRing.h"
+#include "EventRecording.h"
+#include "FrameIndex.h"
+#include "SpscRing.h"
+#include "Realtime.h"
+
+/// Frames from the shield thread. Ten seconds at 100 frames/s, two at the most a 38400 baud UART can carry, so a stalled card loses nothing.
+typedef SpscRing <Frame, 1024> Queue;
+
+/**
+ * When telemetry files are fsynced.
+ */
+enum FsyncPolicy {
+        FSYNC_NEVER,            /// Leave it to the kernel.
+        FSYNC_SEGMENT,          /// When a segment's file is closed.
+        FSYNC_BATCH             /// After every batch written.
+};
+
+/**
+ * Thread which drains the shield frame queue into per-segment CSV files : NNNNN.csv next to
+ * every NNNNN.h264 the Recorder starts. Rows are in the format moto-overlay reads, with
+ * the timestamp in us since the start of the segment.
+ *
+ * Frames go to the segment during which their first byte arrived. The encoder callback only
+ * announces segments (segmentStarted, lock free), all the file I/O happens here. Segments
+ * are opened as announced, shield frames or not.
+ *
+ * If given events, frames also go through the event detector, the segments around every
+ * event are locked in the ring, and event only recording (recording) is triggered. With
+ * recording, the rows of segments outside the recording window are held in memory (as long
+ * as SegmentWriter holds their video) and written out with it.
+ *
+ * Encoded frames (frameEncoded) are matched with the nearest telemetry row, and written to
+ * NNNNN.frames (see FrameIndex.h) when their segment is closed.
+ */
+class TelemetryWriter {
+public:
+
+        TelemetryWriter (Queue *queue, FsyncPolicy fsyncPolicy, int flushIntervalMs, EventDetector *events = 0, SegmentRing *ring = 0,
+                         EventRecording *recording = 0);
+        ~TelemetryWriter ();
+
+        /// policy : the writer thread's, it applies it itself.
+        void start (ThreadPolicy const &policy = ThreadPolicy ());
+
+        /// Writes out what is queued, closes the file and joins the thread.
+        void stop ();
+
+        /// Called from the encoder callback when segment fileNo starts, at CLOCK_MONOTONIC startNs.
+        void segmentStarted (unsigned int fileNo, uint64_t startNs);
+
+        /// Called from the encoder callback for every frame (see FrameIndexer). Lock free.
+        void frameEncoded (EncodedFrame const &frame);
+
+        /// Frames frameEncoded can still take. From the encoder callback's thread.
+        size_t frameRoom () const { return encodedFrames.write_available (); }
+
+        /// The writer thread's flush period and wake-up jitter.
+        LoopStats const &loopStats () const { return loop; }
+
+private:
+
+        struct Segment {
+                unsigned int fileNo;
+                uint64_t startNs;
+        };
+
+        /// A shield frame is queued this long after its first byte at the most (8 bytes take 2 ms at 38400 baud).
+        static const uint64_t SHIELD_LATENCY_NS = 100000000ULL;
+
+        void run ();
+        void drain (uint64_t settledNs);
+        void advance (uint64_t timestampNs);
+        void openSegment (Segment const &segment);
+        void openFile (Segment const &segment);
+        void closeSegment ();
+        void flush ();
+        void flushHeld ();
+        void trimHeld ();
+        void collectFrames ();
+        void writeFrameIndex ();
+
+        Queue *queue;
+        EventDetector *events;
+        SegmentRing *ring;
+        EventRecording *recording;
+        boost::lockfree::spsc_queue <Segment, boost::lockfree::capacity <16>> segments;
+        boost::lockfree::spsc_queue <EncodedFrame, boost::lockfree::capacity <256>> encodedFrames;
+        FsyncPolicy fsyncPolicy;
+        int flushIntervalMs;
+        std::atomic <bool> running;
+        std::thread thread;
+        ThreadPolicy policy;
+        bool droppingFrames = false;            /// Encoder callback side.
+
+        // Writer thread only.
+        int fd = -1;
+        Segment fileSegment = { 0, 0 };         /// The one fd belongs to.
+        Segment current = { 0, 0 };
+        bool started = false;
+        bool hasNext = false;
+        Segment next = { 0, 0 };
+        std::string batch;
+        std::vector <uint64_t> rowTimes;        /// Of the open file's rows.
+        std::vector <EncodedFrame> frames;      /// Of the open file's segment.
+        LoopStats loop;
+        bool hasEncoded = false;
+        EncodedFrame encoded;
+
+        /// Rows and frames of a segment not recorded (yet).
+        struct Held {
+                Segment segment;
+                std::string rows;
+                std::vector <uint64_t> rowTimes;
+                std::vector <EncodedFrame> frames;
+        };
+
+        bool holding = false;
+        std::deque <Held> held;
+};
+
+#endif /* TELEMETRYWRITER_H_ */
@@ -36,64 +36,49 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  *
  * Description
  *
- * 3 components are created; camera, preview and video encoder.
- * Camera component has three ports, preview, video and stills.
- * This program connects preview and stills to the preview and video
- * encoder. Using mmal we don't need to worry about buffers between these
- * components, but we do need to handle buffers from the encoder, which
- * are simply written straight to the file in the requisite buffer callback.
- *
- * We use the RaspiCamControl code to handle the specific camera settings.
- * We use the RaspiPreview code to handle the (generic) preview window
+ * Encoded video comes from a CaptureSource : the camera and the VideoCore encoder through
+ * MMAL (MmalCapture, only when built WITH_MMAL), or .h264 files replayed in its place
+ * (ReplayCapture, --replay), which runs on any Linux box. Either way every encoder buffer
+ * goes through the Recorder into the segment files, and the shield's telemetry into the
+ * matching CSVs.
  */
 
-// We use some GNU extensions (basename)
-//#define _GNU_SOURCE
-
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <memory.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
 
 #define VERSION_STRING "v1.1"
 
-extern "C" {
-#include "bcm_host.h"
-#include "interface/vcos/vcos.h"
-
-#include "interface/mmal/mmal.h"
-#include "interface/mmal/mmal_logging.h"
-#include "interface/mmal/mmal_buffer.h"
-#include "interface/mmal/util/mmal_util.h"
-#include "interface/mmal/util/mmal_util_params.h"
-#include "interface/mmal/util/mmal_default_components.h"
-#include "interface/mmal/util/mmal_connection.h"
-
-#include "RaspiCamControl.h"
-};
-
 #include "Shield.h"
-#include <boost/lockfree/spsc_queue.hpp>
-#include <boost/lockfree/queue.hpp>
+#include "TelemetryWriter.h"
+#include "TelemetryBus.h"
+#include "EventDetector.h"
+#include "EventRecording.h"
+#include "FrameIndex.h"
+#include "Realtime.h"
+#include "Recorder.h"
+#include "ReplayCapture.h"
+#include "Segmenter.h"
+#include "SegmentRing.h"
+#include "SegmentStorage.h"
+#include "SegmentWriter.h"
+#include "StatsReporter.h"
+#include "Histogram.h"
+#ifdef WITH_MMAL
+#include "MmalCapture.h"
+#endif
+#include <cmath>
+#include <memory>
 #include <thread>
+#include <iostream>
 //#include <boost/filesystem.hpp>
 
-typedef boost::lockfree::spsc_queue <Frame, boost::lockfree::capacity <10>> Queue;
-
-/// Camera number to use - we only have one camera, indexed from 0.
-#define CAMERA_NUMBER 0
-
-// Standard port setting for the camera component
-#define MMAL_CAMERA_PREVIEW_PORT 0
-#define MMAL_CAMERA_VIDEO_PORT 1
-#define MMAL_CAMERA_CAPTURE_PORT 2
-
 // Video format information
 #define VIDEO_FRAME_RATE_NUM 30
-#define VIDEO_FRAME_RATE_DEN 1
-
-/// Video render needs at least 2 buffers.
-#define VIDEO_OUTPUT_BUFFERS_NUM 3
 
 // Max bitrate we allow for recording
 const int MAX_BITRATE = 30000000; // 30Mbits/s
@@ -101,9 +86,6 @@ const int MAX_BITRATE = 30000000; // 30Mbits/s
 /// Interval at which we check for an failure abort during capture
 const int ABORT_INTERVAL = 100; // ms
 
-
-extern "C" int mmal_status_to_int(MMAL_STATUS_T status);
-
 /** Structure containing all state information for the current run
  */
 typedef struct
@@ -114,31 +96,38 @@ typedef struct
    int bitrate;                        /// Requested bitrate
    int framerate;                      /// Requested frame rate (fps)
    unsigned int intraperiod;                    /// Intra-refresh period (key frame rate)
-   char *filename;                     /// filename of output file
    int verbose;                        /// !0 if want detailed run information
-   int immutableInput;                /// Flag to specify whether encoder works in place or creates a new buffer. Result is preview can display either
-                                       /// the camera output or the encoder output (with compression artifacts)
-//   RASPIPREVIEW_PARAMETERS preview_parameters;   /// Preview setup parameters
-   RASPICAM_CAMERA_PARAMETERS camera_parameters; /// Camera setup parameters
-
-   MMAL_COMPONENT_T *camera_component;    /// Pointer to the camera component
-   MMAL_COMPONENT_T *encoder_component;   /// Pointer to the encoder component
-   MMAL_CONNECTION_T *preview_connection; /// Pointer to the connection from camera to preview
-   MMAL_CONNECTION_T *encoder_connection; /// Pointer to the connection from camera to encoder
 
-   MMAL_POOL_T *encoder_pool; /// Pointer to the pool of buffers used by encoder output port
+   const char *shield;                 /// Shield's tty, or "synthetic" for made up telemetry
+   const char *bus;                    /// Shared memory every shield frame is published to (TelemetryBus), "none" : not published
+   int replayMaxSpeed;                 /// Replay : !0 as fast as the writers take it, 0 in real time
+   int replayLoops;                    /// Replay : times the files are played, 0 : until stopped
+
+   FsyncPolicy telemetryFsync;         /// When telemetry files are fsynced
+   int telemetryFlushInterval;         /// Telemetry is written out in batches this often, ms
+   int telemetryOverwrite;             /// !0 : if the telemetry queue fills up, lose the oldest frames rather than the newest
+   int segmentDuration;                /// A new segment starts at the first IDR after this many ms, 0 : no limit
+   unsigned int segmentSize;           /// ...or after this many bytes, 0 : no limit
+   int requestKeyframes;               /// !0 : ask the encoder for an IDR when a segment is due, instead of waiting for one
+   unsigned int storageQuota;          /// MiB the segments may take, the oldest unlocked ones are deleted. 0 : no limit
+   unsigned int storageReserve;        /// MiB left free on the card, same. Both 0 : nothing is deleted, the card fills up
+   int lockBefore;                     /// Segments locked before the one an event happened in...
+   int lockAfter;                      /// ...and after it
+   float brakingThreshold;             /// Deceleration which counts as an event, km/h per second
+   int eventOnly;                      /// !0 : keep the video in RAM, write it only around events
+   int preEventDuration;               /// Event only : ms of video kept from before an event
+   int postEventDuration;              /// Event only : ms recorded after the last event
+   unsigned int preEventMemory;        /// Event only : MiB of RAM for the video held
+   ThreadPolicy shieldPolicy;          /// Scheduling of the shield thread...
+   ThreadPolicy capturePolicy;         /// ...the encoder callback's (or the replay's)...
+   ThreadPolicy segmentsPolicy;        /// ...the segment writer's...
+   ThreadPolicy telemetryPolicy;       /// ...and the telemetry writer's
+   int lockMemory;                     /// !0 : mlockall, no page faults once running
+   const char *statsFile;              /// Rewritten with the counters and histograms every statsInterval, "none" : not
+   const char *statsSocket;            /// Unix domain socket which sends them to whoever connects, "none" : not
+   int statsInterval;                  /// ms
 } RASPIVID_STATE;
 
-/** Struct used to pass information in encoder port userdata to callback
- */
-typedef struct
-{
-   FILE *file_handle;                   /// File handle to write buffer data to.
-   RASPIVID_STATE *pstate;            /// pointer to our state in case required in callback
-   int abort;                           /// Set to 1 in callback if an error occurs to attempt to abort the capture
-   Queue *queue;
-} PORT_USERDATA;
-
 /**
  * Assign a default set of parameters to the state passed in
  *
@@ -146,14 +135,8 @@ typedef struct
  */
 static void default_status(RASPIVID_STATE *state)
 {
-   if (!state)
-   {
-      vcos_assert(0);
-      return;
-   }
-
-   // Default everything to zero
-   memset(state, 0, sizeof(RASPIVID_STATE));
+   // Default everything to zero, the thread policies to theirs
+   *state = RASPIVID_STATE ();
 
    // Now set anything non-zero
    state->timeout = 5000;     // 5s delay before take image
@@ -162,14 +145,29 @@ static void default_status(RASPIVID_STATE *state)
    state->bitrate = 17000000; // This is a decent default bitrate for 1080p
    state->framerate = VIDEO_FRAME_RATE_NUM;
    state->intraperiod = 0;    // Not set
-   state->immutableInput = 1;
-   state->filename = "video.h264";
-
-   // Setup preview window defaults
-//   raspipreview_set_defaults(&state->preview_parameters);
-
-   // Set up the camera_parameters to default
-   raspicamcontrol_set_defaults(&state->camera_parameters);
+   state->shield = PORT;
+   state->bus = TELEMETRY_BUS_NAME;
+   state->replayMaxSpeed = 0;
+   state->replayLoops = 1;
+   state->telemetryFsync = FSYNC_SEGMENT;
+   state->telemetryFlushInterval = 200;
+   state->telemetryOverwrite = 1;
+   state->segmentDuration = 3000;
+   state->segmentSize = 0;
+   state->requestKeyframes = 1;
+   state->storageQuota = 0;
+   state->storageReserve = 0;
+   state->lockBefore = 2;
+   state->lockAfter = 2;
+   state->brakingThreshold = 25;
+   state->eventOnly = 0;
+   state->preEventDuration = 30000;
+   state->postEventDuration = 30000;
+   state->preEventMemory = 96;
+   state->lockMemory = 0;
+   state->statsFile = "/dev/shm/motoblackbox.stats";
+   state->statsSocket = "/tmp/motoblackbox.sock";
+   state->statsInterval = 1000;
 }
 
 /**
@@ -179,524 +177,255 @@ static void default_status(RASPIVID_STATE *state)
  */
 static void dump_status(RASPIVID_STATE *state)
 {
-   if (!state)
-   {
-      vcos_assert(0);
-      return;
-   }
-
-   fprintf(stderr, "Width %d, Height %d, filename %s\n", state->width, state->height, state->filename);
+   fprintf(stderr, "Width %d, Height %d, shield %s\n", state->width, state->height, state->shield);
    fprintf(stderr, "bitrate %d, framerate %d, time delay %d\n", state->bitrate, state->framerate, state->timeout);
-
-//   raspipreview_dump_parameters(&state->preview_parameters);
-   raspicamcontrol_dump_parameters(&state->camera_parameters);
-}
-
-/**
- *  buffer header callback function for camera control
- *
- *  Callback will dump buffer data to the specific file
- *
- * @param port Pointer to port from which callback originated
- * @param buffer mmal buffer header pointer
- */
-static void camera_control_callback(MMAL_PORT_T *port, MMAL_BUFFER_HEADER_T *buffer)
-{
-   if (buffer->cmd == MMAL_EVENT_PARAMETER_CHANGED)
-   {
-   }
-   else
-   {
-      vcos_log_error("Received unexpected camera control callback event, 0x%08x", buffer->cmd);
-   }
-
-   mmal_buffer_header_release(buffer);
 }
 
 /**
+ * --sched THREAD=PRIO[@CPU]
  *
+ * @return false if text isn't one
  */
-FILE *rotateFiles (FILE *file)
+static bool parse_sched(const char *text, RASPIVID_STATE *state)
 {
-        const int FILE_NAME_LEN = 32;
-        const int FRAMES_PER_FILE = 90;
-        char filename[FILE_NAME_LEN];
-        static unsigned int fileNo = 0;
-        static unsigned int frameCnt = 0;
-
-        if (!file || frameCnt++ > FRAMES_PER_FILE) {
-
-                if (file) {
-                        fclose (file);
-                }
-
-                snprintf (filename, FILE_NAME_LEN, "%05d.h264", fileNo++);
-                std::cerr << "New file : " << filename << std::endl;
-                file = fopen(filename, "wb");
-                frameCnt = 0;
-        }
-
-        return file;
+   std::string arg = text;
+   size_t equals = arg.find('=');
+   std::string thread = arg.substr(0, equals);
+   ThreadPolicy *policy = NULL;
+
+   if (thread == "shield")
+      policy = &state->shieldPolicy;
+   else if (thread == "capture")
+      policy = &state->capturePolicy;
+   else if (thread == "segments")
+      policy = &state->segmentsPolicy;
+   else if (thread == "telemetry")
+      policy = &state->telemetryPolicy;
+
+   return policy && equals != std::string::npos && parseThreadPolicy(text + equals + 1, policy);
 }
 
 /**
- *  buffer header callback function for encoder
- *
- *  Callback will dump buffer data to the specific file
+ * --telemetry-fsync never|segment|batch
  *
- * @param port Pointer to port from which callback originated
- * @param buffer mmal buffer header pointer
+ * @return false if text isn't one of them
  */
-static void encoder_buffer_callback(MMAL_PORT_T *port, MMAL_BUFFER_HEADER_T *buffer)
+static bool parse_fsync(const char *text, FsyncPolicy *policy)
 {
-        MMAL_BUFFER_HEADER_T *new_buffer;
-        // We pass our file handle and other stuff in via the userdata field.
-        PORT_USERDATA *pData = (PORT_USERDATA *) port->userdata;
-
-        if (pData) {
-                int bytes_written = buffer->length;
-
-//                std::cerr << "Open" << std::endl;
-                pData->file_handle = rotateFiles (pData->file_handle);
-
-                if (buffer->length) {
-                        mmal_buffer_header_mem_lock(buffer);
-                        bytes_written = fwrite(buffer->data, 1, buffer->length, pData->file_handle);
-                        mmal_buffer_header_mem_unlock(buffer);
-                }
-
-                if (bytes_written != buffer->length) {
-                        vcos_log_error("Failed to write buffer data - aborting");
-                        pData->abort = 1;
-                }
-
-                // Store sield data;
-                Frame frame;
-                while (pData->queue->pop(frame)) {
-                        std::cerr << frame << std::endl;
-                }
-        } else {
-                vcos_log_error("Received a encoder buffer callback with no state");
-        }
-
-        // release buffer back to the pool
-        mmal_buffer_header_release(buffer);
-
-        // and send one back to the port (if still open)
-        if (port->is_enabled) {
-                MMAL_STATUS_T status;
-
-                new_buffer = mmal_queue_get(pData->pstate->encoder_pool->queue);
-
-                if (new_buffer) {
-                        status = mmal_port_send_buffer(port, new_buffer);
-                }
-
-                if (!new_buffer || status != MMAL_SUCCESS) {
-                        vcos_log_error("Unable to return a buffer to the encoder port");
-                }
-        }
-}
-
-
-/**
- * Create the camera component, set up its ports
- *
- * @param state Pointer to state control struct
- *
- * @return 0 if failed, pointer to component if successful
- *
- */
-static MMAL_COMPONENT_T *create_camera_component(RASPIVID_STATE *state)
-{
-   MMAL_COMPONENT_T *camera = 0;
-   MMAL_ES_FORMAT_T *format;
-   MMAL_PORT_T *preview_port = NULL, *video_port = NULL, *still_port = NULL;
-   MMAL_STATUS_T status;
-
-   /* Create the component */
-   status = mmal_component_create(MMAL_COMPONENT_DEFAULT_CAMERA, &camera);
-
-   if (status != MMAL_SUCCESS)
-   {
-      vcos_log_error("Failed to create camera component");
-      goto error;
-   }
-
-   if (!camera->output_num)
-   {
-      vcos_log_error("Camera doesn't have output ports");
-      goto error;
-   }
-
-   preview_port = camera->output[MMAL_CAMERA_PREVIEW_PORT];
-   video_port = camera->output[MMAL_CAMERA_VIDEO_PORT];
-   still_port = camera->output[MMAL_CAMERA_CAPTURE_PORT];
-
-   // Enable the camera, and tell it its control callback function
-   status = mmal_port_enable(camera->control, camera_control_callback);
-
-   if (status)
-   {
-      vcos_log_error("Unable to enable control port : error %d", status);
-      goto error;
-   }
-
-   //  set up the camera configuration
-   {
-      MMAL_PARAMETER_CAMERA_CONFIG_T cam_config =
-      {
-         { MMAL_PARAMETER_CAMERA_CONFIG, sizeof(cam_config) },
-         .max_stills_w = state->width,
-         .max_stills_h = state->height,
-         .stills_yuv422 = 0,
-         .one_shot_stills = 0,
-         .max_preview_video_w = state->width,
-         .max_preview_video_h = state->height,
-         .num_preview_video_frames = 3,
-         .stills_capture_circular_buffer_height = 0,
-         .fast_preview_resume = 0,
-         .use_stc_timestamp = MMAL_PARAM_TIMESTAMP_MODE_RESET_STC
-      };
-      mmal_port_parameter_set(camera->control, &cam_config.hdr);
-   }
-
-   // Now set up the port formats
-
-   // Set the encode format on the Preview port
-   // HW limitations mean we need the preview to be the same size as the required recorded output
-
-   format = preview_port->format;
-
-   format->encoding = MMAL_ENCODING_OPAQUE;
-   format->encoding_variant = MMAL_ENCODING_I420;
-
-   format->encoding = MMAL_ENCODING_OPAQUE;
-   format->es->video.width = state->width;
-   format->es->video.height = state->height;
-   format->es->video.crop.x = 0;
-   format->es->video.crop.y = 0;
-   format->es->video.crop.width = state->width;
-   format->es->video.crop.height = state->height;
-   format->es->video.frame_rate.num = state->framerate;
-   format->es->video.frame_rate.den = VIDEO_FRAME_RATE_DEN;
-
-   status = mmal_port_format_commit(preview_port);
-
-   if (status)
-   {
-      vcos_log_error("camera viewfinder format couldn't be set");
-      goto error;
-   }
-
-   // Set the encode format on the video  port
-
-   format = video_port->format;
-   format->encoding_variant = MMAL_ENCODING_I420;
-
-   format->encoding = MMAL_ENCODING_OPAQUE;
-   format->es->video.width = state->width;
-   format->es->video.height = state->height;
-   format->es->video.crop.x = 0;
-   format->es->video.crop.y = 0;
-   format->es->video.crop.width = state->width;
-   format->es->video.crop.height = state->height;
-   format->es->video.frame_rate.num = state->framerate;
-   format->es->video.frame_rate.den = VIDEO_FRAME_RATE_DEN;
-
-   status = mmal_port_format_commit(video_port);
-
-   if (status)
-   {
-      vcos_log_error("camera video format couldn't be set");
-      goto error;
-   }
-
-   // Ensure there are enough buffers to avoid dropping frames
-   if (video_port->buffer_num < VIDEO_OUTPUT_BUFFERS_NUM)
-      video_port->buffer_num = VIDEO_OUTPUT_BUFFERS_NUM;
-
-
-   // Set the encode format on the still  port
-
-   format = still_port->format;
-
-   format->encoding = MMAL_ENCODING_OPAQUE;
-   format->encoding_variant = MMAL_ENCODING_I420;
-
-   format->es->video.width = state->width;
-   format->es->video.height = state->height;
-   format->es->video.crop.x = 0;
-   format->es->video.crop.y = 0;
-   format->es->video.crop.width = state->width;
-   format->es->video.crop.height = state->height;
-   format->es->video.frame_rate.num = 1;
-   format->es->video.frame_rate.den = 1;
-
-   status = mmal_port_format_commit(still_port);
-
-   if (status)
-   {
-      vcos_log_error("camera still format couldn't be set");
-      goto error;
-   }
-
-   /* Ensure there are enough buffers to avoid dropping frames */
-   if (still_port->buffer_num < VIDEO_OUTPUT_BUFFERS_NUM)
-      still_port->buffer_num = VIDEO_OUTPUT_BUFFERS_NUM;
-
-   /* Enable component */
-   status = mmal_component_enable(camera);
-
-   if (status)
-   {
-      vcos_log_error("camera component couldn't be enabled");
-      goto error;
-   }
-
-   raspicamcontrol_set_all_parameters(camera, &state->camera_parameters);
-
-   state->camera_component = camera;
-
-   if (state->verbose)
-      fprintf(stderr, "Camera component done\n");
-
-   return camera;
-
-error:
-
-   if (camera)
-      mmal_component_destroy(camera);
-
-   return 0;
-}
+   std::string arg = text;
+
+   if (arg == "never")
+      *policy = FSYNC_NEVER;
+   else if (arg == "segment")
+      *policy = FSYNC_SEGMENT;
+   else if (arg == "batch")
+      *policy = FSYNC_BATCH;
+   else
+      return false;
 
-/**
- * Destroy the camera component
- *
- * @param state Pointer to state control struct
- *
- */
-static void destroy_camera_component(RASPIVID_STATE *state)
-{
-   if (state->camera_component)
-   {
-      mmal_component_destroy(state->camera_component);
-      state->camera_component = NULL;
-   }
+   return true;
 }
 
 /**
- * Create the encoder component, set up its ports
- *
- * @param state Pointer to state control struct
- *
- * @return 0 if failed, pointer to component if successful
+ * Command line : everything else keeps its default.
  *
+ * @return false (usage printed) if the arguments make no sense
  */
-static MMAL_COMPONENT_T *create_encoder_component(RASPIVID_STATE *state)
+static bool parse_args(int argc, const char **argv, RASPIVID_STATE *state, std::vector <std::string> *replay)
 {
-   MMAL_COMPONENT_T *encoder = 0;
-   MMAL_PORT_T *encoder_input = NULL, *encoder_output = NULL;
-   MMAL_STATUS_T status;
-   MMAL_POOL_T *pool;
-
-   status = mmal_component_create(MMAL_COMPONENT_DEFAULT_VIDEO_ENCODER, &encoder);
+   bool timeout = false;
 
-   if (status != MMAL_SUCCESS)
+   for (int i = 1; i < argc; ++i)
    {
-      vcos_log_error("Unable to create video encoder component");
-      goto error;
-   }
-
-   if (!encoder->input_num || !encoder->output_num)
-   {
-      vcos_log_error("Video encoder doesn't have input/output ports");
-      goto error;
-   }
-
-   encoder_input = encoder->input[0];
-   encoder_output = encoder->output[0];
-
-   // We want same format on input and output
-   mmal_format_copy(encoder_output->format, encoder_input->format);
-
-   // Only supporting H264 at the moment
-   encoder_output->format->encoding = MMAL_ENCODING_H264;
-
-   encoder_output->format->bitrate = state->bitrate;
-
-   encoder_output->buffer_size = encoder_output->buffer_size_recommended;
-
-   if (encoder_output->buffer_size < encoder_output->buffer_size_min)
-      encoder_output->buffer_size = encoder_output->buffer_size_min;
-
-   encoder_output->buffer_num = encoder_output->buffer_num_recommended;
-
-   if (encoder_output->buffer_num < encoder_output->buffer_num_min)
-      encoder_output->buffer_num = encoder_output->buffer_num_min;
-
-   // Commit the port changes to the output port
-   status = mmal_port_format_commit(encoder_output);
-
-   if (status != MMAL_SUCCESS)
-   {
-      vcos_log_error("Unable to set format on video encoder output port");
-      goto error;
-   }
-
-
-   // Set the rate control parameter
-   if (0)
-   {
-      MMAL_PARAMETER_VIDEO_RATECONTROL_T param = {{ MMAL_PARAMETER_RATECONTROL, sizeof(param)}, MMAL_VIDEO_RATECONTROL_DEFAULT};
-      status = mmal_port_parameter_set(encoder_output, &param.hdr);
-      if (status != MMAL_SUCCESS)
+      std::string arg = argv[i];
+      bool value = i + 1 < argc;
+
+      if (arg == "--replay" && value)
+         replay->push_back (argv[++i]);
+      else if (arg == "--max-speed")
+         state->replayMaxSpeed = 1;
+      else if (arg == "--loops" && value)
+         state->replayLoops = atoi(argv[++i]);
+      else if (arg == "--timeout" && value)
       {
-         vcos_log_error("Unable to set ratecontrol");
-         goto error;
+         state->timeout = atoi(argv[++i]);
+         timeout = true;
       }
-
-   }
-
-   if (state->intraperiod)
-   {
-      MMAL_PARAMETER_UINT32_T param = {{ MMAL_PARAMETER_INTRAPERIOD, sizeof(param)}, state->intraperiod};
-      status = mmal_port_parameter_set(encoder_output, &param.hdr);
-      if (status != MMAL_SUCCESS)
+      else if (arg == "--shield" && value)
+         state->shield = argv[++i];
+      else if (arg == "--bus" && value)
+         state->bus = argv[++i];
+      else if (arg == "--telemetry-overwrite" && value)
+         state->telemetryOverwrite = atoi(argv[++i]);
+      else if (arg == "--segment-duration" && value)
+         state->segmentDuration = atoi(argv[++i]);
+      else if (arg == "--segment-size" && value)
+         state->segmentSize = strtoul(argv[++i], NULL, 10);
+      else if (arg == "--request-keyframes" && value)
+         state->requestKeyframes = atoi(argv[++i]);
+      else if (arg == "--storage-quota" && value)
+         state->storageQuota = strtoul(argv[++i], NULL, 10);
+      else if (arg == "--storage-reserve" && value)
+         state->storageReserve = strtoul(argv[++i], NULL, 10);
+      else if (arg == "--lock-before" && value)
+         state->lockBefore = atoi(argv[++i]);
+      else if (arg == "--lock-after" && value)
+         state->lockAfter = atoi(argv[++i]);
+      else if (arg == "--braking-threshold" && value)
+         state->brakingThreshold = atof(argv[++i]);
+      else if (arg == "--event-only")
+         state->eventOnly = 1;
+      else if (arg == "--pre-event" && value)
+         state->preEventDuration = atoi(argv[++i]);
+      else if (arg == "--post-event" && value)
+         state->postEventDuration = atoi(argv[++i]);
+      else if (arg == "--pre-event-memory" && value)
+         state->preEventMemory = strtoul(argv[++i], NULL, 10);
+      else if (arg == "--sched" && value && parse_sched(argv[i + 1], state))
+         ++i;
+      else if (arg == "--mlock")
+         state->lockMemory = 1;
+      else if (arg == "--stats" && value)
+         state->statsFile = argv[++i];
+      else if (arg == "--stats-socket" && value)
+         state->statsSocket = argv[++i];
+      else if (arg == "--stats-interval" && value)
+         state->statsInterval = atoi(argv[++i]);
+      else if (arg == "--telemetry-fsync" && value && parse_fsync(argv[i + 1], &state->telemetryFsync))
+         ++i;
+      else if (arg == "--telemetry-flush" && value)
+         state->telemetryFlushInterval = std::max(1, atoi(argv[++i]));
+      else if (arg == "-v" || arg == "--verbose")
+         state->verbose = 1;
+      else
       {
-         vcos_log_error("Unable to set intraperiod");
-         goto error;
+         fprintf(stderr, "Usage : %s [OPTION]...\n"
+                         "  --replay FILE.h264 : encoded video from files (repeat it) instead of the camera, at the frame rate or --max-speed\n"
+                         "  --max-speed : replay as fast as the writers take it\n"
+                         "  --loops N : times the files are replayed, 0 : until stopped\n"
+                         "  --timeout MS : time to record, 0 : until stopped (replay : until the files end)\n"
+                         "  --shield TTY|synthetic : the shield's tty, or synthetic telemetry at 100 Hz\n"
+                         "  --bus NAME|none : shared memory the telemetry is published to for other processes (TelemetryBus.h)\n"
+                         "  --telemetry-fsync never|segment|batch : when the CSV files are fsynced (segment)\n"
+                         "  --telemetry-flush MS : telemetry is written out in batches this often (200)\n"
+                         "  --telemetry-overwrite 0|1 : if the telemetry queue fills up, lose the oldest frames rather than the newest (1)\n"
+                         "  --segment-duration MS : a new segment starts at the first IDR after this long (3000), 0 : no limit\n"
+                         "  --segment-size BYTES : ...or after this many bytes (0 : no limit)\n"
+                         "  --request-keyframes 0|1 : ask the encoder for an IDR when a segment is due, instead of waiting for one (1)\n"
+                         "  --storage-quota MIB : black box : the oldest unlocked segments are deleted past it (0 : no limit)\n"
+                         "  --storage-reserve MIB : ...or when less is left free on the card (0 : none). Both 0 (the default) : nothing is deleted\n"
+                         "  --lock-before N, --lock-after N : segments kept around an event, before and after its own (2, 2)\n"
+                         "  --braking-threshold KMH_PER_S : deceleration which counts as an event (25)\n"
+                         "  --event-only : keep the video in RAM, write it only around events\n"
+                         "  --pre-event MS, --post-event MS : event only, video kept from before an event, recorded after the last one (30000, 30000)\n"
+                         "  --pre-event-memory MIB : event only, RAM for the video held (96)\n"
+                         "  --sched THREAD=PRIO[@CPU] : THREAD (shield, capture, segments or telemetry) runs SCHED_FIFO at PRIO\n"
+                         "      (1-99, 0 : not), pinned to CPU. Needs root or CAP_SYS_NICE\n"
+                         "  --mlock : lock the recorder in RAM. Needs root or CAP_IPC_LOCK\n"
+                         "  --stats FILE|none : the counters and latency histograms are rewritten to it every --stats-interval MS\n"
+                         "  --stats-socket PATH|none : Unix domain socket sending them on connect (socat - UNIX-CONNECT:PATH)\n"
+                         "  -v : verbose\n", argv[0]);
+         return false;
       }
-
    }
 
-   if (mmal_port_parameter_set_boolean(encoder_input, MMAL_PARAMETER_VIDEO_IMMUTABLE_INPUT, state->immutableInput) != MMAL_SUCCESS)
-   {
-      vcos_log_error("Unable to set immutable input flag");
-      // Continue rather than abort..
-   }
-
-   //  Enable component
-   status = mmal_component_enable(encoder);
+   // A replay runs to the end of the files, unless told otherwise.
+   if (!replay->empty() && !timeout)
+      state->timeout = 0;
 
-   if (status)
-   {
-      vcos_log_error("Unable to enable video encoder component");
-      goto error;
-   }
-
-   /* Create pool of buffer headers for the output port to consume */
-   pool = mmal_port_pool_create(encoder_output, encoder_output->buffer_num, encoder_output->buffer_size);
-
-   if (!pool)
-   {
-      vcos_log_error("Failed to create buffer header pool for encoder output port %s", encoder_output->name);
-   }
-
-   state->encoder_pool = pool;
-   state->encoder_component = encoder;
-
-   if (state->verbose)
-      fprintf(stderr, "Encoder component done\n");
-
-   return encoder;
-
-   error:
-   if (encoder)
-      mmal_component_destroy(encoder);
-
-   return 0;
+   return true;
 }
 
+/// Set by signal_handler, the main loop stops capture on it.
+static volatile sig_atomic_t stop_requested = 0;
+
 /**
- * Destroy the encoder component
+ * Handler for sigint and sigterm signals : the recording is stopped from the main loop, so
+ * the open segment and its telemetry get written out.
  *
- * @param state Pointer to state control struct
+ * @param signal_number ID of incoming signal.
  *
  */
-static void destroy_encoder_component(RASPIVID_STATE *state)
+static void signal_handler(int signal_number)
 {
-   // Get rid of any port buffers first
-   if (state->encoder_pool)
-   {
-      mmal_port_pool_destroy(state->encoder_component->output[0], state->encoder_pool);
-   }
-
-   if (state->encoder_component)
-   {
-      mmal_component_destroy(state->encoder_component);
-      state->encoder_component = NULL;
-   }
+   stop_requested = signal_number;
 }
 
 /**
- * Connect two specific ports together
- *
- * @param output_port Pointer the output port
- * @param input_port Pointer the input port
- * @param Pointer to a mmal connection pointer, reassigned if function successful
- * @return Returns a MMAL_STATUS_T giving result of operation
- *
+ * Reads the shield for as long as the recorder runs. If the port isn't there or hangs up
+ * (a USB adapter pulled out), it is opened anew every SHIELD_RETRY_MS, instead of spinning.
  */
-static MMAL_STATUS_T connect_ports(MMAL_PORT_T *output_port, MMAL_PORT_T *input_port, MMAL_CONNECTION_T **connection)
+void shieldThread (std::string const &portFile, Queue *queue, TelemetryBus *bus, ThreadPolicy policy, LoopStats *timing, ShieldCounters *counters)
 {
-   MMAL_STATUS_T status;
-
-   status =  mmal_connection_create(connection, output_port, input_port, MMAL_CONNECTION_FLAG_TUNNELLING | MMAL_CONNECTION_FLAG_ALLOCATION_ON_INPUT);
-
-   if (status == MMAL_SUCCESS)
-   {
-      status =  mmal_connection_enable(*connection);
-      if (status != MMAL_SUCCESS)
-         mmal_connection_destroy(*connection);
-   }
+        const int SHIELD_RETRY_MS = 1000;
+        applyThreadPolicy (policy, "shield");
+        uint8_t cnt = 0;
+        char mark[] = { '/', '-', '\\', '|' };
+        bool missing = false;
 
-   return status;
-}
+        while (true) {
+                if (access (portFile.c_str (), R_OK) != 0) {
+                        if (!missing) {
+                                std::cerr << "shieldThread : can't open " << portFile << ", no telemetry until it can" << std::endl;
+                                missing = true;
+                        }
+
+                        usleep (SHIELD_RETRY_MS * 1000);
+                        continue;
+                }
 
-/**
- * Checks if specified port is valid and enabled, then disables it
- *
- * @param port  Pointer the port
- *
- */
-static void check_disable_port(MMAL_PORT_T *port)
-{
-   if (port && port->is_enabled)
-      mmal_port_disable(port);
-}
+                missing = false;
+                Shield port (portFile, 38400, counters);
+                Frame frame;
 
-/**
- * Handler for sigint signals
- *
- * @param signal_number ID of incoming signal.
- *
- */
-static void signal_handler(int signal_number)
-{
-   // Going to abort on all signals
-   vcos_log_error("Aborting program\n");
+                if (!port.isOpen ()) {
+                        usleep (SHIELD_RETRY_MS * 1000);
+                        continue;
+                }
 
-   // TODO : Need to close any open stuff...how?
+                while (port.read (&frame)) {
+#if 0
+                        std::cout << "\033[A\033[2K" << frame << " [" << mark[++cnt % 4] << "]" << std::endl;
+#endif
+                        timing->iteration (monotonicNs ());
+                        bus->publish (frame);
+                        // A full queue is counted (Queue::counters), not waited for : the port must be read on time.
+                        queue->push (frame);
+                }
 
-   exit(255);
+                std::cerr << "shieldThread : " << portFile << " lost, opening it again" << std::endl;
+                usleep (SHIELD_RETRY_MS * 1000);
+        }
 }
 
 /**
- *
+ * Telemetry for replays, with no shield : 100 frames/s of a made up ride, the brakes
+ * applied hard every minute.
  */
-void shieldThread (std::string const &portFile, Queue *queue)
+void syntheticShieldThread (Queue *queue, TelemetryBus *bus, ThreadPolicy policy, LoopStats *timing, ShieldCounters *counters)
 {
-        Shield port (portFile);
-        uint8_t cnt = 0;
-        char mark[] = { '/', '-', '\\', '|' };
-
-        while (true) {
-#if 0
-                std::cout << "\033[A\033[2K" << port.read () << " [" << mark[++cnt % 4] << "]" << std::endl;
-#endif
-                queue->push (port.read ());
+        const uint64_t PERIOD_NS = 10000000ULL;
+        applyThreadPolicy (policy, "shield");
+        uint64_t next = monotonicNs ();
+
+        for (uint64_t n = 0;; ++n) {
+                next += PERIOD_NS;
+                sleepUntil (next);
+                uint64_t now = monotonicNs ();
+                timing->woke (next, now);
+                timing->iteration (now);
+
+                double t = double (n % 6000) / 100.0;
+                Frame frame;
+                frame.timestamp = next;
+                frame.frontBrake = frame.rearBrake = (t >= 50 && t < 53);
+                frame.velocity = (frame.frontBrake) ? 90 - 30 * (t - 50) : 60 + 30 * std::sin (t / 50 * M_PI);
+                frame.rpm = 2000 + frame.velocity * 60;
+                frame.engineTemp = 90;
+                frame.airTemp = 20;
+                bus->publish (frame);
+                ShieldCounters::bump (counters->frames);
+                queue->push (frame);
         }
 }
 
@@ -709,24 +438,15 @@ int main(int argc, const char **argv)
 {
    // Our main data storage vessel..
    RASPIVID_STATE state;
+   std::vector <std::string> replay;
 
-   MMAL_STATUS_T status = MMAL_STATUS_MAX;
-   MMAL_PORT_T *camera_preview_port = NULL;
-   MMAL_PORT_T *camera_video_port = NULL;
-   MMAL_PORT_T *camera_still_port = NULL;
-   MMAL_PORT_T *preview_input_port = NULL;
-   MMAL_PORT_T *encoder_input_port = NULL;
-   MMAL_PORT_T *encoder_output_port = NULL;
-   FILE *output_file = NULL;
-
-   bcm_host_init();
+   default_status(&state);
 
-   // Register our application with the logging system
-   vcos_log_register("RaspiVid", VCOS_LOG_CATEGORY);
+   if (!parse_args(argc, argv, &state, &replay))
+      return 1;
 
    signal(SIGINT, signal_handler);
-
-   default_status(&state);
+   signal(SIGTERM, signal_handler);
 
    if (state.verbose)
    {
@@ -734,196 +454,132 @@ int main(int argc, const char **argv)
       dump_status(&state);
    }
 
-   // OK, we have a nice set of parameters. Now set up our components
-   // We have three components. Camera, Preview and encoder.
+   std::unique_ptr <CaptureSource> source;
 
-   if (!create_camera_component(&state))
+   if (!replay.empty ())
    {
-      vcos_log_error("%s: Failed to create camera component", __func__);
+      source.reset (new ReplayCapture (replay, state.framerate, !state.replayMaxSpeed, state.replayLoops));
    }
-   else if (!create_encoder_component(&state))
+   else
    {
-      vcos_log_error("%s: Failed to create encode component", __func__);
-      destroy_camera_component(&state);
+#ifdef WITH_MMAL
+      CaptureSettings settings = { state.width, state.height, state.bitrate, state.framerate, state.intraperiod };
+      source.reset (new MmalCapture (settings, state.verbose));
+#else
+      fprintf(stderr, "Built without MMAL, there is no camera : use --replay\n");
+      return 1;
+#endif
+   }
+
+   Queue queue (state.telemetryOverwrite);
+   TelemetryBus bus (state.bus);
+   SegmentRing ring (".", uint64_t (state.storageQuota) << 20, uint64_t (state.storageReserve) << 20, state.lockBefore, state.lockAfter);
+   EventDetector events (state.brakingThreshold);
+   EventRecording recording (state.preEventDuration, state.postEventDuration);
+   TelemetryWriter telemetry (&queue, state.telemetryFsync, state.telemetryFlushInterval, &events, &ring, (state.eventOnly) ? &recording : NULL);
+   Segmenter segmenter (state.segmentDuration, state.segmentSize, SegmentRing::nextSegment ("."));
+   SegmentStorage storage (".", (state.segmentSize) ? state.segmentSize + state.segmentSize / 4
+                                                    : SegmentStorage::expectedSize (state.bitrate, state.segmentDuration));
+   SegmentWriter segments (&storage, (state.eventOnly) ? size_t (state.preEventMemory) << 20 : 8 << 20, 256 << 10, 1 << 20, 200,
+                           (state.eventOnly) ? &recording : NULL);
+   FrameIndexer indexer;
+   Histogram callbackTime;
+
+   // The video ring lets go of held segments once 7/8 full, and the oldest has to be a whole segment before the window.
+   if (state.eventOnly && (uint64_t (state.preEventMemory) << 20) * 7 / 8 <
+                          uint64_t (state.bitrate) / 8 * (state.preEventDuration + 2 * state.segmentDuration) / 1000)
+      fprintf(stderr, "%u MiB may hold less than %d ms of video before an event\n", state.preEventMemory, state.preEventDuration);
+
+   // 100 frames/s. Only added to by the shield thread, which is never joined.
+   LoopStats shieldTiming (10000000ULL);
+   ShieldCounters shieldCounters;
+
+   // Before the threads start, so their stacks are locked as well.
+   if (state.lockMemory)
+      lockMemory ();
+
+   Recorder recorder (&segmenter, &indexer, &telemetry, &segments, &callbackTime, state.capturePolicy,
+                      1000000000ULL / std::max (state.framerate, 1));
+   segments.start (state.segmentsPolicy);
+
+   if (std::string (state.bus) != "none")
+      bus.open ();
+
+   // Start shield process;
+   if (std::string (state.shield) == "synthetic")
+   {
+      std::thread t {syntheticShieldThread, &queue, &bus, state.shieldPolicy, &shieldTiming, &shieldCounters};
+      t.detach ();
    }
    else
    {
-      PORT_USERDATA callback_data;
-      Queue queue;
-
-      if (state.verbose)
-         fprintf(stderr, "Starting component connection stage\n");
-
-      camera_preview_port = state.camera_component->output[MMAL_CAMERA_PREVIEW_PORT];
-      camera_video_port   = state.camera_component->output[MMAL_CAMERA_VIDEO_PORT];
-      camera_still_port   = state.camera_component->output[MMAL_CAMERA_CAPTURE_PORT];
-      encoder_input_port  = state.encoder_component->input[0];
-      encoder_output_port = state.encoder_component->output[0];
-
-         if (state.verbose)
-            fprintf(stderr, "Connecting camera stills port to encoder input port\n");
-
-         // Now connect the camera to the encoder
-         status = connect_ports(camera_video_port, encoder_input_port, &state.encoder_connection);
-
-         if (status != MMAL_SUCCESS)
-         {
-            vcos_log_error("%s: Failed to connect camera video port to encoder input", __func__);
-            goto error;
-         }
-
-         if (state.filename)
-         {
-//            if (state.filename[0] == '-')
-//            {
-//               output_file = stdout;
-//
-//               // Ensure we don't upset the output stream with diagnostics/info
-//               state.verbose = 0;
-//            }
-//            else
-//            {
-//               if (state.verbose)
-//                  fprintf(stderr, "Opening output file \"%s\"\n", state.filename);
-//
-               output_file = fopen(state.filename, "wb");
-//            }
-//
-//            if (!output_file)
-//            {
-//               // Notify user, carry on but discarding encoded output buffers
-//               vcos_log_error("%s: Error opening output file: %s\nNo output file will be generated\n", __func__, state.filename);
-//            }
-         }
-
-         // Set up our userdata - this is passed though to the callback where we need the information.
-         callback_data.file_handle = rotateFiles (NULL);
-         callback_data.pstate = &state;
-         callback_data.abort = 0;
-         callback_data.queue = &queue;
-
-         encoder_output_port->userdata = (struct MMAL_PORT_USERDATA_T *)&callback_data;
-
-         if (state.verbose)
-            fprintf(stderr, "Enabling encoder output port\n");
-
-         // Enable the encoder output port and tell it its callback function
-         status = mmal_port_enable(encoder_output_port, encoder_buffer_callback);
-
-         if (status != MMAL_SUCCESS)
-         {
-            vcos_log_error("Failed to setup encoder output");
-            goto error;
-         }
-
-
-            // Only encode stuff if we have a filename and it opened
-            if (output_file)
-            {
-               int wait;
-
-               if (state.verbose)
-                  fprintf(stderr, "Starting video capture\n");
-
-               // Start shield process;
-                std::thread t {shieldThread, std::string (PORT), &queue};
-                t.detach ();
-
-               if (mmal_port_parameter_set_boolean(camera_video_port, MMAL_PARAMETER_CAPTURE, 1) != MMAL_SUCCESS)
-               {
-                  goto error;
-               }
-
-               // Send all the buffers to the encoder output port
-               {
-                  int num = mmal_queue_length(state.encoder_pool->queue);
-                  int q;
-                  for (q=0;q<num;q++)
-                  {
-                     MMAL_BUFFER_HEADER_T *buffer = mmal_queue_get(state.encoder_pool->queue);
-
-                     if (!buffer)
-                        vcos_log_error("Unable to get a required buffer %d from pool queue", q);
-
-                     if (mmal_port_send_buffer(encoder_output_port, buffer)!= MMAL_SUCCESS)
-                        vcos_log_error("Unable to send a buffer to encoder output port (%d)", q);
-
-                  }
-               }
-
-               // Now wait until we need to stop. Whilst waiting we do need to check to see if we have aborted (for example
-               // out of storage space)
-               // Going to check every ABORT_INTERVAL milliseconds
-
-               for (wait = 0; state.timeout == 0 || wait < state.timeout; wait+= ABORT_INTERVAL)
-               {
-                  vcos_sleep(ABORT_INTERVAL);
-                  if (callback_data.abort)
-                     break;
-               }
-
-               if (state.verbose)
-                  fprintf(stderr, "Finished capture\n");
-            }
-            else
-            {
-               if (state.timeout)
-                  vcos_sleep(state.timeout);
-               else
-                  for (;;) vcos_sleep(ABORT_INTERVAL);
-            }
-
-
-error:
-
-      mmal_status_to_int(status);
-
-      if (state.verbose)
-         fprintf(stderr, "Closing down\n");
-
-      // Disable all our ports that are not handled by connections
-      check_disable_port(camera_still_port);
-      check_disable_port(encoder_output_port);
+      std::thread t {shieldThread, std::string (state.shield), &queue, &bus, state.shieldPolicy, &shieldTiming, &shieldCounters};
+      t.detach ();
+   }
 
-      mmal_connection_destroy(state.encoder_connection);
+   telemetry.start (state.telemetryPolicy);
+   ring.start ();
+
+   RecorderStats sources;
+   sources.shield = &shieldCounters;
+   sources.shieldTiming = &shieldTiming;
+   sources.queue = &queue;
+   sources.callbackTime = &callbackTime;
+   sources.recorder = &recorder;
+   sources.segments = &segments;
+   sources.telemetry = &telemetry;
+   StatsReporter stats (sources, (std::string (state.statsFile) != "none") ? state.statsFile : "",
+                        (std::string (state.statsSocket) != "none") ? state.statsSocket : "", state.statsInterval);
+   stats.start ();
+
+   if (source->start (&recorder))
+   {
+      int wait;
 
-      // Can now close our file. Note disabling ports may flush buffers which causes
-      // problems if we have already closed the file!
-      if (output_file && output_file != stdout)
-         fclose(output_file);
+      // Now wait until we need to stop. Whilst waiting we do need to check to see if we have aborted (for example
+      // out of storage space), the replay has ended, or we were signalled.
+      // Going to check every ABORT_INTERVAL milliseconds
 
-      /* Disable components */
-      if (state.encoder_component)
-         mmal_component_disable(state.encoder_component);
+      for (wait = 0; state.timeout == 0 || wait < state.timeout; wait+= ABORT_INTERVAL)
+      {
+         usleep(ABORT_INTERVAL * 1000);
+         if (recorder.aborted () || source->finished () || stop_requested)
+            break;
 
-      if (state.camera_component)
-         mmal_component_disable(state.camera_component);
+         // Parameters can't be set from the encoder callback, so the IDR is asked for here, up to ABORT_INTERVAL late.
+         if (state.requestKeyframes && segmenter.keyframeWanted ())
+            source->requestKeyframe ();
+      }
 
-      destroy_encoder_component(&state);
-      destroy_camera_component(&state);
+      if (stop_requested)
+         fprintf(stderr, "Stopping on signal %d\n", int(stop_requested));
 
       if (state.verbose)
-         fprintf(stderr, "Close down completed, all components disconnected, disabled and destroyed\n\n");
+         fprintf(stderr, "Finished capture\n");
+   }
+
+   source->stop ();
+
+   // Encoder is done, write out the rest of the video and telemetry.
+   segments.stop ();
+   telemetry.stop ();
+   ring.stop ();
+   stats.stop ();
+
+   callbackTime.printSummary (std::cerr, "encoder callback", "us");
+   callbackTime.print (std::cerr, "  ", "us");
+   segments.writeLatency ().printSummary (std::cerr, "segment write", "us");
+   segments.rotationLatency ().printSummary (std::cerr, "segment rotation", "us");
+   queue.counters ().printSummary (std::cerr, "telemetry queue");
+   recorder.loopStats ().printSummary (std::cerr, "capture");
+   segments.loopStats ().printSummary (std::cerr, "segment writer");
+   telemetry.loopStats ().printSummary (std::cerr, "telemetry writer");
+   shieldTiming.printSummary (std::cerr, "shield");
+   std::cerr << "shield : " << shieldCounters.frames << " frames, " << shieldCounters.checksumRejects << " checksum rejects" << std::endl;
+
+   if (segments.dropped ()) {
+      std::cerr << segments.dropped () << " encoder buffers dropped" << std::endl;
    }
-   if (status != 0)
-      raspicamcontrol_check_configuration(128);
 
    return 0;
 }
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
@@ -32,15 +32,18 @@
 #define  GPIO_FRONT_BRAKE_BIT 2
 #define  GPIO_REAR_BRAKE_BIT 3
 #define  GPIO_PARKING_LIGHT_BIT 4
+#define  GPIO_EVENT_BUTTON_BIT 5
 #define BUF_AIR_TEMP 5
 
 #define DDR_GPIO DDRA
 #define PIN_GPIO PINA
+#define PORT_GPIO PORTA
 #define GPIO_LEFT_TURN_PIN PA0
 #define GPIO_RIGHT_TURN_PIN PA1
 #define GPIO_FRONT_BRAKE_PIN PA2
 #define GPIO_REAR_BRAKE_PIN PA3
 #define GPIO_PARKING_LIGHT_PIN PA4
+#define GPIO_EVENT_BUTTON_PIN PA5
 
 #define BUFLEN 6
 #define ECU_FRAME_SIZE 6
@@ -116,6 +119,7 @@ void initInitGPIO (void)
 {
         // All as input
         DDR_GPIO = 0x00;
+        PORT_GPIO |= (1 << GPIO_EVENT_BUTTON_PIN);
 
         // Debug outputs for analyzer.
         DDRE = (1 << PE4) | (1 << PE5);
@@ -324,6 +328,11 @@ void checkGPIO (void)
         state |= (PIN_GPIO & (1 << GPIO_LEFT_TURN_PIN)) << GPIO_LEFT_TURN_BIT;
         state |= (PIN_GPIO & (1 << GPIO_PARKING_LIGHT_PIN)) << GPIO_PARKING_LIGHT_BIT;
 
+        // Momentary button to ground, the pull-up is enabled in initInitGPIO.
+        if (!(PIN_GPIO & (1 << GPIO_EVENT_BUTTON_PIN))) {
+                state |= 1 << GPIO_EVENT_BUTTON_BIT;
+        }
+
         buffer[BUF_GPIO] = state;
 }
 